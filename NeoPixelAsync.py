@@ -0,0 +1,55 @@
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+
+# NeoPixel.showAsync(): show() for asyncio. Importing this module adds it to
+# the NeoPixel class. The frame goes out through submit(); if the wire is
+# busy it waits on the completion descriptor in the event loop until the
+# frame has been started, so at most one frame is ever queued behind the one
+# being sent. Only one task should await it per strip.
+
+import asyncio
+
+from NeoPixel import NeoPixel
+
+async def showAsync(self):
+    if self.submit():
+        return
+    loop=asyncio.get_event_loop()
+    fd=self.getCompletionFD()
+    if fd<0:
+        await loop.run_in_executor(None, self.show)
+        return
+    while True:
+        waiter=loop.create_future()
+        def wake():
+            if not waiter.done():
+                waiter.set_result(None)
+        loop.add_reader(fd, wake)
+        try:
+            await waiter
+        finally:
+            loop.remove_reader(fd)
+        if self.handleCompletion():
+            return
+
+NeoPixel.showAsync=showAsync
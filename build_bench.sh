@@ -0,0 +1,6 @@
+case "$(uname -m)" in
+    armv7*|armv8*) SIMD_FLAGS="-mfpu=neon" ;;
+    x86_64|i?86) SIMD_FLAGS="-mssse3" ;;
+esac
+g++ -O2 -c $SIMD_FLAGS ws2812-rpi-encoder-simd.cpp
+g++ -O2 ws2812-rpi.cpp ws2812-rpi-encoder.cpp ws2812-rpi-encoder-simd.o ws2812-rpi-softdma.cpp ws2812-rpi-transport.cpp ws2812-rpi-scheduler.cpp ws2812-rpi-effects.cpp ws2812-rpi-recording.cpp ws2812-rpi-workers.cpp ws2812-rpi-decoder.cpp ws2812-rpi-opc.cpp ws2812-rpi-ring.cpp ws2812-rpi-bench.cpp -o ws2812-rpi-bench -lrt -lpthread
@@ -1,3 +1,26 @@
-g++ -c ws2812-rpi.cpp
-g++ -c -I/usr/include/python2.7 -I/usr/include -fPIC  ws2812-rpi-python.cpp
-g++ -shared -Wl,--export-dynamic ws2812-rpi.o ws2812-rpi-python.o -L/usr/lib -lboost_python-py27 -L/usr/lib/python2.7/config -lpython2.7 -o NeoPixel.so
+case "$(uname -m)" in
+    armv7*|armv8*) SIMD_FLAGS="-mfpu=neon" ;;
+    x86_64|i?86) SIMD_FLAGS="-mssse3" ;;
+esac
+# Python 3, and the Boost Python built for it, which Debian names after the
+# version (libboost_python311) and older releases just libboost_python3
+PYTHON=${PYTHON:-python3}
+PY_VERSION=$($PYTHON -c 'import sys; print("%d%d" % sys.version_info[:2])')
+PY_INCLUDES=$($PYTHON-config --includes)
+BOOST_PYTHON=boost_python$PY_VERSION
+if [ -z "$(ls /usr/lib/libboost_python$PY_VERSION.so /usr/lib/*/libboost_python$PY_VERSION.so 2>/dev/null)" ]; then
+    BOOST_PYTHON=boost_python3
+fi
+g++ -c -fPIC ws2812-rpi.cpp
+g++ -c -fPIC ws2812-rpi-encoder.cpp
+g++ -c -fPIC ws2812-rpi-softdma.cpp
+g++ -c -fPIC ws2812-rpi-transport.cpp
+g++ -c -fPIC ws2812-rpi-scheduler.cpp
+g++ -c -fPIC ws2812-rpi-effects.cpp
+g++ -c -fPIC ws2812-rpi-decoder.cpp
+g++ -c -fPIC ws2812-rpi-ring.cpp
+g++ -c -fPIC ws2812-rpi-recording.cpp
+g++ -c -fPIC ws2812-rpi-workers.cpp
+g++ -c -fPIC $SIMD_FLAGS ws2812-rpi-encoder-simd.cpp
+g++ -c -fPIC $PY_INCLUDES ws2812-rpi-python.cpp
+g++ -shared -Wl,--export-dynamic ws2812-rpi.o ws2812-rpi-encoder.o ws2812-rpi-encoder-simd.o ws2812-rpi-softdma.o ws2812-rpi-transport.o ws2812-rpi-scheduler.o ws2812-rpi-effects.o ws2812-rpi-decoder.o ws2812-rpi-ring.o ws2812-rpi-recording.o ws2812-rpi-workers.o ws2812-rpi-python.o -l$BOOST_PYTHON -lrt -lpthread -o NeoPixel.so
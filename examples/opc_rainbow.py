@@ -0,0 +1,67 @@
+#!/usr/bin/python3
+
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+
+# An Open Pixel Control producer for ws2812-rpi-opcd: a rainbow chasing
+# along the strip at 30 frames per second. It needs no root and no NeoPixel
+# module, just a socket. Start the daemon first, for example:
+#
+#   sudo ./ws2812-rpi-opcd --leds 60 --unix /tmp/ws2812.sock
+#   ./examples/opc_rainbow.py /tmp/ws2812.sock 60
+#
+# or give a port number instead of a path to connect over localhost TCP.
+
+import socket
+import struct
+import sys
+from time import sleep
+
+def wheel(pos):
+    if pos<85: return (pos*3, 255-pos*3, 0)
+    if pos<170:
+        pos-=85
+        return (255-pos*3, 0, pos*3)
+    pos-=170
+    return (0, pos*3, 255-pos*3)
+
+if __name__=="__main__":
+    if len(sys.argv)!=3:
+        print("Usage: %s PATH|PORT LEDS" % sys.argv[0])
+        sys.exit(1)
+    if sys.argv[1].isdigit():
+        s=socket.create_connection(("127.0.0.1", int(sys.argv[1])))
+    else:
+        s=socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        s.connect(sys.argv[1])
+    numLEDs=int(sys.argv[2])
+
+    frame=0
+    while True:
+        pixels=bytearray()
+        for i in range(numLEDs):
+            pixels+=bytearray(wheel((i*256//numLEDs+frame)&255))
+        # Channel 0 (the whole strip), command 0 (set pixels), then the length
+        s.sendall(struct.pack(">BBH", 0, 0, len(pixels))+pixels)
+        frame+=1
+        sleep(1./30)
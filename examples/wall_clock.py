@@ -1,4 +1,4 @@
-#!/usr/bin/python
+#!/usr/bin/python3
 
 ###############################################################################
 #                                                                             #
@@ -65,30 +65,29 @@ class WallClock(object):
         # The hour is shown at every 5th LED
         hour*=5
 
-        # Clear the display
-        self.clear()
+        # Build the whole frame, every pixel off to start with,
+        # and hand it over in one go
+        frame=bytearray(60*3)
 
         # Set the hour LED to blue
-        self._strip.setPixelColor(hour, 0, 0, 255)
+        self.setPixel(frame, hour, 0, 0, 255)
 
         # Set the minute LED to red unless the minute
         # hour LED are the same then alternate the colour
         # between red and blue every second
         if hour==minute and second%2:
-            self._strip.setPixelColor(minute, 0, 0, 255)
-        else: self._strip.setPixelColor(minute, 255, 0, 0)
+            self.setPixel(frame, minute, 0, 0, 255)
+        else: self.setPixel(frame, minute, 255, 0, 0)
 
         # Set the second LED to green
-        self._strip.setPixelColor(second, 0, 255, 0)
+        self.setPixel(frame, second, 0, 255, 0)
 
         # Update the display
+        self._strip.setPixels(frame)
         self._strip.show()
 
-    def clear(self):
-        # Set every pixel off
-        for i in range(60):
-            self._strip.setPixelColor(i, 0, 0, 0)
-        self._strip.show()
+    def setPixel(self, frame, n, r, g, b):
+        frame[n*3:n*3+3]=bytearray((r, g, b))
 
 if __name__=="__main__":
     w=WallClock()
@@ -0,0 +1,12 @@
+# Builds and runs the benchmarks on the loopback transport and collects every
+# result in one CSV file (bench-results.csv unless another is given). The
+# Python benchmark is included when NeoPixel.so has been built, run with
+# $PYTHON if set and python3 otherwise, which build_python.sh builds for.
+OUT="${1:-bench-results.csv}"
+./build_bench.sh || exit 1
+./ws2812-rpi-bench --csv "$OUT" || exit 1
+if [ -f NeoPixel.so ]; then
+    ${PYTHON:-python3} ws2812-rpi-bench.py --csv "$OUT.python" || exit 1
+    tail -n +2 "$OUT.python" >> "$OUT"
+    rm -f "$OUT.python"
+fi
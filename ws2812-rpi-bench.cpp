@@ -0,0 +1,1983 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include <vector>
+#include <algorithm>
+#include "ws2812-rpi.h"
+#include "ws2812-rpi-effects.h"
+#include "ws2812-rpi-decoder.h"
+#include "ws2812-rpi-opc.h"
+#include "ws2812-rpi-ring.h"
+#include "ws2812-rpi-recording.h"
+
+// Encoder and show() benchmarks. Everything runs through the loopback
+// transport and its software DMA stand-in, so nothing touches /dev/mem and it
+// can be run anywhere.
+//
+// With --csv FILE every result is also written to FILE, one per line as
+// suite,name,leds,value,unit, so runs from different releases can be
+// compared line by line.
+
+static FILE *results = 0;
+
+static double nowNS(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Appends a result to the CSV file, if one was asked for
+static void record(const char *suite, const char *name, unsigned int numLEDs, double value, const char *unit){
+    if(results) {
+        fprintf(results, "%s,%s,%u,%.3f,%s\n", suite, name, numLEDs, value, unit);
+    }
+}
+
+// The original per-bit encoder from NeoPixel::show(), kept as the reference
+static void setPWMBit(unsigned int *words, unsigned int bitPos, unsigned char bit){
+    unsigned int wordOffset = (int)(bitPos / 32);
+    unsigned int bitIdx = bitPos - (wordOffset * 32);
+
+    switch(bit) {
+        case 1:
+            words[wordOffset] |= (1 << (31 - bitIdx));
+            break;
+        case 0:
+            words[wordOffset] &= ~(1 << (31 - bitIdx));
+            break;
+    }
+}
+
+static void referenceEncode(const Color_t *leds, unsigned int numLEDs, unsigned int *words){
+    unsigned int i, wireBit = 0, colorBits;
+    int j;
+
+    for(i=0; i<numLEDs; i++) {
+        colorBits = ((unsigned int)leds[i].r << 8) | ((unsigned int)leds[i].g << 16) | leds[i].b;
+        for(j=23; j>=0; j--) {
+            setPWMBit(words, wireBit++, 1);
+            setPWMBit(words, wireBit++, (colorBits & (1 << j)) ? 1 : 0);
+            setPWMBit(words, wireBit++, 0);
+        }
+    }
+}
+
+// The same bit by bit, for colour bytes already in wire order
+static void referenceEncodeBytes(const uint8_t *bytes, unsigned int numBytes, unsigned int *words){
+    unsigned int i, wireBit = 0;
+    int j;
+
+    for(i=0; i<numBytes; i++) {
+        for(j=7; j>=0; j--) {
+            setPWMBit(words, wireBit++, 1);
+            setPWMBit(words, wireBit++, (bytes[i] & (1 << j)) ? 1 : 0);
+            setPWMBit(words, wireBit++, 0);
+        }
+    }
+}
+
+// What the lookup table is documented to do, worked out the long way
+static unsigned char referenceLevel(unsigned char v, float brightness, float gamma, unsigned char white){
+    uint32_t curve = (gamma == 1.0f) ? v : (uint32_t)(255 * pow(v / 255.0, gamma) + 0.5);
+    uint32_t level = (uint32_t)(brightness * white * 257 + 0.5f);
+    return (curve * level + 32767) >> 16;
+}
+
+static void referenceAdjust(std::vector<Color_t>& leds, float brightness, float gamma, Color_t white){
+    for(unsigned int i=0; i<leds.size(); i++) {
+        leds[i].r = referenceLevel(leds[i].r, brightness, gamma, white.r);
+        leds[i].g = referenceLevel(leds[i].g, brightness, gamma, white.g);
+        leds[i].b = referenceLevel(leds[i].b, brightness, gamma, white.b);
+    }
+}
+
+static void randomFrame(std::vector<Color_t>& leds){
+    for(unsigned int i=0; i<leds.size(); i++) {
+        leds[i] = Color_t(rand(), rand(), rand());
+    }
+}
+
+struct FormatCase {
+    const char *name;
+    unsigned int flag;
+    WS2812Encoder::EncodeFunc encode;
+};
+
+static const FormatCase formats[] = {
+    { "GRB", NEOPIXEL_GRB, &WS2812Encoder::encodeFormat<FormatGRB> },
+    { "RGB", NEOPIXEL_RGB, &WS2812Encoder::encodeFormat<FormatRGB> },
+    { "GRBW", NEOPIXEL_GRBW, &WS2812Encoder::encodeFormat<FormatGRBW> },
+    { "RGBW", NEOPIXEL_RGBW, &WS2812Encoder::encodeFormat<FormatRGBW> },
+};
+#define NUM_FORMATS (sizeof(formats) / sizeof(formats[0]))
+
+// Colour bytes in the order the format's name gives
+static void formatBytes(const char *order, const std::vector<Color_t>& leds, const std::vector<uint8_t>& white,
+                        std::vector<uint8_t>& bytes){
+    unsigned int i;
+    const char *c;
+
+    bytes.clear();
+    for(i=0; i<leds.size(); i++) {
+        for(c=order; *c; c++) {
+            bytes.push_back(*c == 'R' ? leds[i].r : *c == 'G' ? leds[i].g : *c == 'B' ? leds[i].b : white[i]);
+        }
+    }
+}
+
+// Every format's encoder, scalar and SIMD, against the bit by bit encoder
+// fed the bytes in that format's order
+static bool verifyFormats(unsigned int numLEDs){
+    std::vector<Color_t> leds(numLEDs);
+    std::vector<uint8_t> white(numLEDs), bytes;
+    unsigned int f, i, k;
+
+    randomFrame(leds);
+    for(i=0; i<numLEDs; i++) {
+        white[i] = rand();
+    }
+    for(f=0; f<NUM_FORMATS; f++) {
+        unsigned int channels = WS2812Encoder::channelsFor(formats[f].flag);
+        unsigned int words = WS2812Encoder::wordsForLEDs(numLEDs, channels);
+        std::vector<unsigned int> ref(words + 1, 0), out(words + 1, 0);
+
+        formatBytes(formats[f].name, leds, white, bytes);
+        referenceEncodeBytes(bytes.data(), bytes.size(), ref.data());
+        for(k=0; k<2; k++) {
+            if(!WS2812Encoder::useSIMD(k == 1)) {
+                continue;
+            }
+            std::fill(out.begin(), out.end(), 0);
+            if(formats[f].encode(leds.data(), white.data(), numLEDs, out.data(), words, 0) != words ||
+               memcmp(ref.data(), out.data(), (words + 1) * 4) != 0) {
+                printf("%s %s encoder output differs from reference for %d LEDs\n",
+                       formats[f].name, WS2812Encoder::kernelName(), numLEDs);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool verify(unsigned int numLEDs){
+    std::vector<Color_t> leds(numLEDs), adjusted;
+    unsigned int words = WS2812Encoder::wordsForLEDs(numLEDs);
+    std::vector<unsigned int> ref(words + 1, 0), out(words + 1, 0);
+    SymbolLUT lut;
+
+    randomFrame(leds);
+    referenceEncode(leds.data(), numLEDs, ref.data());
+
+    WS2812Encoder::useSIMD(false);
+    WS2812Encoder::encode(leds.data(), numLEDs, out.data(), words);
+    if(memcmp(ref.data(), out.data(), (words + 1) * 4) != 0) {
+        printf("Scalar encoder output differs from reference for %d LEDs\n", numLEDs);
+        return false;
+    }
+
+    if(WS2812Encoder::useSIMD(true)) {
+        std::fill(out.begin(), out.end(), 0);
+        WS2812Encoder::encode(leds.data(), numLEDs, out.data(), words);
+        if(memcmp(ref.data(), out.data(), (words + 1) * 4) != 0) {
+            printf("%s encoder output differs from reference for %d LEDs\n",
+                   WS2812Encoder::kernelName(), numLEDs);
+            return false;
+        }
+    }
+
+    // Through a brightness, gamma and white balance table
+    adjusted = leds;
+    referenceAdjust(adjusted, 0.6f, 2.2f, Color_t(255, 200, 180));
+    std::fill(ref.begin(), ref.end(), 0);
+    referenceEncode(adjusted.data(), numLEDs, ref.data());
+    WS2812Encoder::buildLUT(lut, 0.6f, 2.2f, Color_t(255, 200, 180));
+    std::fill(out.begin(), out.end(), 0);
+    WS2812Encoder::encode(leds.data(), numLEDs, out.data(), words, &lut);
+    if(memcmp(ref.data(), out.data(), (words + 1) * 4) != 0) {
+        printf("Encoder output through a lookup table differs from reference for %d LEDs\n", numLEDs);
+        return false;
+    }
+
+    // The decoder has to read the encoder's output back pulse by pulse, all
+    // of it within the datasheet timing
+    {
+        std::vector<uint32_t> wire(ref.begin(), ref.end());
+        std::vector<Color_t> decoded;
+        WaveformTiming timing;
+
+        std::fill(wire.begin(), wire.end(), 0);
+        WS2812Encoder::encode(leds.data(), numLEDs, (unsigned int*)wire.data(), words);
+        if(WS2812Decoder::decode(wire, decoded, &timing) != numLEDs || decoded != leds || timing.errors != 0) {
+            printf("Decoding %d encoded LEDs gave %d LEDs and %d timing errors\n",
+                   numLEDs, (int)decoded.size(), timing.errors);
+            return false;
+        }
+    }
+
+    // And the identity table has to go through the plain encoder untouched
+    WS2812Encoder::buildLUT(lut, 1.0f, 1.0f, Color_t(255, 255, 255));
+    if(!lut.identity) {
+        printf("Full brightness, linear, white lookup table isn't the identity\n");
+        return false;
+    }
+    return true;
+}
+
+// Run frames back to back through the double buffered show() and check every
+// frame the stand-in put on the wire is the one that was encoded for it
+static bool benchShow(unsigned int numLEDs, unsigned int numFrames){
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    SoftDMA *dma = strip.getSoftDMA();
+    unsigned int words = WS2812Encoder::wordsForLEDs(numLEDs) + 1;
+    std::vector<std::vector<Color_t> > frames(numFrames, std::vector<Color_t>(numLEDs));
+    std::vector<unsigned int> expected(words);
+    double start = 0, elapsed, wireFPS, fps;
+    unsigned int f, i;
+
+    for(f=0; f<numFrames; f++) {
+        randomFrame(frames[f]);
+    }
+
+    for(f=0; f<numFrames; f++) {
+        for(i=0; i<numLEDs; i++) {
+            strip.setPixelUnchecked(i, frames[f][i]);
+        }
+        strip.show();
+        // The first show() doesn't wait, time from when it is on the wire
+        if(f == 0) {
+            start = nowNS();
+        }
+    }
+    while(dma->active());
+    elapsed = nowNS() - start;
+
+    if(dma->numFrames() != numFrames || dma->errors() != 0) {
+        printf("Soft DMA saw %d frames and %d errors, expected %d frames\n",
+               dma->numFrames(), dma->errors(), numFrames);
+        return false;
+    }
+    for(f=0; f<numFrames; f++) {
+        std::fill(expected.begin(), expected.end(), 0);
+        WS2812Encoder::encode(frames[f].data(), numLEDs, expected.data(), words);
+        if(dma->frame(f) != std::vector<uint32_t>(expected.begin(), expected.end())) {
+            printf("Frame %d of %d LEDs was corrupted on the wire\n", f, numLEDs);
+            return false;
+        }
+    }
+
+    wireFPS = 1e9 / (words * 32.0 * PWM_BIT_NSEC + LATCH_USEC * 1000.0);
+    fps = (numFrames - 1) * 1e9 / elapsed;
+    printf("%8d %14.1f %14.1f %13.0f%%\n", numLEDs, fps, wireFPS, 100.0 * fps / wireFPS);
+    record("show", "fps", numLEDs, fps, "fps");
+    record("show", "wire_rate", numLEDs, 100.0 * fps / wireFPS, "%");
+    return true;
+}
+
+// The same through submit() and the completion descriptor, as an event loop
+// would drive it. Every frame is submitted as soon as the last has latched.
+static bool benchSubmit(unsigned int numLEDs, unsigned int numFrames){
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    SoftDMA *dma = strip.getSoftDMA();
+    struct pollfd pfd;
+    unsigned int f = 0, wakeups = 0;
+    double start, fps;
+
+    pfd.fd = strip.getCompletionFD();
+    pfd.events = POLLIN;
+
+    start = nowNS();
+    strip.submit();
+    while(++f < numFrames) {
+        strip.setPixelColor(f % numLEDs, Color_t(f, f, f));
+        if(!strip.submit()) {
+            // Queued; it goes out from handleCompletion()
+            do {
+                poll(&pfd, 1, -1);
+                wakeups++;
+            } while(!strip.handleCompletion());
+        }
+    }
+    while(strip.busy()) {
+        poll(&pfd, 1, -1);
+        strip.handleCompletion();
+    }
+
+    if(dma->numFrames() != numFrames || dma->errors() != 0) {
+        printf("Soft DMA saw %d frames and %d errors from submit(), expected %d\n",
+               dma->numFrames(), dma->errors(), numFrames);
+        return false;
+    }
+    fps = numFrames * 1e9 / (nowNS() - start);
+    printf("%8d %14.1f %14d\n", numLEDs, fps, wakeups);
+    record("submit", "fps", numLEDs, fps, "fps");
+    record("submit", "wakeups", numLEDs, wakeups, "count");
+    return true;
+}
+
+// The run time counters against what the soft DMA actually saw: every frame
+// shown counted once, unchanged frames counted as skipped, one submit()
+// replaced in the queue, and every encode and wait in its histogram.
+// Waits for everything submitted to have gone out
+static void drain(NeoPixel& strip){
+    struct pollfd pfd;
+
+    pfd.fd = strip.getCompletionFD();
+    pfd.events = POLLIN;
+    while(strip.busy()) {
+        poll(&pfd, 1, -1);
+        strip.handleCompletion();
+    }
+}
+
+// Four owners each writing a quarter of one strip. With a show() apiece every
+// frame goes out four times; through views it has to go out once, from the
+// last owner's commit(), and be the whole frame. Releasing the one view that
+// hasn't committed has to let the frame go too.
+static bool benchViews(unsigned int numLEDs, unsigned int numFrames){
+    const unsigned int owners = 4;
+    NeoPixel shown(numLEDs, NEOPIXEL_LOOPBACK), viewed(numLEDs, NEOPIXEL_LOOPBACK);
+    NeoPixelView *views[owners];
+    std::vector<Color_t> leds;
+    unsigned int f, o, quarter = numLEDs / owners, completed = 0;
+    double start, showFPS, viewFPS;
+
+    start = nowNS();
+    for(f=0; f<numFrames; f++) {
+        for(o=0; o<owners; o++) {
+            shown.fill(o * quarter, o + 1 < owners ? quarter : numLEDs - o * quarter, Color_t(f, o, 1));
+            shown.show();
+        }
+    }
+    drain(shown);
+    showFPS = numFrames * 1e9 / (nowNS() - start);
+
+    for(o=0; o<owners; o++) {
+        views[o] = viewed.createView(o * quarter, o + 1 < owners ? quarter : numLEDs - o * quarter);
+    }
+    start = nowNS();
+    for(f=0; f<numFrames; f++) {
+        for(o=0; o<owners; o++) {
+            views[o]->fill(0, views[o]->numPixels(), Color_t(f, o, 1));
+            if(views[o]->commit()) {
+                completed += (o + 1 == owners);
+            }
+        }
+        drain(viewed);
+    }
+    viewFPS = numFrames * 1e9 / (nowNS() - start);
+
+    if(completed != numFrames || viewed.getSoftDMA()->numFrames() != numFrames ||
+       viewed.getSoftDMA()->errors() != 0) {
+        printf("Views on %d LEDs: %d of %d frames completed by the last commit(), %d transfers\n",
+               numLEDs, completed, numFrames, viewed.getSoftDMA()->numFrames());
+        return false;
+    }
+    WS2812Decoder::decode(viewed.getSoftDMA()->frame(numFrames - 1), leds);
+    for(o=0; o<owners; o++) {
+        if(leds[o * quarter] != Color_t(numFrames - 1, o, 1) || leds[numLEDs - 1] != Color_t(numFrames - 1, owners - 1, 1)) {
+            printf("Views on %d LEDs: view %d's pixels didn't reach the wire\n", numLEDs, o);
+            return false;
+        }
+    }
+
+    // Three commit and the fourth goes away instead
+    views[0]->fill(0, quarter, Color_t(1, 2, 3));
+    for(o=0; o<owners-1; o++) {
+        if(views[o]->commit()) {
+            printf("Views on %d LEDs: the frame went out before every view committed\n", numLEDs);
+            return false;
+        }
+    }
+    viewed.releaseView(views[owners - 1]);
+    drain(viewed);
+    if(viewed.numViews() != owners - 1 || viewed.getSoftDMA()->numFrames() != numFrames + 1) {
+        printf("Views on %d LEDs: releasing the last view didn't send the frame\n", numLEDs);
+        return false;
+    }
+
+    printf("%8d %8d %14.1f %14.1f %14d %14d\n", numLEDs, owners, showFPS, viewFPS,
+           shown.getSoftDMA()->numFrames() / numFrames, viewed.getSoftDMA()->numFrames() / numFrames);
+    record("views", "show_fps", numLEDs, showFPS, "fps");
+    record("views", "commit_fps", numLEDs, viewFPS, "fps");
+    return true;
+}
+
+// One owner thread per view for benchViewThreads()
+struct ViewOwner {
+    NeoPixel *strip;
+    NeoPixelView *view;
+    pthread_barrier_t *barrier;
+    unsigned int owner;
+    unsigned int numFrames;
+    unsigned int completed;
+};
+
+static void* viewOwner(void *arg){
+    ViewOwner *o = (ViewOwner *)arg;
+    unsigned int f, i;
+
+    for(f=0; f<o->numFrames; f++) {
+        // Pixel at a time, so owners whose views share a dirty group race
+        // to mark it
+        for(i=0; i<o->view->numPixels(); i++) {
+            o->view->setPixelColor(i, Color_t(f, o->owner, 1));
+        }
+        if(o->view->commit()) {
+            o->completed++;
+        }
+        // Owner 0 sees the frame out before anyone starts the next
+        pthread_barrier_wait(o->barrier);
+        if(o->owner == 0) {
+            drain(*o->strip);
+        }
+        pthread_barrier_wait(o->barrier);
+    }
+    return 0;
+}
+
+// Views written and committed from a thread apiece, over views that don't
+// line up with the dirty groups. Every frame has to go out exactly once,
+// whole, from one commit.
+static bool benchViewThreads(unsigned int numLEDs, unsigned int numFrames){
+    const unsigned int owners = 4;
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    pthread_barrier_t barrier;
+    pthread_t threads[owners];
+    ViewOwner o[owners];
+    std::vector<Color_t> leds;
+    unsigned int f, i, k, share = numLEDs / owners, completed = 0;
+    double start, fps;
+
+    pthread_barrier_init(&barrier, NULL, owners);
+    for(k=0; k<owners; k++) {
+        o[k].strip = &strip;
+        o[k].view = strip.createView(k * share, k + 1 < owners ? share : numLEDs - k * share);
+        o[k].barrier = &barrier;
+        o[k].owner = k;
+        o[k].numFrames = numFrames;
+        o[k].completed = 0;
+    }
+    start = nowNS();
+    for(k=0; k<owners; k++) {
+        pthread_create(&threads[k], NULL, viewOwner, &o[k]);
+    }
+    for(k=0; k<owners; k++) {
+        pthread_join(threads[k], NULL);
+        completed += o[k].completed;
+    }
+    fps = numFrames * 1e9 / (nowNS() - start);
+    pthread_barrier_destroy(&barrier);
+
+    if(completed != numFrames || strip.getSoftDMA()->numFrames() != numFrames ||
+       strip.getSoftDMA()->errors() != 0) {
+        printf("Threaded views on %d LEDs: %d commits sent of %d frames, %d transfers\n",
+               numLEDs, completed, numFrames, strip.getSoftDMA()->numFrames());
+        return false;
+    }
+    for(f=0; f<numFrames; f++) {
+        WS2812Decoder::decode(strip.getSoftDMA()->frame(f), leds);
+        for(i=0; i<numLEDs; i++) {
+            k = std::min(i / share, owners - 1);
+            if(leds[i] != Color_t(f, k, 1)) {
+                printf("Threaded views on %d LEDs: pixel %d of frame %d is stale\n", numLEDs, i, f);
+                return false;
+            }
+        }
+    }
+
+    printf("%8d %8d %14.1f\n", numLEDs, owners, fps);
+    record("view_threads", "commit_fps", numLEDs, fps, "fps");
+    return true;
+}
+
+// What a process restart costs before the strip shows anything: building
+// the strip, getting its first frame onto the wire, and tearing it down.
+// The loopback transport has no hardware to reattach to, so asking to has to
+// be ignored and the first frame still come out whole.
+static bool benchStartup(unsigned int numLEDs, unsigned int runs){
+    std::vector<Color_t> leds;
+    double start, created = 0, shown = 0, destroyed = 0;
+    unsigned int r;
+
+    for(r=0; r<runs; r++) {
+        start = nowNS();
+        NeoPixel *strip = new NeoPixel(numLEDs, NEOPIXEL_LOOPBACK | NEOPIXEL_REATTACH);
+        created += nowNS() - start;
+
+        start = nowNS();
+        strip->fill(0, numLEDs, Color_t(r, 1, 2));
+        strip->show();
+        drain(*strip);
+        shown += nowNS() - start;
+
+        if(strip->reattached() || strip->getSoftDMA()->numFrames() != 1) {
+            printf("Startup on %d LEDs: %s, %d frames\n", numLEDs,
+                   strip->reattached() ? "reattached to loopback" : "not reattached",
+                   strip->getSoftDMA()->numFrames());
+            delete strip;
+            return false;
+        }
+        WS2812Decoder::decode(strip->getSoftDMA()->frame(0), leds);
+        if(leds.size() != numLEDs || leds[0] != Color_t(r, 1, 2) || leds[numLEDs - 1] != Color_t(r, 1, 2)) {
+            printf("Startup on %d LEDs: the first frame came out wrong\n", numLEDs);
+            delete strip;
+            return false;
+        }
+
+        start = nowNS();
+        delete strip;
+        destroyed += nowNS() - start;
+    }
+
+    created /= runs * 1000.0;
+    shown /= runs * 1000.0;
+    destroyed /= runs * 1000.0;
+    printf("%8d %14.1f %14.1f %14.1f\n", numLEDs, created, shown, destroyed);
+    record("startup", "construct", numLEDs, created, "us");
+    record("startup", "first_frame", numLEDs, shown, "us");
+    record("startup", "destroy", numLEDs, destroyed, "us");
+    return true;
+}
+
+// The same frames through a strip encoding on one thread and one encoding on
+// several must put the same words on the wire: whole frames, scattered
+// pixels and a run straddling the workers' pieces, in one channel, two
+// channels and RGBW
+static bool verifyParallel(unsigned int numLEDs, unsigned int threads){
+    const unsigned int flagSets[] = { 0, NEOPIXEL_DUAL_CHANNEL, NEOPIXEL_GRBW };
+    std::vector<Color_t> leds;
+    unsigned int s, f, i, k;
+
+    for(s=0; s<sizeof(flagSets)/sizeof(flagSets[0]); s++) {
+        NeoPixel serial(numLEDs, NEOPIXEL_LOOPBACK | flagSets[s]);
+        NeoPixel parallel(numLEDs, NEOPIXEL_LOOPBACK | flagSets[s]);
+        NeoPixel *strips[2] = { &serial, &parallel };
+        unsigned int total = serial.numPixels();
+
+        if(!parallel.setEncodeThreads(threads) || parallel.getEncodeThreads() != threads) {
+            printf("Parallel encode: couldn't start %d threads\n", threads);
+            return false;
+        }
+        for(f=0; f<6; f++) {
+            leds.resize(total);
+            randomFrame(leds);
+            for(k=0; k<2; k++) {
+                if(f < 2) {
+                    for(i=0; i<total; i++) {
+                        strips[k]->setPixelColor(i, leds[i]);
+                        if(flagSets[s] == NEOPIXEL_GRBW) {
+                            strips[k]->setPixelWhite(i, leds[i].g ^ leds[i].b);
+                        }
+                    }
+                } else if(f < 4) {
+                    for(i=0; i<50; i++) {
+                        strips[k]->setPixelColor(leds[i].r * 256 % total + i * 37 % total, leds[i]);
+                    }
+                } else {
+                    strips[k]->fill(total / 3 - 5, total / 3 + 10, leds[f]);
+                }
+                strips[k]->show();
+                drain(*strips[k]);
+            }
+            if(serial.getEncodedPercent() != parallel.getEncodedPercent()) {
+                printf("Parallel encode on %d LEDs, flags %x: encoded %.1f%% of frame %d, not %.1f%%\n",
+                       numLEDs, flagSets[s], parallel.getEncodedPercent(), f, serial.getEncodedPercent());
+                return false;
+            }
+        }
+        for(f=0; f<serial.getSoftDMA()->numFrames(); f++) {
+            if(parallel.getSoftDMA()->numFrames() != serial.getSoftDMA()->numFrames() ||
+               parallel.getSoftDMA()->frame(f) != serial.getSoftDMA()->frame(f)) {
+                printf("Parallel encode on %d LEDs, flags %x: frame %d differs from the serial one\n",
+                       numLEDs, flagSets[s], f);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Encoding straight into the DMA buffer against encoding into PWMWaveform
+// and copying over, through whole frames, scattered pixels, a brightness
+// change and submit()s replacing a queued frame, with and without workers.
+// Both have to put the same words on the wire.
+static bool verifyDirect(unsigned int numLEDs){
+    const unsigned int flagSets[] = { 0, NEOPIXEL_GRBW };
+    std::vector<Color_t> leds(numLEDs);
+    unsigned int s, f, i, k;
+
+    NeoPixel dual(numLEDs, NEOPIXEL_LOOPBACK | NEOPIXEL_DUAL_CHANNEL);
+    if(dual.setDirectEncode(true)) {
+        printf("Direct encode: a dual channel strip claimed to encode straight into the buffer\n");
+        return false;
+    }
+    for(s=0; s<sizeof(flagSets)/sizeof(flagSets[0]); s++) {
+        NeoPixel copied(numLEDs, NEOPIXEL_LOOPBACK | flagSets[s]);
+        NeoPixel direct(numLEDs, NEOPIXEL_LOOPBACK | flagSets[s]);
+        NeoPixel *strips[2] = { &copied, &direct };
+
+        if(copied.setDirectEncode(false) || !direct.setDirectEncode(true)) {
+            printf("Direct encode: couldn't pick the encode path\n");
+            return false;
+        }
+        for(f=0; f<8; f++) {
+            randomFrame(leds);
+            for(k=0; k<2; k++) {
+                strips[k]->setEncodeThreads(f < 4 ? 1 : 3);
+                if(f % 4 == 0) {
+                    for(i=0; i<numLEDs; i++) {
+                        strips[k]->setPixelColor(i, leds[i]);
+                        if(flagSets[s] == NEOPIXEL_GRBW) {
+                            strips[k]->setPixelWhite(i, leds[i].r ^ leds[i].g);
+                        }
+                    }
+                } else if(f % 4 == 1) {
+                    for(i=0; i<10; i++) {
+                        strips[k]->setPixelColor(leds[i].r * 256 % numLEDs + i * 13 % numLEDs, leds[i]);
+                    }
+                } else if(f % 4 == 2) {
+                    strips[k]->setBrightness(0.25 + f * 0.1);
+                } else {
+                    // Three frames queued up while the first is on the wire
+                    for(i=0; i<3; i++) {
+                        strips[k]->fill(i * 7, numLEDs / 2, leds[i]);
+                        strips[k]->submit();
+                    }
+                }
+                strips[k]->show();
+                drain(*strips[k]);
+            }
+        }
+        if(copied.getSoftDMA()->numFrames() != direct.getSoftDMA()->numFrames()) {
+            printf("Direct encode on %d LEDs, flags %x: %d frames, not %d\n", numLEDs, flagSets[s],
+                   direct.getSoftDMA()->numFrames(), copied.getSoftDMA()->numFrames());
+            return false;
+        }
+        for(f=0; f<copied.getSoftDMA()->numFrames(); f++) {
+            if(direct.getSoftDMA()->frame(f) != copied.getSoftDMA()->frame(f)) {
+                printf("Direct encode on %d LEDs, flags %x: frame %d differs from the copied one\n",
+                       numLEDs, flagSets[s], f);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// submit() of a whole changed frame, encoding into PWMWaveform and copying
+// the words over against encoding straight into the DMA buffer
+static bool benchDirect(unsigned int numLEDs, unsigned int numFrames){
+    std::vector<Color_t> leds(numLEDs);
+    double us[2], start;
+    unsigned int d, f, i;
+
+    randomFrame(leds);
+    for(d=0; d<2; d++) {
+        NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+
+        strip.setDirectEncode(d == 1);
+        us[d] = 0;
+        for(f=0; f<numFrames; f++) {
+            for(i=0; i<numLEDs; i++) {
+                strip.setPixelColor(i, leds[(i + f) % numLEDs]);
+            }
+            start = nowNS();
+            strip.submit();
+            us[d] += nowNS() - start;
+        }
+        us[d] /= numFrames * 1000.0;
+        drain(strip);
+    }
+
+    printf("%8d %14.2f %14.2f %7.2fx\n", numLEDs, us[0], us[1], us[0] / us[1]);
+    record("direct", "copied", numLEDs, us[0], "us");
+    record("direct", "direct", numLEDs, us[1], "us");
+    return true;
+}
+
+// Per frame CPU cost of submit() for a whole changed frame, on 1 to 4
+// encode threads. Only the encode is spread; copying into the DMA buffer
+// stays on the calling thread.
+static bool benchParallel(unsigned int numLEDs, unsigned int numFrames){
+    const unsigned int threadCounts[] = { 1, 2, 3, 4 };
+    std::vector<Color_t> leds(numLEDs);
+    double us[4], start;
+    unsigned int t, f, i;
+
+    randomFrame(leds);
+    for(t=0; t<4; t++) {
+        NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+
+        if(!strip.setEncodeThreads(threadCounts[t])) {
+            return false;
+        }
+        us[t] = 0;
+        for(f=0; f<numFrames; f++) {
+            for(i=0; i<numLEDs; i++) {
+                strip.setPixelColor(i, leds[(i + f) % numLEDs]);
+            }
+            start = nowNS();
+            strip.submit();
+            us[t] += nowNS() - start;
+        }
+        us[t] /= numFrames * 1000.0;
+        drain(strip);
+    }
+
+    printf("%8d", numLEDs);
+    for(t=0; t<4; t++) {
+        printf(" %14.1f", us[t]);
+    }
+    printf(" %7.1fx\n", us[0] / us[3]);
+    record("parallel", "1_thread", numLEDs, us[0], "us");
+    record("parallel", "2_threads", numLEDs, us[1], "us");
+    record("parallel", "3_threads", numLEDs, us[2], "us");
+    record("parallel", "4_threads", numLEDs, us[3], "us");
+    return true;
+}
+
+static bool benchStats(unsigned int numLEDs, unsigned int numFrames){
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    SoftDMA *dma = strip.getSoftDMA();
+    const char *path = "/tmp/ws2812-rpi-bench.prom";
+    NeoPixelStats stats;
+    struct pollfd pfd;
+    unsigned long encodes = 0, waits = 0;
+    unsigned int f, b;
+    char line[128], expected[128];
+    bool found = false;
+    int sums = 0;
+    FILE *in;
+
+    for(f=0; f<numFrames; f++) {
+        strip.setPixelColor(f % numLEDs, Color_t(f, 255 - f, 1));
+        strip.show();
+        strip.show();
+    }
+
+    pfd.fd = strip.getCompletionFD();
+    pfd.events = POLLIN;
+    while(strip.busy());
+    for(f=0; f<3; f++) {
+        strip.setPixelColor(0, Color_t(f, f, f));
+        strip.submit();
+    }
+    while(strip.busy()) {
+        poll(&pfd, 1, -1);
+        strip.handleCompletion();
+    }
+
+    stats = strip.getStats();
+    for(b=0; b<STATS_BUCKETS; b++) {
+        encodes += stats.encodeHist[b];
+        waits += stats.waitHist[b];
+    }
+    if(stats.framesShown != dma->numFrames() || stats.framesShown != numFrames + 2 ||
+       stats.framesSkipped != numFrames || stats.framesReplaced != 1) {
+        printf("Counted %lu shown, %lu skipped and %lu replaced; soft DMA saw %d of %d frames\n",
+               stats.framesShown, stats.framesSkipped, stats.framesReplaced, dma->numFrames(), numFrames + 2);
+        return false;
+    }
+    if(encodes != numFrames + 3 || waits != numFrames) {
+        printf("Histograms hold %lu encodes and %lu waits, expected %d and %d\n",
+               encodes, waits, numFrames + 3, numFrames);
+        return false;
+    }
+    if(stats.encodeSumUS < stats.encodeMaxUS || stats.waitSumUS < stats.waitMaxUS) {
+        printf("Time totals %lu and %lu us are below the longest encode and wait\n",
+               stats.encodeSumUS, stats.waitSumUS);
+        return false;
+    }
+    if(stats.dmaErrors != dma->errors() || stats.fifoErrors != 0) {
+        printf("Counted %lu DMA and %lu FIFO errors; soft DMA reported %d\n",
+               stats.dmaErrors, stats.fifoErrors, dma->errors());
+        return false;
+    }
+
+    if(!strip.writeStats(path) || !(in = fopen(path, "r"))) {
+        printf("Unable to write and read back %s\n", path);
+        return false;
+    }
+    // Prometheus won't take a histogram without its _sum
+    snprintf(expected, sizeof(expected), "ws2812_frames_shown_total %lu\n", stats.framesShown);
+    while(fgets(line, sizeof(line), in)) {
+        found = found || strcmp(line, expected) == 0;
+        sums += strncmp(line, "ws2812_encode_us_sum ", 21) == 0 || strncmp(line, "ws2812_wait_us_sum ", 19) == 0;
+    }
+    fclose(in);
+    unlink(path);
+    if(!found || sums != 2) {
+        printf("Statistics file has no line %s", found ? "ws2812_<name>_us_sum\n" : expected);
+        return false;
+    }
+
+    printf("%8d %14lu %14lu %14lu\n", numLEDs, stats.encodeMaxUS, stats.waitMaxUS, stats.underruns);
+    record("stats", "encode_max", numLEDs, stats.encodeMaxUS, "us");
+    record("stats", "wait_max", numLEDs, stats.waitMaxUS, "us");
+    record("stats", "underruns", numLEDs, stats.underruns, "count");
+    return true;
+}
+
+// Writes an OPC message from a non-blocking client, running the server
+// whenever the socket is full so the two can share a thread. Payloads longer
+// than the header can describe are cut short.
+static void opcSend(int fd, OPCServer& server, unsigned int channel, unsigned int command,
+                    const uint8_t *data, unsigned int len){
+    std::vector<uint8_t> msg;
+    unsigned int sent = 0;
+    ssize_t n;
+
+    len = std::min(len, (unsigned int)OPC_MAX_PAYLOAD);
+    msg.resize(OPC_HEADER_BYTES + len);
+    msg[0] = channel;
+    msg[1] = command;
+    msg[2] = len >> 8;
+    msg[3] = len & 0xff;
+    memcpy(msg.data() + OPC_HEADER_BYTES, data, len);
+    while(sent < msg.size()) {
+        n = write(fd, msg.data() + sent, msg.size() - sent);
+        if(n > 0) {
+            sent += n;
+        } else {
+            server.poll(1);
+        }
+    }
+}
+
+static bool opcFrameMatches(SoftDMA *dma, unsigned int f, const std::vector<uint8_t>& data){
+    std::vector<Color_t> leds;
+
+    WS2812Decoder::decode(dma->frame(f), leds);
+    return leds.size() * 3 == data.size() && memcmp(leds.data(), data.data(), data.size()) == 0;
+}
+
+// The OPC server on the loopback transport. Frames sent one at a time over
+// the UNIX socket must each reach the wire intact; a burst over TCP, with an
+// oversized frame, a sysex and a message for another channel mixed in, must
+// be coalesced down to what the wire can take and end on the last frame.
+// The burst goes in reverse so its last frame isn't the one already shown.
+static bool benchOPC(unsigned int numLEDs, unsigned int numFrames){
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    SoftDMA *dma = strip.getSoftDMA();
+    OPCServer server(strip);
+    const char *path = "/tmp/ws2812-rpi-bench.sock";
+    std::vector<std::vector<uint8_t> > frames(numFrames, std::vector<uint8_t>(numLEDs * 3));
+    std::vector<uint8_t> big((numLEDs + 10) * 3, 0x55);
+    struct sockaddr_un unixAddr;
+    struct sockaddr_in tcpAddr;
+    unsigned int f, i, first;
+    unsigned long messages;
+    double start, latency = 0, burst;
+    int unixFD, tcpFD;
+
+    for(f=0; f<numFrames; f++) {
+        for(i=0; i<numLEDs * 3; i++) {
+            frames[f][i] = rand();
+        }
+    }
+
+    memset(&unixAddr, 0, sizeof(unixAddr));
+    unixAddr.sun_family = AF_UNIX;
+    strcpy(unixAddr.sun_path, path);
+    memset(&tcpAddr, 0, sizeof(tcpAddr));
+    tcpAddr.sin_family = AF_INET;
+    tcpAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(!server.listenUnix(path) || !server.listenTCP(0)) {
+        return false;
+    }
+    tcpAddr.sin_port = htons(server.getTCPPort());
+    unixFD = socket(AF_UNIX, SOCK_STREAM, 0);
+    tcpFD = socket(AF_INET, SOCK_STREAM, 0);
+    if(connect(unixFD, (struct sockaddr *)&unixAddr, sizeof(unixAddr)) < 0 ||
+       connect(tcpFD, (struct sockaddr *)&tcpAddr, sizeof(tcpAddr)) < 0) {
+        printf("Unable to connect to the OPC server: %s\n", strerror(errno));
+        return false;
+    }
+    fcntl(unixFD, F_SETFL, O_NONBLOCK);
+    fcntl(tcpFD, F_SETFL, O_NONBLOCK);
+
+    // One at a time: each frame goes out as soon as it has arrived
+    while(server.numClients() < 2) {
+        server.poll(10);
+    }
+    first = dma->numFrames();
+    for(f=0; f<numFrames; f++) {
+        while(strip.busy()) {
+            server.poll(10);
+        }
+        start = nowNS();
+        opcSend(unixFD, server, 0, OPC_SET_PIXELS, frames[f].data(), frames[f].size());
+        while(dma->numFrames() < first + f + 1) {
+            server.poll(10);
+        }
+        latency += nowNS() - start;
+    }
+    while(strip.busy()) {
+        server.poll(10);
+    }
+    for(f=0; f<numFrames; f++) {
+        if(!opcFrameMatches(dma, first + f, frames[f])) {
+            printf("OPC frame %d of %d LEDs doesn't match what was sent\n", f, numLEDs);
+            return false;
+        }
+    }
+
+    // All at once: only the frames the wire has time for go out
+    first = dma->numFrames();
+    messages = server.getMessages();
+    start = nowNS();
+    opcSend(tcpFD, server, 0, OPC_SET_PIXELS, big.data(), big.size());
+    opcSend(tcpFD, server, 0, OPC_SYSEX, big.data(), 7);
+    opcSend(tcpFD, server, 9, OPC_SET_PIXELS, big.data(), big.size());
+    for(f=numFrames; f-- > 0; ) {
+        opcSend(tcpFD, server, 0, OPC_SET_PIXELS, frames[f].data(), frames[f].size());
+    }
+    burst = nowNS() - start;
+    while(server.getMessages() < messages + numFrames + 1 || strip.busy()) {
+        server.poll(10);
+    }
+    server.poll(OPC_STALL_MS + 1);
+    while(strip.busy()) {
+        server.poll(10);
+    }
+    if(server.getMessages() != messages + numFrames + 1 ||
+       !opcFrameMatches(dma, dma->numFrames() - 1, frames[0])) {
+        printf("OPC burst of %d frames: %lu messages, last frame on the wire %s\n", numFrames,
+               server.getMessages() - messages,
+               opcFrameMatches(dma, dma->numFrames() - 1, frames[0]) ? "right" : "wrong");
+        return false;
+    }
+
+    close(unixFD);
+    close(tcpFD);
+    while(server.numClients() > 0) {
+        server.poll(10);
+    }
+    if(dma->errors() != 0) {
+        printf("Soft DMA reported %d errors\n", dma->errors());
+        return false;
+    }
+
+    printf("%8d %14.1f %14d %14d %14.1f\n", numLEDs, latency / numFrames / 1e3, numFrames + 1,
+           dma->numFrames() - first, burst / 1e3);
+    record("opc", "latency", numLEDs, latency / numFrames / 1e3, "us");
+    record("opc", "burst_frames_sent", numLEDs, dma->numFrames() - first, "count");
+    return true;
+}
+
+// Frame k from producer p is every pixel (k, k >> 8, p), so a frame mixed
+// from two writes shows up as pixels that differ. Frames are 20us apart, so
+// the strip takes plenty of them while the producers are still going.
+static void ringProducer(const char *name, unsigned int numLEDs, unsigned int numFrames, unsigned char id){
+    FrameRing *ring = FrameRing::attach(name);
+    std::vector<Color_t> frame(numLEDs);
+    unsigned int k;
+    double next = nowNS();
+
+    if(!ring) {
+        _exit(1);
+    }
+    for(k=1; k<=numFrames; k++) {
+        std::fill(frame.begin(), frame.end(), Color_t(k, k >> 8, id));
+        while(!ring->publish(frame.data(), numLEDs));
+        for(next += 20000; nowNS() < next; );
+    }
+    delete ring;
+    _exit(0);
+}
+
+// The shared memory frame ring: the cost of publishing a frame, then two
+// producer processes publishing flat out while the strip takes the newest
+// frame whenever the wire is free. The strip must only ever hold whole
+// frames, and the last one must be the last one published.
+static bool benchRing(unsigned int numLEDs, unsigned int numFrames){
+    const char *name = "/ws2812-rpi-bench";
+    FrameRing *ring = FrameRing::create(name, numLEDs);
+    FrameRing *producer;
+    std::vector<Color_t> frame(numLEDs), leds;
+    unsigned int i, k, shown = 0, running = 2;
+    int status;
+    bool taken;
+    double start, ns;
+
+    if(!ring || !(producer = FrameRing::attach(name))) {
+        return false;
+    }
+    // Published frames are never compared, so they may as well be the same
+    start = nowNS();
+    for(k=0; k<numFrames; k++) {
+        producer->publish(frame.data(), numLEDs);
+    }
+    ns = (nowNS() - start) / numFrames;
+    delete producer;
+
+    for(i=0; i<2; i++) {
+        if(fork() == 0) {
+            ringProducer(name, numLEDs, numFrames, 0x5a + i);
+        }
+    }
+
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    while(running > 0) {
+        if(waitpid(-1, &status, WNOHANG) > 0) {
+            if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                printf("Frame ring producer failed\n");
+                return false;
+            }
+            running--;
+        }
+        if(strip.busy()) {
+            continue;
+        }
+        // A frame overtaken while being copied mustn't reach the strip either
+        taken = ring->consume(strip);
+        leds = strip.getPixels();
+        for(i=1; i<numLEDs; i++) {
+            if(leds[i] != leds[0]) {
+                printf("Frame from the ring is torn at pixel %d of %d\n", i, numLEDs);
+                return false;
+            }
+        }
+        if(!taken) {
+            continue;
+        }
+        strip.submit();
+        shown++;
+    }
+
+    // Once both have finished, the newest frame has to be one of their last
+    while(strip.busy());
+    ring->consume(strip);
+    leds = strip.getPixels();
+    k = leds[0].r | (leds[0].g << 8);
+    if(k != (numFrames & 0xffff) || (leds[0].b != 0x5a && leds[0].b != 0x5b)) {
+        printf("Last frame from the ring is %d from producer %02x, expected %d\n", k, leds[0].b, numFrames);
+        return false;
+    }
+
+    printf("%8d %14.0f %14d %14d %14lu\n", numLEDs, ns, numFrames * 2, shown, ring->getSkipped());
+    record("ring", "publish", numLEDs, ns, "ns");
+    record("ring", "frames_shown", numLEDs, shown, "count");
+    delete ring;
+    return true;
+}
+
+// Plays path back into a fresh strip and checks every frame against the one
+// recorded, then seeks to a few frames at random. Returns the decode time
+// per frame in ns, or a negative number on failure.
+static double checkPlayback(const char *path, const std::vector<std::vector<Color_t> >& expected){
+    AnimationPlayer *player = AnimationPlayer::open(path);
+    unsigned int numLEDs = expected[0].size(), f, k;
+    double start, ns;
+
+    if(!player) {
+        return -1;
+    }
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    start = nowNS();
+    for(f=0; f<expected.size(); f++) {
+        if(!player->next(strip)) {
+            printf("Recording ended at frame %d of %d\n", f, (int)expected.size());
+            return -1;
+        }
+    }
+    ns = (nowNS() - start) / expected.size();
+
+    // Again, checking each frame as it goes, then seeking about
+    player->seek(strip, 0);
+    for(f=0; f<expected.size(); f++) {
+        if(f > 0) {
+            player->next(strip);
+        }
+        if(strip.getPixels() != expected[f]) {
+            printf("Frame %d of %d LEDs doesn't play back as recorded\n", f, numLEDs);
+            return -1;
+        }
+    }
+    if(player->next(strip)) {
+        printf("Recording has more than the %d frames recorded\n", (int)expected.size());
+        return -1;
+    }
+    for(k=0; k<5; k++) {
+        f = rand() % expected.size();
+        if(!player->seek(strip, f) || player->frame() != f || strip.getPixels() != expected[f]) {
+            printf("Seeking to frame %d of %d LEDs doesn't give the frame recorded\n", f, numLEDs);
+            return -1;
+        }
+    }
+    delete player;
+    return ns;
+}
+
+// Recording and playback: a rainbow recorded live from show(), where every
+// pixel changes every frame, and clock hands rendered offline, where three
+// do. Both must play back exactly, and a short clip must play in real time.
+static bool benchRecording(unsigned int numLEDs){
+    const char *path = "/tmp/ws2812-rpi-bench.wsa";
+    std::vector<std::vector<Color_t> > expected;
+    std::vector<Color_t> leds(numLEDs);
+    AnimationRecorder *recorder;
+    AnimationPlayer *player;
+    struct stat st;
+    double rainbowNS, clockNS, raw, rainbowRatio, clockRatio, start, elapsed;
+    unsigned int f, k;
+
+    {
+        NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+        NeoPixelSegment all(&strip, 0, numLEDs);
+        RainbowEffect rainbow(5);
+
+        strip.startRecording(path, 25);
+        for(f=0; f<100; f++) {
+            rainbow.render(f * 5, all);
+            strip.show();
+            expected.push_back(strip.getPixels());
+        }
+        strip.stopRecording();
+    }
+    if(stat(path, &st) < 0 || (rainbowNS = checkPlayback(path, expected)) < 0) {
+        return false;
+    }
+    raw = (double)expected.size() * numLEDs * 3;
+    rainbowRatio = raw / st.st_size;
+
+    recorder = AnimationRecorder::create(path, numLEDs);
+    expected.clear();
+    for(f=0; f<1000; f++) {
+        std::fill(leds.begin(), leds.end(), Color_t());
+        for(k=1; k<=3; k++) {
+            leds[(f / k) % numLEDs] = Color_t(255 * (k == 1), 255 * (k == 2), 255 * (k == 3));
+        }
+        recorder->addFrame(leds.data(), f * 20);
+        expected.push_back(leds);
+    }
+    delete recorder;
+    if(stat(path, &st) < 0 || (clockNS = checkPlayback(path, expected)) < 0) {
+        return false;
+    }
+    raw = (double)expected.size() * numLEDs * 3;
+    clockRatio = raw / st.st_size;
+
+    // Ten frames 50ms apart, which is longer than a frame of 1000 LEDs takes
+    // to send, play in 450ms whatever the strip length
+    recorder = AnimationRecorder::create(path, numLEDs);
+    for(f=0; f<10; f++) {
+        recorder->addFrame(expected[f].data(), 1000 + f * 50);
+    }
+    delete recorder;
+    {
+        NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+        player = AnimationPlayer::open(path);
+        start = nowNS();
+        player->play(strip);
+        elapsed = (nowNS() - start) / 1e6;
+        delete player;
+        if(elapsed < 450 || elapsed > 450 + 20 || strip.getPixels() != expected[9]) {
+            printf("Ten frame clip of %d LEDs played in %.1fms, expected 450ms\n", numLEDs, elapsed);
+            return false;
+        }
+    }
+    unlink(path);
+
+    printf("%8d %13.1fx %13.1fx %14.2f %14.2f %14.1f\n", numLEDs, rainbowRatio, clockRatio,
+           rainbowNS / 1e3, clockNS / 1e3, elapsed);
+    record("recording", "rainbow_ratio", numLEDs, rainbowRatio, "x");
+    record("recording", "clock_ratio", numLEDs, clockRatio, "x");
+    record("recording", "rainbow_decode", numLEDs, rainbowNS / 1e3, "us");
+    record("recording", "clock_decode", numLEDs, clockNS / 1e3, "us");
+    return true;
+}
+
+// Partial updates, three pixels a frame like the hands of a clock. Every frame
+// on the wire must match a full encode of the pixels, and a show() with
+// nothing changed mustn't send anything.
+static bool benchDirty(unsigned int numLEDs, unsigned int numFrames){
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    SoftDMA *dma = strip.getSoftDMA();
+    unsigned int words = WS2812Encoder::wordsForLEDs(numLEDs) + 1;
+    std::vector<std::vector<uint32_t> > expected(numFrames, std::vector<uint32_t>(words, 0));
+    std::vector<Color_t> leds;
+    double percent = 0;
+    unsigned int f, k;
+
+    for(f=0; f<numFrames; f++) {
+        for(k=0; k<3; k++) {
+            strip.setPixelColor(rand() % numLEDs, Color_t(rand(), rand(), rand()));
+        }
+        leds = strip.getPixels();
+        WS2812Encoder::encode(leds.data(), numLEDs, expected[f].data(), words);
+        strip.show();
+        if(f > 0) {
+            percent += strip.getEncodedPercent();
+        }
+        strip.show();
+        if(strip.getEncodedPercent() != 0) {
+            printf("show() re-encoded pixels with nothing changed\n");
+            return false;
+        }
+    }
+    while(dma->active());
+
+    if(dma->numFrames() != numFrames) {
+        printf("Soft DMA saw %d frames, expected %d\n", dma->numFrames(), numFrames);
+        return false;
+    }
+    for(f=0; f<numFrames; f++) {
+        if(dma->frame(f) != expected[f]) {
+            printf("Partial update frame %d of %d LEDs doesn't match a full encode\n", f, numLEDs);
+            return false;
+        }
+    }
+    printf("%8d %14.1f%%\n", numLEDs, percent / (numFrames - 1));
+    record("dirty", "reencoded", numLEDs, percent / (numFrames - 1), "%");
+    return true;
+}
+
+// Two strips of numLEDs on the two PWM channels against one chain of twice
+// the length. The words on the wire alternate between the channels and each
+// channel's share must be that strip's frame on its own.
+static bool benchDual(unsigned int numLEDs, unsigned int numFrames){
+    NeoPixel dual(numLEDs, NEOPIXEL_LOOPBACK | NEOPIXEL_DUAL_CHANNEL);
+    NeoPixel chain(numLEDs * 2, NEOPIXEL_LOOPBACK);
+    SoftDMA *dma = dual.getSoftDMA();
+    unsigned int words = WS2812Encoder::wordsForLEDs(numLEDs) + 1;
+    std::vector<std::vector<Color_t> > frames(numFrames, std::vector<Color_t>(numLEDs * 2));
+    std::vector<unsigned int> expected(words);
+    double start, dualNS, chainNS;
+    unsigned int f, c, i;
+
+    for(f=0; f<numFrames; f++) {
+        randomFrame(frames[f]);
+    }
+
+    start = nowNS();
+    for(f=0; f<numFrames; f++) {
+        for(c=0; c<2; c++) {
+            NeoPixelSegment strip = dual.channel(c);
+            for(i=0; i<numLEDs; i++) {
+                strip.setPixelColor(i, frames[f][c * numLEDs + i]);
+            }
+        }
+        dual.show();
+    }
+    while(dma->active());
+    dualNS = (nowNS() - start) / numFrames;
+
+    start = nowNS();
+    for(f=0; f<numFrames; f++) {
+        for(i=0; i<numLEDs * 2; i++) {
+            chain.setPixelColor(i, frames[f][i]);
+        }
+        chain.show();
+    }
+    while(chain.getSoftDMA()->active());
+    chainNS = (nowNS() - start) / numFrames;
+
+    if(dma->numFrames() != numFrames || dma->errors() != 0) {
+        printf("Soft DMA saw %d frames and %d errors, expected %d frames\n",
+               dma->numFrames(), dma->errors(), numFrames);
+        return false;
+    }
+    for(f=0; f<numFrames; f++) {
+        const std::vector<uint32_t>& wire = dma->frame(f);
+
+        if(wire.size() != words * 2) {
+            printf("Dual channel frame %d is %d words, expected %d\n", f, (int)wire.size(), words * 2);
+            return false;
+        }
+        for(c=0; c<2; c++) {
+            std::fill(expected.begin(), expected.end(), 0);
+            WS2812Encoder::encode(&frames[f][c * numLEDs], numLEDs, expected.data(), words);
+            for(i=0; i<words; i++) {
+                if(wire[i * 2 + c] != expected[i]) {
+                    printf("Channel %d of dual channel frame %d was corrupted on the wire\n", c + 1, f);
+                    return false;
+                }
+            }
+        }
+    }
+
+    printf("%8d %14.2f %14.2f %13.1fx\n", numLEDs, chainNS / 1e6, dualNS / 1e6, chainNS / dualNS);
+    record("dual", "chain", numLEDs, chainNS / 1e6, "ms");
+    record("dual", "dual", numLEDs, dualNS / 1e6, "ms");
+    return true;
+}
+
+// A fade: brightness changes every frame and the pixels are never set
+// again. What goes out must track the brightness while the pixel buffer
+// keeps the colours it was given.
+static bool benchFade(unsigned int numLEDs, unsigned int numFrames){
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    SoftDMA *dma = strip.getSoftDMA();
+    unsigned int words = WS2812Encoder::wordsForLEDs(numLEDs) + 1;
+    std::vector<Color_t> leds(numLEDs), adjusted;
+    std::vector<uint32_t> expected(words);
+    double start, elapsed = 0;
+    unsigned int f, i;
+
+    randomFrame(leds);
+    for(i=0; i<numLEDs; i++) {
+        strip.setPixelUnchecked(i, leds[i]);
+    }
+    strip.setGamma(2.2f);
+    strip.setWhiteBalance(255, 220, 200);
+
+    for(f=0; f<numFrames; f++) {
+        // Only the table rebuild is timed, show() mostly waits for the wire
+        start = nowNS();
+        strip.setBrightness(1.0f - (float)f / numFrames);
+        elapsed += nowNS() - start;
+        strip.show();
+    }
+    while(dma->active());
+
+    if(strip.getPixels() != leds) {
+        printf("Pixels changed after %d shows with brightness below 1\n", numFrames);
+        return false;
+    }
+    if(dma->numFrames() != numFrames) {
+        printf("Soft DMA saw %d frames, expected %d\n", dma->numFrames(), numFrames);
+        return false;
+    }
+    for(f=0; f<numFrames; f++) {
+        adjusted = leds;
+        referenceAdjust(adjusted, 1.0f - (float)f / numFrames, 2.2f, Color_t(255, 220, 200));
+        std::fill(expected.begin(), expected.end(), 0);
+        WS2812Encoder::encode(adjusted.data(), numLEDs, expected.data(), words);
+        if(dma->frame(f) != expected) {
+            printf("Fade frame %d of %d LEDs doesn't match the adjusted colours\n", f, numLEDs);
+            return false;
+        }
+    }
+    printf("%8d %17.2f\n", numLEDs, elapsed / numFrames / 1000);
+    record("fade", "setBrightness", numLEDs, elapsed / numFrames / 1000, "us");
+    return true;
+}
+
+// One frame set a pixel at a time through the checked setPixelColor(), the
+// unchecked accessor and a single setPixels(). All three must leave the same
+// pixels behind; the bulk operations are checked against plain vector code.
+static bool benchPixels(unsigned int numLEDs, unsigned int numFrames){
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    std::vector<Color_t> leds(numLEDs), expected;
+    double start, checked, unchecked, bulk;
+    unsigned int f, i;
+
+    randomFrame(leds);
+
+    start = nowNS();
+    for(f=0; f<numFrames; f++) {
+        for(i=0; i<numLEDs; i++) {
+            strip.setPixelColor(i, leds[(i + f) % numLEDs]);
+        }
+    }
+    checked = (nowNS() - start) / numFrames / numLEDs;
+
+    start = nowNS();
+    for(f=0; f<numFrames; f++) {
+        for(i=0; i<numLEDs; i++) {
+            strip.setPixelUnchecked(i, leds[(i + f) % numLEDs]);
+        }
+    }
+    unchecked = (nowNS() - start) / numFrames / numLEDs;
+    expected = strip.getPixels();
+
+    start = nowNS();
+    for(f=0; f<numFrames; f++) {
+        strip.setPixels(0, leds.data(), numLEDs);
+    }
+    bulk = (nowNS() - start) / numFrames / numLEDs;
+
+    if(strip.getPixels() != leds) {
+        printf("setPixels() of %d LEDs left the wrong pixels\n", numLEDs);
+        return false;
+    }
+    for(i=0; i<numLEDs; i++) {
+        if(expected[i] != leds[(i + numFrames - 1) % numLEDs]) {
+            printf("setPixelUnchecked() left pixel %d of %d wrong\n", i, numLEDs);
+            return false;
+        }
+    }
+
+    // fill() and copyWithin() against the same on a plain vector, with
+    // overlapping runs both ways
+    expected = leds;
+    std::fill(expected.begin() + 5, expected.begin() + numLEDs / 2, Color_t(1, 2, 3));
+    std::copy(expected.begin(), expected.begin() + numLEDs / 2, expected.begin() + numLEDs / 4);
+    std::copy(expected.begin() + 7, expected.end(), expected.begin() + 3);
+    if(!strip.fill(5, numLEDs / 2 - 5, Color_t(1, 2, 3)) ||
+       !strip.copyWithin(numLEDs / 4, 0, numLEDs / 2) ||
+       !strip.copyWithin(3, 7, numLEDs - 7) || strip.getPixels() != expected) {
+        printf("fill()/copyWithin() of %d LEDs don't match\n", numLEDs);
+        return false;
+    }
+
+    // Out of range calls are refused and counted, leaving the pixels alone
+    if(strip.setPixelColor(numLEDs, Color_t(9, 9, 9)) || strip.fill(numLEDs - 1, 2, Color_t(9, 9, 9)) ||
+       strip.copyWithin(0, 1, numLEDs) || strip.channel(0).fill(0, numLEDs + 1, Color_t(9, 9, 9)) ||
+       strip.getRangeErrors() != 4 || strip.getPixels() != expected) {
+        printf("Out of range calls on %d LEDs weren't refused and counted\n", numLEDs);
+        return false;
+    }
+
+    printf("%8d %14.2f %14.2f %14.2f %7.1fx\n", numLEDs, checked, unchecked, bulk, checked / bulk);
+    record("pixels", "setPixelColor", numLEDs, checked, "ns/LED");
+    record("pixels", "setPixelUnchecked", numLEDs, unchecked, "ns/LED");
+    record("pixels", "setPixels", numLEDs, bulk, "ns/LED");
+    return true;
+}
+
+// Frames through show() on one and both PWM channels, read back off the
+// recorded wire by the decoder rather than compared word for word, along
+// with the pulse timing it measured. Then the decoder has to catch a bad
+// pulse and an early latch.
+static bool benchWaveform(unsigned int numLEDs, unsigned int flags){
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK | flags);
+    SoftDMA *dma = strip.getSoftDMA();
+    unsigned int channels = strip.getNumChannels();
+    std::vector<Color_t> leds(numLEDs * channels), decoded;
+    std::vector<uint32_t> wire;
+    WaveformTiming timing;
+    unsigned int c, i;
+
+    randomFrame(leds);
+    strip.setPixels(0, leds.data(), leds.size());
+    strip.show();
+    while(dma->active());
+
+    wire = dma->frame(0);
+    for(c=0; c<channels; c++) {
+        WS2812Decoder::decode(wire, decoded, &timing, c, channels);
+        if(timing.errors != 0 || decoded != std::vector<Color_t>(leds.begin() + c * numLEDs,
+                                                                 leds.begin() + (c + 1) * numLEDs)) {
+            printf("Channel %d of %d decoded as %d LEDs with %d timing errors\n",
+                   c + 1, numLEDs, (int)decoded.size(), timing.errors);
+            return false;
+        }
+        printf("%8d %8d %6d-%-6d %6d-%-6d %6d-%-6d\n", numLEDs, c + 1, timing.minT0H, timing.maxT0H,
+               timing.minT1H, timing.maxT1H, timing.minPeriod, timing.maxPeriod);
+        record("waveform", c ? "max_bit_ch2" : "max_bit", numLEDs, timing.maxPeriod, "ns");
+    }
+
+    // Bits stuck high stretch a pulse out of both windows
+    wire = dma->frame(0);
+    wire[channels * 2] |= 0xE0000000;
+    WS2812Decoder::decode(wire, decoded, &timing, 0, channels);
+    if(timing.errors == 0) {
+        printf("Decoder missed a stretched pulse on %d LEDs\n", numLEDs);
+        return false;
+    }
+
+    // A dropout long enough to latch splits the frame
+    wire = dma->frame(0);
+    for(i = 1; i <= WS2812_RESET_NSEC / PWM_BIT_NSEC / 32 + 1 && i + 1 < wire.size() / channels; i++) {
+        wire[i * channels] = 0;
+    }
+    if(i > WS2812_RESET_NSEC / PWM_BIT_NSEC / 32 + 1) {
+        WS2812Decoder::decode(wire, decoded, &timing, 0, channels);
+        if(timing.errors == 0 || decoded.size() >= numLEDs) {
+            printf("Decoder missed an early latch on %d LEDs\n", numLEDs);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Each pixel format on the loopback transport, through a brightness, gamma
+// and white balance table. The frame is decoded off the wire byte by byte and
+// compared with the bytes the format should send; a second frame changes
+// only some white levels, which have to be picked up by the dirty tracking.
+// Then the encode cost of each format with the SIMD kernel where it applies.
+static bool benchFormats(unsigned int numLEDs){
+    const float brightness = 0.6f, gamma = 2.2f;
+    const Color_t balance(255, 200, 180);
+    std::vector<Color_t> leds(numLEDs), adjusted;
+    std::vector<uint8_t> white(numLEDs), adjustedWhite(numLEDs), expected, decoded;
+    std::vector<unsigned int> words(WS2812Encoder::wordsForLEDs(numLEDs, 4), 0);
+    unsigned int iterations = 1000000 / numLEDs;
+    double cost[NUM_FORMATS], start;
+    WaveformTiming timing;
+    unsigned int f, i;
+
+    randomFrame(leds);
+    for(i=0; i<numLEDs; i++) {
+        white[i] = rand();
+    }
+
+    for(f=0; f<NUM_FORMATS; f++) {
+        NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK | formats[f].flag);
+        SoftDMA *dma = strip.getSoftDMA();
+        bool hasWhite = strip.getColorChannels() == 4;
+
+        strip.setPixels(0, leds.data(), numLEDs);
+        strip.setBrightness(brightness);
+        strip.setGamma(gamma);
+        strip.setWhiteBalance(balance.r, balance.g, balance.b);
+        for(i=0; i<numLEDs; i++) {
+            if(strip.setPixelWhite(i, white[i]) != hasWhite) {
+                printf("%s: setPixelWhite() %s\n", formats[f].name, hasWhite ? "failed" : "worked without white");
+                return false;
+            }
+        }
+        strip.show();
+        if(hasWhite) {
+            for(i=0; i<numLEDs; i+=7) {
+                white[i] ^= 0x5a;
+                strip.setPixelWhite(i, white[i]);
+            }
+            strip.show();
+        }
+        while(dma->active());
+
+        adjusted = leds;
+        referenceAdjust(adjusted, brightness, gamma, balance);
+        for(i=0; i<numLEDs; i++) {
+            adjustedWhite[i] = referenceLevel(white[i], brightness, gamma, 255);
+        }
+        formatBytes(formats[f].name, adjusted, adjustedWhite, expected);
+        WS2812Decoder::decodeBytes(dma->frame(dma->numFrames() - 1), decoded, &timing);
+        if(decoded != expected || timing.errors != 0) {
+            printf("%s: %d LEDs decoded as %d bytes, expected %d, with %d timing errors\n", formats[f].name,
+                   numLEDs, (int)decoded.size(), (int)expected.size(), timing.errors);
+            return false;
+        }
+
+        start = nowNS();
+        for(i=0; i<iterations; i++) {
+            formats[f].encode(leds.data(), white.data(), numLEDs, words.data(), words.size(), 0);
+        }
+        cost[f] = (nowNS() - start) / iterations / numLEDs;
+        record("format", formats[f].name, numLEDs, cost[f], "ns/LED");
+    }
+
+    // The format as part of the type
+    {
+        NeoPixelStrip<FormatRGBW> strip(numLEDs, NEOPIXEL_LOOPBACK | NEOPIXEL_RGB);
+        if(strip.getColorChannels() != 4) {
+            printf("NeoPixelStrip<FormatRGBW> has %d colour channels\n", strip.getColorChannels());
+            return false;
+        }
+    }
+
+    printf("%8d", numLEDs);
+    for(f=0; f<NUM_FORMATS; f++) {
+        printf(" %14.2f", cost[f]);
+    }
+    printf("\n");
+    return true;
+}
+
+struct RainbowArgs {
+    NeoPixel *strip;
+    unsigned long lastFrame;
+};
+
+static bool renderRainbow(unsigned long frame, void *arg){
+    RainbowArgs *a = (RainbowArgs*)arg;
+    unsigned int n = a->strip->numPixels();
+
+    for(unsigned int i=0; i<n; i++) {
+        a->strip->setPixelUnchecked(i, NeoPixel::wheel(((i * 256 / n) + frame) & 255));
+    }
+    a->strip->show();
+    return frame < a->lastFrame;
+}
+
+// A moving rainbow at a fixed frame rate through the scheduler. It should get
+// to its last frame in the same time whatever the strip length, dropping
+// frames where the wire can't keep up.
+static bool benchScheduler(unsigned int numLEDs, float fps, unsigned long numFrames){
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    FrameScheduler scheduler(fps);
+    RainbowArgs args = { &strip, numFrames - 1 };
+    double start = nowNS();
+
+    scheduler.run(renderRainbow, &args);
+    printf("%8d %8.0f %10.1f %8.2f %8lu %8lu %10.0f %10.0f\n", numLEDs, fps,
+           scheduler.getAchievedFPS(), (nowNS() - start) / 1e9,
+           scheduler.getLateFrames(), scheduler.getDroppedFrames(),
+           scheduler.getJitterPercentile(50), scheduler.getJitterPercentile(99));
+    record("scheduler", "achieved", numLEDs, scheduler.getAchievedFPS(), "fps");
+    record("scheduler", "dropped", numLEDs, scheduler.getDroppedFrames(), "count");
+    record("scheduler", "jitter_p99", numLEDs, scheduler.getJitterPercentile(99), "us");
+    if(strip.getSoftDMA()->errors() != 0) {
+        printf("Soft DMA reported %d errors\n", strip.getSoftDMA()->errors());
+        return false;
+    }
+    return true;
+}
+
+// Two effects side by side on the halves of a strip through the engine, one
+// stopped halfway. Reports the cost of a step, which renders one frame of each.
+static bool benchEffects(unsigned int numLEDs, unsigned int numFrames){
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    unsigned int half = numLEDs / 2;
+    NeoPixelSegment left(&strip, 0, half), right(&strip, half, numLEDs - half);
+    RainbowEffect rainbow(5, 1, true);
+    TheaterChaseEffect chase(Color_t(255, 0, 0), 20, 100);
+    EffectEngine engine;
+    unsigned int chaseID;
+    std::vector<Color_t> stopped;
+    double start, elapsed = 0;
+    unsigned long t;
+    unsigned int f, i;
+
+    engine.add(&rainbow, left, 0);
+    chaseID = engine.add(&chase, right, 0);
+
+    for(f=0; f<numFrames; f++) {
+        t = f * 10;
+        if(f == numFrames / 2) {
+            engine.stop(chaseID);
+            stopped = strip.getPixels();
+        }
+
+        start = nowNS();
+        engine.step(t);
+        elapsed += nowNS() - start;
+
+        for(i=0; i<half; i++) {
+            if(!(left.getPixelColor(i) == NeoPixel::wheel((i * 256 / half + t / 5) & 255))) {
+                printf("Rainbow pixel %d wrong at %lums\n", i, t);
+                return false;
+            }
+        }
+        for(i=0; i<numLEDs - half; i++) {
+            Color_t want = (i % 3 == t / 20 % 3) ? Color_t(255, 0, 0) : Color_t(0, 0, 0);
+            if(f >= numFrames / 2) {
+                want = stopped[half + i];
+            }
+            if(!(right.getPixelColor(i) == want)) {
+                printf("Chase pixel %d wrong at %lums\n", i, t);
+                return false;
+            }
+        }
+        strip.show();
+    }
+
+    if(engine.running(chaseID) || engine.numRunning() != 1) {
+        printf("Stopped effect is still running\n");
+        return false;
+    }
+    if(engine.step(rainbow.duration()) != 0) {
+        printf("Finished effect is still running\n");
+        return false;
+    }
+    printf("%8d %14.1f %14.2f\n", numLEDs, elapsed / numFrames / 1000, elapsed / numFrames / numLEDs);
+    record("engine", "step", numLEDs, elapsed / numFrames / 1000, "us");
+    return true;
+}
+
+// Latency of a single show() with the wire idle: how long the call takes to
+// return, and how long until the frame has gone out and latched
+static bool benchLatency(unsigned int numLEDs, unsigned int numFrames){
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    SoftDMA *dma = strip.getSoftDMA();
+    std::vector<Color_t> leds(numLEDs);
+    double start, call = 0, latched = 0, wire;
+    unsigned int f;
+
+    for(f=0; f<numFrames; f++) {
+        randomFrame(leds);
+        strip.setPixels(0, leds.data(), numLEDs);
+        while(strip.busy());
+
+        start = nowNS();
+        strip.show();
+        call += nowNS() - start;
+        while(dma->active());
+        latched += nowNS() - start;
+    }
+    if(dma->errors() != 0) {
+        printf("Soft DMA reported %d errors\n", dma->errors());
+        return false;
+    }
+
+    call /= numFrames * 1000.0;
+    latched /= numFrames * 1000.0;
+    wire = WS2812Encoder::wordsForLEDs(numLEDs) * 32.0 * PWM_BIT_NSEC / 1000;
+    printf("%8d %14.1f %14.1f %14.1f\n", numLEDs, call, latched, wire);
+    record("latency", "show_call", numLEDs, call, "us");
+    record("latency", "show_to_wire_done", numLEDs, latched, "us");
+    return true;
+}
+
+// What one frame of each built in effect costs the CPU: rendering it and
+// show() encoding and starting it, with the wire idle so nothing waits. The
+// strip is cleared first so every frame is re-encoded in full.
+// gradient() and bars() render and show one frame per call; the others are
+// timed through their Effect classes, as the blocking methods only pace them.
+static bool benchEffectFrames(unsigned int numLEDs, unsigned int numFrames){
+    NeoPixel strip(numLEDs, NEOPIXEL_LOOPBACK);
+    SoftDMA *dma = strip.getSoftDMA();
+    NeoPixelSegment all(&strip, 0, numLEDs);
+    ColorWipeEffect colorWipe(Color_t(255, 0, 0), 1, numLEDs);
+    RainbowEffect rainbow(1, 1000);
+    RainbowEffect rainbowCycle(1, 1000, true);
+    TheaterChaseEffect theaterChase(Color_t(127, 127, 127), 1, 1000);
+    TheaterChaseEffect theaterChaseRainbow(Color_t(), 1, 1000, true);
+    Effect *effects[] = { &colorWipe, &rainbow, &rainbowCycle, &theaterChase, &theaterChaseRainbow, 0, 0 };
+    const char *names[] = { "colorWipe", "rainbow", "rainbowCycle", "theaterChase", "theaterChaseRainbow",
+                            "gradient", "bars" };
+    std::vector<Color_t> scheme;
+    double start, elapsed;
+    unsigned int e, f;
+
+    scheme.push_back(Color_t(255, 0, 0));
+    scheme.push_back(Color_t(0, 255, 0));
+    scheme.push_back(Color_t(0, 0, 255));
+
+    for(e=0; e<sizeof(names)/sizeof(names[0]); e++) {
+        elapsed = 0;
+        for(f=0; f<numFrames; f++) {
+            while(strip.busy());
+            strip.clear();
+            start = nowNS();
+            if(effects[e]) {
+                effects[e]->render(f % numLEDs, all);
+                strip.show();
+            } else if(e == 5) {
+                strip.gradient(scheme, 2, 10);
+            } else {
+                strip.bars(scheme, 2, 10);
+            }
+            elapsed += nowNS() - start;
+        }
+        elapsed /= numFrames * 1000.0;
+        printf("%8d %20s %14.1f %14.2f\n", numLEDs, names[e], elapsed, elapsed * 1000 / numLEDs);
+        record("effect_frame", names[e], numLEDs, elapsed, "us");
+    }
+    if(dma->errors() != 0) {
+        printf("Soft DMA reported %d errors\n", dma->errors());
+        return false;
+    }
+    return true;
+}
+
+static double timeEncode(const std::vector<Color_t>& leds, std::vector<unsigned int>& words, unsigned int iterations,
+                         const SymbolLUT *lut=0){
+    double start = nowNS();
+    for(unsigned int i=0; i<iterations; i++) {
+        WS2812Encoder::encode(leds.data(), leds.size(), words.data(), words.size(), lut);
+    }
+    return (nowNS() - start) / iterations / leds.size();
+}
+
+int main(int argc, char **argv){
+    const unsigned int sizes[] = { 60, 300, 1000 };
+    bool simd = WS2812Encoder::hasSIMD();
+    unsigned int s, i, n;
+    int arg;
+
+    for(arg=1; arg<argc; arg++) {
+        if(strcmp(argv[arg], "--csv") == 0 && arg + 1 < argc) {
+            if((results = fopen(argv[++arg], "w")) == 0) {
+                printf("Unable to open %s: %s\n", argv[arg], strerror(errno));
+                return 1;
+            }
+            fprintf(results, "suite,name,leds,value,unit\n");
+        } else {
+            printf("Usage: %s [--csv FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Equivalence of every kernel with the reference over random frames,
+    // covering every tail length
+    for(n=0; n<=200; n++) {
+        if(!verify(n) || !verifyFormats(n)) return 1;
+    }
+
+    printf("SIMD kernel: %s\n", simd ? simdKernelName() : "none");
+    printf("%8s %14s %14s %14s %14s %8s\n", "LEDs", "ref ns/LED", "scalar ns/LED", "simd ns/LED", "lut ns/LED", "speedup");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        unsigned int numLEDs = sizes[s];
+        unsigned int iterations = 2000000 / numLEDs;
+        std::vector<Color_t> leds(numLEDs);
+        std::vector<unsigned int> words(WS2812Encoder::wordsForLEDs(numLEDs), 0);
+        double start, ref, scalar, vector = 0, table;
+        SymbolLUT lut;
+
+        if(!verify(numLEDs)) return 1;
+        randomFrame(leds);
+
+        start = nowNS();
+        for(i=0; i<iterations; i++) {
+            referenceEncode(leds.data(), numLEDs, words.data());
+        }
+        ref = (nowNS() - start) / iterations / numLEDs;
+
+        WS2812Encoder::buildLUT(lut, 0.5f, 2.2f, Color_t(255, 255, 255));
+        table = timeEncode(leds, words, iterations, &lut);
+
+        WS2812Encoder::useSIMD(false);
+        scalar = timeEncode(leds, words, iterations);
+        if(WS2812Encoder::useSIMD(true)) {
+            vector = timeEncode(leds, words, iterations);
+            printf("%8d %14.2f %14.2f %14.2f %14.2f %7.1fx\n", numLEDs, ref, scalar, vector, table, ref / vector);
+            record("encode", "simd", numLEDs, vector, "ns/LED");
+        } else {
+            printf("%8d %14.2f %14.2f %14s %14.2f %7.1fx\n", numLEDs, ref, scalar, "-", table, ref / scalar);
+        }
+        record("encode", "reference", numLEDs, ref, "ns/LED");
+        record("encode", "scalar", numLEDs, scalar, "ns/LED");
+        record("encode", "lut", numLEDs, table, "ns/LED");
+    }
+
+    printf("\n%8s", "LEDs");
+    for(i=0; i<NUM_FORMATS; i++) {
+        printf(" %7s ns/LED", formats[i].name);
+    }
+    printf("\n");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        if(!benchFormats(sizes[s])) return 1;
+    }
+
+    printf("\n%8s %14s %14s %14s\n", "LEDs", "show() fps", "wire fps", "of wire rate");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        if(!benchShow(sizes[s], 100)) return 1;
+    }
+    if(!benchShow(5000, 20)) return 1;
+
+    printf("\n%8s %14s %14s %14s\n", "LEDs", "show() us", "latched us", "wire us");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        if(!benchLatency(sizes[s], 20)) return 1;
+    }
+
+    printf("\n%8s %8s %13s %13s %13s\n", "LEDs", "channel", "T0H ns", "T1H ns", "bit ns");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        if(!benchWaveform(sizes[s], 0)) return 1;
+    }
+    if(!benchWaveform(300, NEOPIXEL_DUAL_CHANNEL)) return 1;
+
+    printf("\n%8s %14s %14s %14s\n", "LEDs/chan", "chain ms", "dual ms", "speedup");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        if(!benchDual(sizes[s], 20)) return 1;
+    }
+
+    printf("\n%8s %14s %14s\n", "LEDs", "step() us", "step ns/LED");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        if(!benchEffects(sizes[s], 40)) return 1;
+    }
+
+    printf("\n%8s %20s %14s %14s\n", "LEDs", "effect", "frame us", "frame ns/LED");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        if(!benchEffectFrames(sizes[s], 40)) return 1;
+    }
+
+    printf("\n%8s %14s %14s %14s %8s\n", "LEDs", "checked ns/LED", "unchecked ns", "setPixels ns", "speedup");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        if(!benchPixels(sizes[s], 200)) return 1;
+    }
+
+    printf("\n%8s %17s\n", "LEDs", "setBrightness() us");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        if(!benchFade(sizes[s], 20)) return 1;
+    }
+
+    printf("\n%8s %8s %10s %8s %8s %8s %10s %10s\n", "LEDs", "fps", "achieved", "seconds",
+           "late", "dropped", "p50 us", "p99 us");
+    if(!benchScheduler(60, 50, 50)) return 1;
+    if(!benchScheduler(600, 50, 50)) return 1;
+    if(!benchScheduler(5000, 50, 50)) return 1;
+
+    printf("\n%8s %15s\n", "LEDs", "re-encoded/frame");
+    for(s=0; s<2; s++) {
+        if(!benchDirty(sizes[s], 50)) return 1;
+    }
+
+    printf("\n%8s %14s %14s\n", "LEDs", "submit() fps", "fd wakeups");
+    for(s=0; s<2; s++) {
+        if(!benchSubmit(sizes[s], 100)) return 1;
+    }
+
+    printf("\n%8s %14s %14s %14s %14s\n", "LEDs", "OPC latency us", "burst frames", "frames sent", "burst us");
+    for(s=0; s<2; s++) {
+        if(!benchOPC(sizes[s], 50)) return 1;
+    }
+
+    printf("\n%8s %14s %14s %14s %14s\n", "LEDs", "publish ns", "published", "shown", "skipped");
+    for(s=0; s<2; s++) {
+        if(!benchRing(sizes[s], 5000)) return 1;
+    }
+
+    printf("\n%8s %14s %14s %14s %14s %14s\n", "LEDs", "rainbow ratio", "clock ratio",
+           "rainbow us", "clock us", "450ms clip ms");
+    for(s=0; s<3; s++) {
+        if(!benchRecording(sizes[s])) return 1;
+    }
+
+    printf("\n%8s %8s %14s %14s %14s %14s\n", "LEDs", "owners", "show() fps", "commit() fps",
+           "show() xfers", "commit() xfers");
+    for(s=0; s<2; s++) {
+        if(!benchViews(sizes[s], 30)) return 1;
+    }
+
+    printf("\n%8s %8s %14s\n", "LEDs", "threads", "commit() fps");
+    if(!benchViewThreads(61, 50) || !benchViewThreads(301, 50)) return 1;
+
+    if(!verifyDirect(1) || !verifyDirect(61) || !verifyDirect(1500)) return 1;
+    printf("\n%8s %14s %14s %8s\n", "LEDs", "copied us", "direct us", "speedup");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        if(!benchDirect(sizes[s], 50)) return 1;
+    }
+    if(!benchDirect(5000, 50)) return 1;
+
+    if(!verifyParallel(1500, 3) || !verifyParallel(2000, 4)) return 1;
+    printf("\nParallel encode, %d cores online\n", WorkerPool::numCores());
+    printf("%8s %14s %14s %14s %14s %8s\n", "LEDs", "1 thread us", "2 threads us", "3 threads us",
+           "4 threads us", "speedup");
+    if(!benchParallel(2000, 20)) return 1;
+    if(!benchParallel(10000, 20)) return 1;
+
+    printf("\n%8s %14s %14s %14s\n", "LEDs", "construct us", "first frame us", "destroy us");
+    for(s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+        if(!benchStartup(sizes[s], 20)) return 1;
+    }
+
+    printf("\n%8s %14s %14s %14s\n", "LEDs", "max encode us", "max wait us", "underruns");
+    for(s=0; s<2; s++) {
+        if(!benchStats(sizes[s], 50)) return 1;
+    }
+
+    if(results) {
+        fclose(results);
+    }
+    return 0;
+}
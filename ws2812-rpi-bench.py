@@ -0,0 +1,373 @@
+#!/usr/bin/python3
+
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+
+# Measures the cost of a call through the wrapper, then compares the ways of
+# getting a frame into the LED buffer from Python: one setPixelColor() call
+# per pixel, one setPixels() call with the whole frame, and writes straight
+# into the buffer through getBuffer(). Then checks other Python threads, and
+# other asyncio tasks, keep running while frames are on the wire. Runs on the
+# loopback transport so it needs no hardware or super user privileges.
+#
+# With --csv FILE the results are also written to FILE in the same
+# suite,name,leds,value,unit form as ws2812-rpi-bench.
+
+import sys
+import threading
+from time import time
+
+from NeoPixel import NeoPixel, Color, FrameRing, AnimationRecorder, AnimationPlayer, LOOPBACK, REATTACH, GRBW
+
+FRAMES=200
+CALLS=100000
+
+results=None
+
+def record(suite, name, numLEDs, value, unit):
+    if results: results.write("%s,%s,%d,%.3f,%s\n" % (suite, name, numLEDs, value, unit))
+
+def frame(numLEDs, k):
+    return bytes(bytearray((i*7+k*3+c)&0xFF for i in range(numLEDs) for c in range(3)))
+
+def timeFrames(fill, frames):
+    start=time()
+    for k in range(FRAMES): fill(frames[k%len(frames)])
+    return (time()-start)*1e6/FRAMES
+
+def check(strip, data, what):
+    for i in range(strip.numPixels()):
+        c=strip.getPixelColor(i)
+        if (c.r, c.g, c.b)!=tuple(bytearray(data[i*3:i*3+3])):
+            print("%s: pixel %d mismatch" % (what, i))
+            return False
+    return True
+
+def bench(numLEDs):
+    strip=NeoPixel(numLEDs, LOOPBACK)
+    strip.begin()
+    frames=[frame(numLEDs, k) for k in range(4)]
+    ok=True
+
+    def perPixel(data):
+        for i in range(numLEDs):
+            strip.setPixelColor(i, data[i*3], data[i*3+1], data[i*3+2])
+
+    def bulk(data):
+        strip.setPixels(data)
+
+    view=strip.getBuffer()
+    flat=view.cast('B')
+    def buffer(data):
+        flat[:]=data
+
+    results=[]
+    for name, fill in (("setPixelColor", perPixel), ("setPixels", bulk), ("buffer", buffer)):
+        us=timeFrames(fill, frames)
+        fill(frames[1])
+        ok=check(strip, frames[1], name) and ok
+        results.append((name, us))
+
+    # What was written through the buffer has to reach the wire
+    flat[:]=frames[2]
+    strip.show()
+    if strip.getEncodedPercent()<=0.:
+        print("buffer: show() didn't pick up the change")
+        ok=False
+    strip.show()
+    if strip.getEncodedPercent()!=0.:
+        print("buffer: show() re-encoded an unchanged frame")
+        ok=False
+    flat.release()
+    view.release()
+
+    base=results[0][1]
+    for name, us in results:
+        print("%5d LEDs  %-14s %10.1f us/frame  %6.1fx" % (numLEDs, name, us, base/us))
+        record("python_frame", name, numLEDs, us, "us")
+    del strip
+    return ok
+
+# Cost of a single call through the wrapper, less the cost of the loop
+# around it. show() with nothing changed returns without encoding, so it
+# is the overhead of the call and of releasing the GIL.
+def benchCalls(numLEDs):
+    strip=NeoPixel(numLEDs, LOOPBACK)
+    red=Color(255, 0, 0)
+    pixel=bytes(bytearray((1, 2, 3)))
+    ring=FrameRing.create("/ws2812-rpi-bench-py", numLEDs)
+    producer=FrameRing.attach("/ws2812-rpi-bench-py")
+    pixels=frame(numLEDs, 1)
+    calls=(("numPixels", "numPixels()", lambda: strip.numPixels()),
+           ("getPixelColor", "getPixelColor()", lambda: strip.getPixelColor(1)),
+           ("setPixelColor", "setPixelColor(r, g, b)", lambda: strip.setPixelColor(1, 255, 0, 0)),
+           ("setPixelColor_color", "setPixelColor(Color)", lambda: strip.setPixelColor(1, red)),
+           ("setPixels", "setPixels(1 pixel)", lambda: strip.setPixels(pixel, 1)),
+           ("getStats", "getStats()", lambda: strip.getStats()),
+           ("ring_publish", "FrameRing.publish()", lambda: producer.publish(pixels)),
+           ("show", "show() unchanged", lambda: strip.show()))
+    nothing=lambda: None
+
+    strip.show()
+    start=time()
+    for i in range(CALLS): nothing()
+    loop=time()-start
+    for name, label, call in calls:
+        start=time()
+        for i in range(CALLS): call()
+        ns=(time()-start-loop)*1e9/CALLS
+        print("%5d LEDs  %-22s %8.0f ns/call" % (numLEDs, label, ns))
+        record("python_call", name, numLEDs, ns, "ns")
+
+    # One show() up front and the timed ones, all but the first unchanged
+    stats=strip.getStats()
+    if stats.framesShown!=2 or stats.framesSkipped!=CALLS-1 or sum(stats.waitHist)!=2:
+        print("getStats(): counted %d shown and %d skipped, expected 2 and %d" %
+              (stats.framesShown, stats.framesSkipped, CALLS-1))
+        return False
+
+    # The newest frame from the ring lands in the strip once, and only once
+    if not ring.consume(strip) or ring.consume(strip) or not check(strip, pixels, "FrameRing"):
+        print("FrameRing: the published frame didn't reach the strip")
+        return False
+    return True
+
+# A four channel strip keeps white apart from the colour, and a three
+# channel one has no white to set
+def benchFormats(numLEDs):
+    rgbw=NeoPixel(numLEDs, LOOPBACK|GRBW)
+    grb=NeoPixel(numLEDs, LOOPBACK)
+    if rgbw.getColorChannels()!=4 or grb.getColorChannels()!=3:
+        print("getColorChannels(): %d and %d, expected 4 and 3" % (rgbw.getColorChannels(), grb.getColorChannels()))
+        return False
+    rgbw.setPixelColor(1, 10, 20, 30)
+    if not rgbw.setPixelWhite(1, 40) or rgbw.getPixelWhite(1)!=40 or rgbw.getPixelColor(1).b!=30 or grb.setPixelWhite(1, 40):
+        print("setPixelWhite(): white wasn't kept apart from the colour")
+        return False
+    rgbw.show()
+    return True
+
+# Two views of one strip: the frame goes out once, when both have committed,
+# or when the one that hasn't is released
+def benchViews(numLEDs):
+    strip=NeoPixel(numLEDs, LOOPBACK)
+    left=strip.createView(0, numLEDs//2)
+    right=strip.createView(numLEDs//2, numLEDs-numLEDs//2)
+    left.fill(0, left.numPixels(), Color(255, 0, 0))
+    right.fill(0, right.numPixels(), Color(0, 0, 255))
+    if left.commit() or not left.committed() or not right.commit() or strip.numViews()!=2:
+        print("NeoPixelView.commit(): the frame didn't wait for both views")
+        return False
+    while strip.busy():
+        strip.handleCompletion()
+    shown=strip.getStats().framesShown
+    left.fill(0, left.numPixels(), Color(0, 255, 0))
+    gone=strip.createView(0, 1)
+    if left.commit() or right.commit():
+        print("NeoPixelView.commit(): the frame went out without the third view")
+        return False
+    strip.releaseView(gone)
+    if strip.numViews()!=2 or strip.getStats().framesShown!=shown+1:
+        print("NeoPixel.releaseView(): releasing the last view didn't send the frame")
+        return False
+    del strip
+    if right.getPixelColor(0).b!=255:
+        print("NeoPixelView: the view lost its strip")
+        return False
+    return True
+
+# Frames recorded from Python come back from the player in order, and by seek
+def benchRecording(numLEDs, numFrames):
+    path="/tmp/ws2812-rpi-bench-py.rec"
+    strip=NeoPixel(numLEDs, LOOPBACK)
+    frames=[frame(numLEDs, k) for k in range(numFrames)]
+    recorder=AnimationRecorder.create(path, numLEDs, 10)
+    for k in range(numFrames):
+        if not recorder.addFrame(frames[k], k*20):
+            print("AnimationRecorder: frame %d wasn't written" % k)
+            return False
+    recorder.close()
+
+    player=AnimationPlayer.open(path)
+    if not player or player.numFrames()!=numFrames:
+        print("AnimationPlayer: %s didn't open with %d frames" % (path, numFrames))
+        return False
+    elapsed=0
+    for k in range(numFrames):
+        start=time()
+        played=player.next(strip)
+        elapsed+=time()-start
+        if not played or not check(strip, frames[k], "AnimationPlayer.next()"):
+            return False
+    us=elapsed*1e6/numFrames
+    if player.next(strip):
+        print("AnimationPlayer.next(): played past the last frame")
+        return False
+    if not player.seek(strip, numFrames//2+3) or not check(strip, frames[numFrames//2+3], "AnimationPlayer.seek()"):
+        return False
+
+    print("%5d LEDs  %4d recorded frames  %8.1f us/frame by next()" % (numLEDs, numFrames, us))
+    record("python_recording", "next", numLEDs, us, "us")
+    return True
+
+# Encoding spread over worker threads, which Python only has to ask for
+def benchEncodeThreads(numLEDs, numFrames):
+    strip=NeoPixel(numLEDs, LOOPBACK)
+    if not strip.setEncodeThreads(4) or strip.getEncodeThreads()!=4:
+        print("NeoPixel.setEncodeThreads(): didn't start 4 threads")
+        return False
+    frames=[frame(numLEDs, k) for k in range(numFrames)]
+    start=time()
+    for k in range(numFrames):
+        strip.setPixels(frames[k])
+        strip.submit()
+    us=(time()-start)*1e6/numFrames
+    if not check(strip, frames[-1], "setEncodeThreads(4)") or strip.getEncodedPercent()!=100:
+        return False
+    strip.setEncodeThreads(1)
+    if strip.setDirectEncode(False) or not strip.setDirectEncode(True):
+        print("NeoPixel.setDirectEncode(): a single channel strip should encode straight into its buffer")
+        return False
+    print("%5d LEDs  %8.1f us/frame by submit() on 4 encode threads" % (numLEDs, us))
+    record("python_parallel", "submit", numLEDs, us, "us")
+    return strip.getEncodeThreads()==1
+
+# Building a strip is what a restart pays before it can show anything.
+# There is nothing to reattach to on the loopback, so REATTACH is ignored.
+def benchStartup(numLEDs, runs):
+    elapsed=0
+    for k in range(runs):
+        start=time()
+        strip=NeoPixel(numLEDs, LOOPBACK | REATTACH)
+        elapsed+=time()-start
+        if strip.reattached():
+            print("NeoPixel(REATTACH): reattached to the loopback")
+            return False
+        del strip
+    us=elapsed*1e6/runs
+    print("%5d LEDs  %8.1f us to construct" % (numLEDs, us))
+    record("python_startup", "construct", numLEDs, us, "us")
+    return True
+
+# Counts how far a second thread gets while the main thread runs work(),
+# as a rate
+def countWhile(work):
+    ticks=[0]
+    done=threading.Event()
+
+    def count():
+        while not done.is_set(): ticks[0]+=1
+
+    counter=threading.Thread(target=count)
+    counter.start()
+    start=time()
+    work()
+    elapsed=time()-start
+    done.set()
+    counter.join()
+    return elapsed, ticks[0]/elapsed
+
+# A second thread's progress while the main thread sends frames back to back
+# with show(), against its progress while the main thread just sleeps. With
+# the GIL held through show() it would only run in the gaps between calls.
+def benchThreads(numLEDs, numFrames):
+    from time import sleep
+    strip=NeoPixel(numLEDs, LOOPBACK)
+    frames=[frame(numLEDs, k) for k in range(2)]
+
+    def send():
+        for k in range(numFrames):
+            strip.setPixels(frames[k%2])
+            strip.show()
+
+    elapsed, rate=countWhile(send)
+    idle, idleRate=countWhile(lambda: sleep(elapsed))
+
+    print("%5d LEDs  %4d frames by show()      %8.1f ms  %9.0f%% of idle progress in another thread" %
+          (numLEDs, numFrames, elapsed*1e3, 100.*rate/idleRate))
+    record("python_threads", "idle_progress", numLEDs, 100.*rate/idleRate, "%")
+    if rate<idleRate/2:
+        print("show(): other threads were held up while frames were on the wire")
+        return False
+    return True
+
+# The same frames through showAsync() while another task ticks every
+# millisecond; the ticker only runs if showAsync() yields to the event loop
+def benchAsync(numLEDs, numFrames):
+    import asyncio
+    import NeoPixelAsync
+    strip=NeoPixel(numLEDs, LOOPBACK)
+    frames=[frame(numLEDs, k) for k in range(2)]
+    ticks=[0]
+
+    async def ticker():
+        while True:
+            ticks[0]+=1
+            await asyncio.sleep(.001)
+
+    async def run():
+        task=asyncio.ensure_future(ticker())
+        await asyncio.sleep(0)
+        start=time()
+        for k in range(numFrames):
+            strip.setPixels(frames[k%2])
+            await strip.showAsync()
+        while strip.busy(): await asyncio.sleep(.001)
+        elapsed=time()-start
+        task.cancel()
+        return elapsed
+
+    loop=asyncio.new_event_loop()
+    elapsed=loop.run_until_complete(run())
+    loop.close()
+
+    print("%5d LEDs  %4d frames by showAsync() %8.1f ms  %10d ticks in another task" %
+          (numLEDs, numFrames, elapsed*1e3, ticks[0]))
+    if ticks[0]<numFrames/2:
+        print("showAsync(): the event loop was blocked while frames were on the wire")
+        return False
+    return True
+
+if __name__=="__main__":
+    if len(sys.argv)==3 and sys.argv[1]=="--csv":
+        results=open(sys.argv[2], "w")
+        results.write("suite,name,leds,value,unit\n")
+    elif len(sys.argv)!=1:
+        print("Usage: %s [--csv FILE]" % sys.argv[0])
+        sys.exit(1)
+
+    ok=benchCalls(60)
+    ok=benchFormats(60) and ok
+    ok=benchViews(60) and ok
+    print("")
+    for n in (60, 1000):
+        ok=bench(n) and ok
+    print("")
+    ok=benchThreads(1000, 100) and ok
+    ok=benchRecording(300, 50) and ok
+    ok=benchStartup(1000, 20) and ok
+    ok=benchEncodeThreads(5000, 20) and ok
+    if sys.version_info>=(3, 5):
+        ok=benchAsync(1000, 100) and ok
+    if results: results.close()
+    sys.exit(0 if ok else 1)
@@ -0,0 +1,124 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <algorithm>
+
+#include "ws2812-rpi-decoder.h"
+
+// PUBLIC
+
+unsigned int WS2812Decoder::decode(const std::vector<uint32_t>& wire, std::vector<Color_t>& leds,
+                                   WaveformTiming *timing, unsigned int channel, unsigned int channels){
+    std::vector<uint8_t> grb;
+    WaveformTiming t;
+    unsigned int i;
+
+    decodeBytes(wire, grb, &t, channel, channels);
+    leds.clear();
+    for(i = 0; i + 3 <= grb.size(); i += 3) {
+        leds.push_back(Color_t(grb[i + 1], grb[i], grb[i + 2]));
+    }
+
+    // A partial LED made of whole bytes; a partial byte is already counted
+    if(t.bits % 8 == 0 && grb.size() % 3 != 0) {
+        t.errors++;
+    }
+    if(timing) {
+        *timing = t;
+    }
+    return leds.size();
+}
+
+unsigned int WS2812Decoder::decodeBytes(const std::vector<uint32_t>& wire, std::vector<uint8_t>& bytes,
+                                        WaveformTiming *timing, unsigned int channel, unsigned int channels){
+    WaveformTiming t = { 0, 0, ~0u, 0, ~0u, 0, ~0u, 0 };
+    unsigned int numBits = (wire.size() + channels - 1 - channel) / channels * 32;
+    unsigned int pos = 0, high, low, highNS, periodNS;
+    unsigned int byte = 0;
+
+#define LINE(p) ((wire[((p) >> 5) * channels + channel] >> (31 - ((p) & 31))) & 1)
+
+    bytes.clear();
+
+    // Idle low before the first pulse
+    while(pos < numBits && !LINE(pos)) {
+        pos++;
+    }
+    while(pos < numBits) {
+        for(high = 0; pos < numBits && LINE(pos); pos++) {
+            high++;
+        }
+        for(low = 0; pos < numBits && !LINE(pos); pos++) {
+            low++;
+        }
+        highNS = high * PWM_BIT_NSEC;
+        periodNS = (high + low) * PWM_BIT_NSEC;
+
+        byte = (byte << 1) | (highNS > WS2812_T1H_THRESHOLD_NSEC);
+        if(++t.bits % 8 == 0) {
+            bytes.push_back(byte);
+            byte = 0;
+        }
+
+        if(highNS > WS2812_T1H_THRESHOLD_NSEC) {
+            t.minT1H = std::min(t.minT1H, highNS);
+            t.maxT1H = std::max(t.maxT1H, highNS);
+            if(highNS < WS2812_T1H_MIN_NSEC || highNS > WS2812_T1H_MAX_NSEC) {
+                t.errors++;
+            }
+        } else {
+            t.minT0H = std::min(t.minT0H, highNS);
+            t.maxT0H = std::max(t.maxT0H, highNS);
+            if(highNS < WS2812_T0H_MIN_NSEC || highNS > WS2812_T0H_MAX_NSEC) {
+                t.errors++;
+            }
+        }
+
+        // The last pulse's low time runs on into the latch, so its period
+        // can't be measured
+        if(pos == numBits) {
+            break;
+        }
+        if(low * PWM_BIT_NSEC >= WS2812_RESET_NSEC) {
+            // The LEDs would latch here and take the rest as a new frame
+            t.errors++;
+            break;
+        }
+        t.minPeriod = std::min(t.minPeriod, periodNS);
+        t.maxPeriod = std::max(t.maxPeriod, periodNS);
+        if(periodNS < WS2812_BIT_MIN_NSEC || periodNS > WS2812_BIT_MAX_NSEC) {
+            t.errors++;
+        }
+    }
+
+#undef LINE
+
+    if(t.bits % 8 != 0) {
+        t.errors++;
+    }
+    if(timing) {
+        *timing = t;
+    }
+    return bytes.size();
+}
@@ -0,0 +1,62 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#ifndef WS2812_RPI_DECODER_H
+#define WS2812_RPI_DECODER_H
+
+#include <stdint.h>
+
+#include <vector>
+#include "ws2812-rpi-defines.h"
+
+// What the decoder measured on the line, in ns, and how many pulses fell
+// outside the datasheet windows (or ended the frame early, or left a
+// partial LED at the end)
+struct WaveformTiming {
+    unsigned int bits;
+    unsigned int errors;
+    unsigned int minT0H, maxT0H;
+    unsigned int minT1H, maxT1H;
+    unsigned int minPeriod, maxPeriod;
+};
+
+// Reads a PWM word stream back the way an LED would: pulse by pulse, from
+// the high time of each pulse and not from the 3 bit symbol framing, so it
+// checks the encoder and the timing at once. Meant for the loopback
+// transport's recorded frames, and for tests on machines without a Pi.
+class WS2812Decoder {
+public:
+    // Decodes one channel of wire, whose channels are interleaved word by
+    // word as they are in the FIFO, into leds (GRB on the wire, Color_t out).
+    // Returns the number of whole LEDs decoded; timing, if given, is filled
+    // in for the same pulses.
+    static unsigned int decode(const std::vector<uint32_t>& wire, std::vector<Color_t>& leds,
+                               WaveformTiming *timing=0, unsigned int channel=0, unsigned int channels=1);
+    // The same, as colour bytes in wire order for any pixel format. Returns
+    // the number of whole bytes; only a partial byte counts as an error.
+    static unsigned int decodeBytes(const std::vector<uint32_t>& wire, std::vector<uint8_t>& bytes,
+                                    WaveformTiming *timing=0, unsigned int channel=0, unsigned int channels=1);
+};
+
+#endif
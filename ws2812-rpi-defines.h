@@ -28,12 +28,25 @@
 // Base Addresses
 #define DMA_BASE        0x20007000
 #define DMA_LEN         0x24
+// Channels 0 to 14 follow on from DMA_BASE, 0x100 apart
+#define DMA_BLOCK_LEN   0xF00
+#define DMA_CHANNEL_SIZE 0x100
+#define DMA_CHANNELS    15
 #define PWM_BASE        0x2020C000
 #define PWM_LEN         0x28
 #define CLK_BASE        0x20101000
 #define CLK_LEN         0xA8
 #define GPIO_BASE       0x20200000
 #define GPIO_LEN        0xB4
+#define PCM_BASE        0x20203000
+#define PCM_LEN         0x24
+#define SPI_BASE        0x20204000
+#define SPI_LEN         0x18
+
+// FIFO bus addresses, as seen by the DMA controller
+#define PWM_FIFO_BUS    (0x7E20C000 + 0x18)
+#define PCM_FIFO_BUS    (0x7E203000 + 0x04)
+#define SPI_FIFO_BUS    (0x7E204000 + 0x04)
 
 // GPIO
 #define GPFSEL0         0x20200000          
@@ -48,7 +61,18 @@
 #define GPPUDCLK0       0x20200098          
 #define GPPUDCLK1       0x2020009C
 
+// Clock manager control bits, and how long a register change may take to
+// show before init gives up on it
+#define CM_PASSWD       0x5A000000
+#define CM_BUSY         7
+#define CM_KILL         5
+#define CM_ENAB_PLLD    0x15
+#define CM_DIV_WS2812   400     // PLLD divider the PWM and PCM bit clocks run at
+#define REG_TIMEOUT_USEC    10000
+
 // Memory Offsets 
+#define PCM_CLK_CNTL    38
+#define PCM_CLK_DIV     39
 #define PWM_CLK_CNTL    40
 #define PWM_CLK_DIV     41
 
@@ -99,6 +123,65 @@
 #define PWM_DMAC_PANIC  8
 #define PWM_DMAC_DREQ   0
 
+// PCM Register Addresses
+#define PCM_CS      (0x00 / 4)
+#define PCM_FIFO    (0x04 / 4)
+#define PCM_MODE    (0x08 / 4)
+#define PCM_RXC     (0x0C / 4)
+#define PCM_TXC     (0x10 / 4)
+#define PCM_DREQ    (0x14 / 4)
+#define PCM_INTEN   (0x18 / 4)
+#define PCM_INTSTC  (0x1C / 4)
+#define PCM_GRAY    (0x20 / 4)
+
+// PCM_CS register bit offsets
+#define PCM_CS_STBY     25
+#define PCM_CS_SYNC     24
+#define PCM_CS_TXE      21
+#define PCM_CS_TXERR    15
+#define PCM_CS_TXSYNC   13
+#define PCM_CS_DMAEN    9
+#define PCM_CS_TXTHR    5
+#define PCM_CS_RXCLR    4
+#define PCM_CS_TXCLR    3
+#define PCM_CS_TXON     2
+#define PCM_CS_RXON     1
+#define PCM_CS_EN       0
+
+// PCM_MODE, PCM_TXC and PCM_DREQ bit offsets
+#define PCM_MODE_FLEN       10
+#define PCM_MODE_FSLEN      0
+#define PCM_TXC_CH1WEX      31
+#define PCM_TXC_CH1EN       30
+#define PCM_TXC_CH1POS      20
+#define PCM_TXC_CH1WID      16
+#define PCM_DREQ_TX_PANIC   24
+#define PCM_DREQ_TX         8
+
+// SPI Register Addresses
+#define SPI_CS      (0x00 / 4)
+#define SPI_FIFO    (0x04 / 4)
+#define SPI_CLK     (0x08 / 4)
+#define SPI_DLEN    (0x0C / 4)
+#define SPI_LTOH    (0x10 / 4)
+#define SPI_DC      (0x14 / 4)
+
+// SPI_CS register bit offsets
+#define SPI_CS_ADCS     11
+#define SPI_CS_DMAEN    8
+#define SPI_CS_TA       7
+#define SPI_CS_CLEAR_RX 5
+#define SPI_CS_CLEAR_TX 4
+#define SPI_CS_CPOL     3
+#define SPI_CS_CPHA     2
+
+// SPI_DC bit offsets
+#define SPI_DC_TPANIC   8
+#define SPI_DC_TDREQ    0
+
+// SPI clock divider from the 250MHz core clock, for one PWM_BIT_NSEC per bit
+#define SPI_CDIV        (250 * PWM_BIT_NSEC / 1000)
+
 // DMA
 #define DMA_CS              (0x00 / 4)
 #define DMA_CONBLK_AD       (0x04 / 4)
@@ -130,6 +213,12 @@
                             (8 << DMA_CS_PRIORITY) | \
                             (1 << DMA_CS_WAIT_FOR)
 
+// One DMA channel per output, so strips on different peripherals can run
+// side by side. PWM keeps the channel it has always used.
+#define DMA_CHANNEL_PWM     0
+#define DMA_CHANNEL_SPI     4
+#define DMA_CHANNEL_PCM     5
+
 // DREQ lines
 #define DMA_DREQ_ALWAYS     0
 #define DMA_DREQ_PCM_TX     2
@@ -156,13 +245,14 @@
 #define DMA_TI_WAIT_RESP        3
 #define DMA_TI_TDMODE           1
 #define DMA_TI_INTEN            0
-// Default TI word
-#define DMA_TI_CONFIGWORD       (1 << DMA_TI_NO_WIDE_BURSTS) | \
-                                (1 << DMA_TI_SRC_INC) | \
-                                (1 << DMA_TI_DEST_DREQ) | \
-                                (1 << DMA_TI_WAIT_RESP) | \
-                                (1 << DMA_TI_INTEN) | \
-                                (DMA_DREQ_PWM << DMA_TI_PERMAP)
+// Default TI word, paced by the given peripheral's DREQ
+#define DMA_TI_DREQWORD(dreq)   ((1 << DMA_TI_NO_WIDE_BURSTS) | \
+                                 (1 << DMA_TI_SRC_INC) | \
+                                 (1 << DMA_TI_DEST_DREQ) | \
+                                 (1 << DMA_TI_WAIT_RESP) | \
+                                 (1 << DMA_TI_INTEN) | \
+                                 ((dreq) << DMA_TI_PERMAP))
+#define DMA_TI_CONFIGWORD       DMA_TI_DREQWORD(DMA_DREQ_PWM)
 
 // DMA Debug register bit offsets
 #define DMA_DEBUG_LITE                  28
@@ -190,15 +280,12 @@ typedef struct {
     uint32_t physaddr;
 } page_map_t;
 
-#define NUM_DATA_WORDS 1016
-struct control_data_s {
-    dma_cb_t cb[1];
-    uint32_t sample[NUM_DATA_WORDS];
-};
+// Two sample buffers, each with its own control block chain, used ping-pong
+// so the next frame can be encoded while the current one is on the wire
+#define NUM_BUFFERS 2
 
 #define PAGE_SIZE   4096
 #define PAGE_SHIFT  12
-#define NUM_PAGES   ((sizeof(struct control_data_s) + PAGE_SIZE - 1) >> PAGE_SHIFT)
 
 #define SETBIT(word, bit) word |= 1<<bit
 #define CLRBIT(word, bit) word &= ~(1<<bit)
@@ -209,7 +296,9 @@ struct control_data_s {
 // GPIO
 #define INP_GPIO(g) *(gpio_reg+((g)/10)) &= ~(7<<(((g)%10)*3))
 #define OUT_GPIO(g) *(gpio_reg+((g)/10)) |=  (1<<(((g)%10)*3))
-#define SET_GPIO_ALT(g,a) *(gpio_reg+(((g)/10))) |= (((a)<=3?(a)+4:(a)==4?3:2)<<(((g)%10)*3))
+#define GPIO_ALT_FSEL(a) ((a)<=3?(a)+4:(a)==4?3:2)
+#define SET_GPIO_ALT(g,a) *(gpio_reg+(((g)/10))) |= (GPIO_ALT_FSEL(a)<<(((g)%10)*3))
+#define GET_GPIO_FSEL(g) ((*(gpio_reg+((g)/10)) >> (((g)%10)*3)) & 7)
 #define GPIO_SET *(gpio_reg+7)
 #define GPIO_CLR *(gpio_reg+10)
 
@@ -228,12 +317,64 @@ struct Color_t {
     }
 
     bool operator!=(const Color_t& other) const {
-        return (r!=other.r && g!=other.g && b!=other.b);
+        return !(*this == other);
     }
 
 //} Color_t;
 };
 
 #define DEFAULT_BRIGHTNESS 1.0
+#define DEFAULT_GAMMA      1.0
+
+// Dirty tracking granularity. Four LEDs are exactly nine PWM words so each
+// group can be re-encoded on its own.
+#define DIRTY_GROUP_LEDS    4
+#define DIRTY_GROUP_WORDS   9
+
+// Parallel encoding hands each thread at least this many LEDs, so a frame
+// with fewer changes than that per thread stays on the calling thread
+#define PARALLEL_ENCODE_MIN_LEDS    256
+
+// Wire timing: one PWM bit is a third of a WS2812 bit, and the line has to be
+// held low for the latch time before the LEDs take a new frame. The PCM and
+// SPI transports are clocked for the same bit time.
+#define PWM_BIT_NSEC    400
+#define LATCH_USEC      300
+
+// Run time statistics: encode and wait times are kept in power of two
+// microsecond buckets, bucket b counting times under 2^b us and the last
+// taking everything longer
+#define STATS_BUCKETS   16
+
+// WS2812B datasheet windows, checked by the waveform decoder: high time of a
+// 0 bit (0.4us +-150ns) and a 1 bit (0.8us +-150ns), and the whole bit
+// period (1.25us +-600ns). A high time above the threshold is read as a 1.
+#define WS2812_T0H_MIN_NSEC     250
+#define WS2812_T0H_MAX_NSEC     550
+#define WS2812_T1H_MIN_NSEC     650
+#define WS2812_T1H_MAX_NSEC     950
+#define WS2812_BIT_MIN_NSEC     650
+#define WS2812_BIT_MAX_NSEC     1850
+#define WS2812_T1H_THRESHOLD_NSEC   600
+// Low for this long and the LEDs latch what they have, ending the frame
+#define WS2812_RESET_NSEC       50000
+
+// Frames of jitter kept by FrameScheduler for its percentiles
+#define JITTER_SAMPLES  1024
+
+// NeoPixel constructor flags
+#define NEOPIXEL_SOFT_DMA       (1 << 0)    // Software DMA stand-in, no /dev/mem
+#define NEOPIXEL_DUAL_CHANNEL   (1 << 1)    // Second strip on PWM channel 2 (GPIO19)
+#define NEOPIXEL_PCM            (1 << 2)    // PCM DOUT (GPIO21) instead of PWM
+#define NEOPIXEL_SPI            (1 << 3)    // SPI0 MOSI (GPIO10) instead of PWM
+#define NEOPIXEL_LOOPBACK       NEOPIXEL_SOFT_DMA   // Same thing: record to memory
+#define NEOPIXEL_REATTACH       (1 << 6)    // Take over output left set up, and leave it so
+
+// Pixel format, one of these (see ws2812-rpi-format.h)
+#define NEOPIXEL_GRB            (0 << 4)    // WS2812 and WS2812B, the default
+#define NEOPIXEL_RGB            (1 << 4)    // WS2811
+#define NEOPIXEL_GRBW           (2 << 4)    // SK6812 RGBW
+#define NEOPIXEL_RGBW           (3 << 4)
+#define NEOPIXEL_FORMAT_MASK    (3 << 4)
 
 #endif
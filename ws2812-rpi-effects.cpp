@@ -0,0 +1,203 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <time.h>
+
+#include "ws2812-rpi-effects.h"
+
+// PUBLIC
+
+bool Effect::finished(unsigned long t){
+    unsigned long d = duration();
+    return d != 0 && t >= d;
+}
+
+// ColorWipeEffect
+
+ColorWipeEffect::ColorWipeEffect(Color_t c, unsigned int stepMS, unsigned int length)
+    : c(c), stepMS(stepMS ? stepMS : 1), length(length)
+{
+}
+
+unsigned long ColorWipeEffect::duration(){ return (unsigned long)length * stepMS; }
+
+bool ColorWipeEffect::render(unsigned long t, NeoPixelSegment& span){
+    unsigned int n = std::min(length, span.numPixels());
+    unsigned int lit = t / stepMS + 1;
+
+    if(finished(t)) {
+        return false;
+    }
+    // Everything up to the current step, so a skipped frame loses nothing
+    span.fill(0, std::min(lit, n), c);
+    return true;
+}
+
+// RainbowEffect
+
+RainbowEffect::RainbowEffect(unsigned int stepMS, unsigned int cycles, bool spread)
+    : stepMS(stepMS ? stepMS : 1), cycles(cycles), spread(spread)
+{
+}
+
+unsigned long RainbowEffect::duration(){ return (unsigned long)256 * cycles * stepMS; }
+
+bool RainbowEffect::render(unsigned long t, NeoPixelSegment& span){
+    unsigned int n = span.numPixels();
+    unsigned int j = t / stepMS;
+    unsigned int i;
+
+    if(finished(t)) {
+        return false;
+    }
+    for(i=0; i<n; i++) {
+        span.setPixelUnchecked(i, NeoPixel::wheel(((spread ? i * 256 / n : i) + j) & 255));
+    }
+    return true;
+}
+
+// TheaterChaseEffect
+
+TheaterChaseEffect::TheaterChaseEffect(Color_t c, unsigned int stepMS, unsigned int runs, bool rainbow)
+    : c(c), stepMS(stepMS ? stepMS : 1), runs(runs), rainbow(rainbow)
+{
+}
+
+unsigned long TheaterChaseEffect::duration(){ return (unsigned long)runs * 3 * stepMS; }
+
+bool TheaterChaseEffect::render(unsigned long t, NeoPixelSegment& span){
+    unsigned int n = span.numPixels();
+    unsigned int k = t / stepMS;
+    unsigned int q = k % 3;
+    unsigned int j = k / 3 * 4;
+    unsigned int i;
+
+    if(finished(t)) {
+        return false;
+    }
+    for(i=0; i<n; i++) {
+        if(i % 3 != q) {
+            span.setPixelUnchecked(i, Color_t(0, 0, 0));
+        } else if(rainbow) {
+            span.setPixelUnchecked(i, NeoPixel::wheel((i + j) % 255));
+        } else {
+            span.setPixelUnchecked(i, c);
+        }
+    }
+    return true;
+}
+
+// EffectSequence
+
+void EffectSequence::add(Effect *effect){
+    effects.push_back(effect);
+}
+
+// Endless if any part of it is
+unsigned long EffectSequence::duration(){
+    unsigned long total = 0, d;
+
+    for(unsigned int e=0; e<effects.size(); e++) {
+        if((d = effects[e]->duration()) == 0) {
+            return 0;
+        }
+        total += d;
+    }
+    return total;
+}
+
+bool EffectSequence::render(unsigned long t, NeoPixelSegment& span){
+    unsigned long d;
+
+    for(unsigned int e=0; e<effects.size(); e++) {
+        d = effects[e]->duration();
+        if(d == 0 || t < d) {
+            return effects[e]->render(t, span);
+        }
+        t -= d;
+    }
+    return false;
+}
+
+// EffectEngine
+
+EffectEngine::EffectEngine() : nextID(1) {}
+
+unsigned int EffectEngine::add(Effect *effect, NeoPixelSegment span){
+    return add(effect, span, millis());
+}
+
+unsigned int EffectEngine::add(Effect *effect, NeoPixelSegment span, unsigned long startMS){
+    slots.push_back(Slot(nextID, effect, span, startMS));
+    return nextID++;
+}
+
+void EffectEngine::stop(unsigned int id){
+    for(unsigned int s=0; s<slots.size(); s++) {
+        if(slots[s].id == id) {
+            slots.erase(slots.begin() + s);
+            return;
+        }
+    }
+}
+
+void EffectEngine::clear(){ slots.clear(); }
+
+bool EffectEngine::running(unsigned int id){
+    for(unsigned int s=0; s<slots.size(); s++) {
+        if(slots[s].id == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned int EffectEngine::numRunning(){ return slots.size(); }
+
+unsigned int EffectEngine::step(){
+    return step(millis());
+}
+
+// Later effects draw over earlier ones where their spans overlap. Effects
+// not due to start yet are left alone.
+unsigned int EffectEngine::step(unsigned long nowMS){
+    unsigned int s = 0;
+
+    while(s < slots.size()) {
+        Slot& slot = slots[s];
+
+        if(nowMS < slot.startMS || slot.effect->render(nowMS - slot.startMS, slot.span)) {
+            s++;
+        } else {
+            slots.erase(slots.begin() + s);
+        }
+    }
+    return slots.size();
+}
+
+unsigned long EffectEngine::millis(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec*1000+ts.tv_nsec/1000000L);
+}
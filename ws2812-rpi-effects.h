@@ -0,0 +1,144 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#ifndef WS2812_RPI_EFFECTS_H
+#define WS2812_RPI_EFFECTS_H
+
+#include <vector>
+#include "ws2812-rpi.h"
+
+// An effect is a frame generator: render() draws the frame for time t, in ms
+// from the start of the effect, into a span of pixels. It keeps no state from
+// one frame to the next, so frames can be rendered at any rate, skipped or
+// repeated, and the same effect can run on several spans at once.
+class Effect {
+public:
+    virtual ~Effect() {}
+
+    // Length of the effect in ms, 0 if it runs until stopped
+    virtual unsigned long duration() = 0;
+    // Draws frame t; returns false without drawing once t is past the end
+    virtual bool render(unsigned long t, NeoPixelSegment& span) = 0;
+
+protected:
+    bool finished(unsigned long t);
+};
+
+// Lights one more pixel every stepMS, leaving the rest of the span as it was
+class ColorWipeEffect : public Effect {
+public:
+    ColorWipeEffect(Color_t c, unsigned int stepMS, unsigned int length);
+    unsigned long duration();
+    bool render(unsigned long t, NeoPixelSegment& span);
+
+private:
+    Color_t c;
+    unsigned int stepMS;
+    unsigned int length;
+};
+
+// The colour wheel across the span, moving one step every stepMS. Spread
+// makes one turn of the wheel cover the whole span, otherwise one pixel per
+// wheel position.
+class RainbowEffect : public Effect {
+public:
+    RainbowEffect(unsigned int stepMS, unsigned int cycles=1, bool spread=false);
+    unsigned long duration();
+    bool render(unsigned long t, NeoPixelSegment& span);
+
+private:
+    unsigned int stepMS;
+    unsigned int cycles;
+    bool spread;
+};
+
+// Every third pixel lit, moving on one pixel every stepMS. With rainbow set
+// the lit pixels take their colour from the wheel, which turns 4 positions
+// per 3 steps.
+class TheaterChaseEffect : public Effect {
+public:
+    TheaterChaseEffect(Color_t c, unsigned int stepMS, unsigned int runs, bool rainbow=false);
+    unsigned long duration();
+    bool render(unsigned long t, NeoPixelSegment& span);
+
+private:
+    Color_t c;
+    unsigned int stepMS;
+    unsigned int runs;
+    bool rainbow;
+};
+
+// Effects one after the other. Doesn't own them.
+class EffectSequence : public Effect {
+public:
+    void add(Effect *effect);
+    unsigned long duration();
+    bool render(unsigned long t, NeoPixelSegment& span);
+
+private:
+    std::vector<Effect*> effects;
+};
+
+// Runs effects on spans of pixels without blocking. Call step() once per
+// frame and then show() or submit(); each call renders one frame of every
+// running effect and returns, so the cost per frame is bounded by the
+// effects' own render costs. Effects that finish are dropped. The engine
+// doesn't own the effects.
+class EffectEngine {
+public:
+    EffectEngine();
+
+    // Starts effect on span now (or at time startMS on the millis() clock)
+    // and returns an id for stop()
+    unsigned int add(Effect *effect, NeoPixelSegment span);
+    unsigned int add(Effect *effect, NeoPixelSegment span, unsigned long startMS);
+    void stop(unsigned int id);
+    void clear();
+    bool running(unsigned int id);
+    unsigned int numRunning();
+
+    // Renders every effect at time nowMS on the millis() clock, or now.
+    // Returns the number still running.
+    unsigned int step();
+    unsigned int step(unsigned long nowMS);
+
+    static unsigned long millis();
+
+private:
+    struct Slot {
+        unsigned int id;
+        Effect *effect;
+        NeoPixelSegment span;
+        unsigned long startMS;
+
+        Slot(unsigned int id, Effect *effect, NeoPixelSegment span, unsigned long startMS)
+            : id(id), effect(effect), span(span), startMS(startMS)
+        {}
+    };
+
+    std::vector<Slot> slots;
+    unsigned int nextID;
+};
+
+#endif
@@ -0,0 +1,213 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <string.h>
+
+#include "ws2812-rpi-encoder.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SIMD_KERNEL "neon"
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define SIMD_KERNEL "ssse3"
+#define SIMD_KERNEL_SSSE3
+#endif
+
+#ifdef SIMD_KERNEL
+
+// A colour byte b7..b0 becomes the 24 bit symbol 1b70 1b60 ... 1b00, i.e.
+// the three bytes
+//
+//     1 b7 0 1 b6 0 1 b5 | 0 1 b4 0 1 b3 0 1 | b2 0 1 b1 0 1 b0 0
+//
+// Each symbol byte only depends on a few bits of the colour byte, so all three
+// are small table lookups (8, 4 and 8 entries) which map onto a single
+// vtbl/pshufb. The colour bytes are first shuffled from memory order into wire
+// order, and interleaving the three lookups then gives the symbol stream. That
+// is big endian, so it is byte swapped into native PWM words.
+struct ExpandTables {
+    uint8_t hi[16];     // symbol byte 0, indexed by b >> 5
+    uint8_t mid[16];    // symbol byte 1, indexed by (b >> 3) & 3
+    uint8_t lo[16];     // symbol byte 2, indexed by b & 7
+#ifdef SIMD_KERNEL_SSSE3
+    // pshufb masks gathering the 36 output bytes of a 12 byte step from the
+    // three lookups: shuffle[out][lookup]
+    uint8_t shuffle[3][3][16];
+#endif
+
+    ExpandTables(){
+        int i;
+        memset(this, 0, sizeof(*this));
+        for(i=0; i<8; i++) {
+            hi[i] = WS2812Encoder::symbol(i << 5) >> 16;
+            lo[i] = WS2812Encoder::symbol(i);
+        }
+        for(i=0; i<4; i++) {
+            mid[i] = WS2812Encoder::symbol(i << 3) >> 8;
+        }
+#ifdef SIMD_KERNEL_SSSE3
+        for(int out=0; out<3; out++) {
+            for(int q=0; q<16; q++) {
+                int m = out * 16 + q;
+                int s = (m & ~3) + 3 - (m & 3);
+                for(int j=0; j<3; j++) {
+                    shuffle[out][j][q] = (s < 36 && s % 3 == j) ? s / 3 : 0x80;
+                }
+            }
+        }
+#endif
+    }
+};
+
+static const ExpandTables& expandTables(){
+    static const ExpandTables tables;
+    return tables;
+}
+
+// Index of the memory byte that goes out at each wire position of a step,
+// given the per-pixel byte order. step must be a multiple of groupBytes.
+static void wireOrder(uint8_t *index, unsigned int step, const uint8_t *order, unsigned int groupBytes){
+    for(unsigned int i=0; i<step; i++) {
+        index[i] = (i / groupBytes) * groupBytes + order[i % groupBytes];
+    }
+}
+
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+// 24 colour bytes -> 72 symbol bytes -> 18 PWM words per step. 24 bytes is a
+// whole number of both 3 and 4 byte pixels.
+unsigned int expandSIMD(const uint8_t *bytes, unsigned int numBytes, uint32_t *words,
+                        const uint8_t *order, unsigned int groupBytes){
+    const ExpandTables& t = expandTables();
+    const uint8x8_t hi = vld1_u8(t.hi), mid = vld1_u8(t.mid), lo = vld1_u8(t.lo);
+    const uint8x8_t three = vdup_n_u8(3), seven = vdup_n_u8(7);
+    uint8_t index[24];
+    uint8_t stream[72] __attribute__((aligned(16)));
+    uint8_t *out = (uint8_t*)words;
+    uint8x8_t perm[3];
+    unsigned int i;
+    int c;
+
+    wireOrder(index, 24, order, groupBytes);
+    for(c=0; c<3; c++) {
+        perm[c] = vld1_u8(index + c * 8);
+    }
+
+    for(i=0; i+24<=numBytes; i+=24) {
+        uint8x8x3_t in;
+
+        in.val[0] = vld1_u8(bytes + i);
+        in.val[1] = vld1_u8(bytes + i + 8);
+        in.val[2] = vld1_u8(bytes + i + 16);
+
+        for(c=0; c<3; c++) {
+            uint8x8_t b = vtbl3_u8(in, perm[c]);
+            uint8x8x3_t s;
+
+            s.val[0] = vtbl1_u8(hi, vshr_n_u8(b, 5));
+            s.val[1] = vtbl1_u8(mid, vand_u8(vshr_n_u8(b, 3), three));
+            s.val[2] = vtbl1_u8(lo, vand_u8(b, seven));
+            vst3_u8(stream + c * 24, s);
+        }
+
+        for(c=0; c<72; c+=16) {
+            if(c + 16 <= 72) {
+                vst1q_u8(out + c, vrev32q_u8(vld1q_u8(stream + c)));
+            } else {
+                vst1_u8(out + c, vrev32_u8(vld1_u8(stream + c)));
+            }
+        }
+        out += 72;
+    }
+    return i;
+}
+
+#elif defined(SIMD_KERNEL_SSSE3)
+
+// 12 colour bytes -> 36 symbol bytes -> 9 PWM words per step. 12 bytes is a
+// whole number of both 3 and 4 byte pixels; each step loads 16 bytes so the
+// last 4 bytes of input are always left to the scalar kernel.
+unsigned int expandSIMD(const uint8_t *bytes, unsigned int numBytes, uint32_t *words,
+                        const uint8_t *order, unsigned int groupBytes){
+    const ExpandTables& t = expandTables();
+    const __m128i hi = _mm_loadu_si128((const __m128i*)t.hi);
+    const __m128i mid = _mm_loadu_si128((const __m128i*)t.mid);
+    const __m128i lo = _mm_loadu_si128((const __m128i*)t.lo);
+    const __m128i three = _mm_set1_epi8(3), seven = _mm_set1_epi8(7);
+    uint8_t index[16];
+    __m128i perm, shuffle[3][3];
+    uint8_t *out = (uint8_t*)words;
+    unsigned int i;
+    int j, k;
+
+    memset(index, 0x80, sizeof(index));
+    wireOrder(index, 12, order, groupBytes);
+    perm = _mm_loadu_si128((const __m128i*)index);
+    for(j=0; j<3; j++) {
+        for(k=0; k<3; k++) {
+            shuffle[j][k] = _mm_loadu_si128((const __m128i*)t.shuffle[j][k]);
+        }
+    }
+
+    for(i=0; i+16<=numBytes; i+=12) {
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(bytes + i)), perm);
+        // No 8 bit shifts in SSE; the masks drop what leaks across bytes
+        __m128i s0 = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(b, 5), seven));
+        __m128i s1 = _mm_shuffle_epi8(mid, _mm_and_si128(_mm_srli_epi16(b, 3), three));
+        __m128i s2 = _mm_shuffle_epi8(lo, _mm_and_si128(b, seven));
+        __m128i w[3];
+
+        for(j=0; j<3; j++) {
+            w[j] = _mm_or_si128(
+                _mm_or_si128(_mm_shuffle_epi8(s0, shuffle[j][0]), _mm_shuffle_epi8(s1, shuffle[j][1])),
+                _mm_shuffle_epi8(s2, shuffle[j][2]));
+        }
+        _mm_storeu_si128((__m128i*)out, w[0]);
+        _mm_storeu_si128((__m128i*)(out + 16), w[1]);
+        *(uint32_t*)(out + 32) = _mm_cvtsi128_si32(w[2]);
+        out += 36;
+    }
+    return i;
+}
+
+#else
+
+// No kernel for this target; the scalar encoder does every byte
+unsigned int expandSIMD(const uint8_t * /* bytes */, unsigned int /* numBytes */, uint32_t * /* words */,
+                        const uint8_t * /* order */, unsigned int /* groupBytes */){
+    return 0;
+}
+
+#endif
+
+const char* simdKernelName(){
+#ifdef SIMD_KERNEL
+    return SIMD_KERNEL;
+#else
+    return 0;
+#endif
+}
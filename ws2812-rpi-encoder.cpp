@@ -0,0 +1,294 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <string.h>
+#include <math.h>
+#if defined(__arm__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#include "ws2812-rpi-encoder.h"
+
+// Pack four consecutive 24 bit symbols into three 32 bit words
+#define PACK_SYMBOLS(w, s0, s1, s2, s3) \
+    (w)[0] = ((s0) << 8) | ((s1) >> 16); \
+    (w)[1] = ((s1) << 16) | ((s2) >> 8); \
+    (w)[2] = ((s2) << 24) | (s3)
+
+// The SIMD kernel reads the LED buffer as a plain byte array
+static_assert(sizeof(Color_t) == 3, "Color_t must be packed");
+
+// The byte of pixel i that goes out for channel C
+template<unsigned int C>
+static inline uint8_t channelByte(const Color_t *leds, const uint8_t *white, unsigned int i){
+    return white[i];
+}
+template<> inline uint8_t channelByte<CHANNEL_R>(const Color_t *leds, const uint8_t *white, unsigned int i){
+    return leds[i].r;
+}
+template<> inline uint8_t channelByte<CHANNEL_G>(const Color_t *leds, const uint8_t *white, unsigned int i){
+    return leds[i].g;
+}
+template<> inline uint8_t channelByte<CHANNEL_B>(const Color_t *leds, const uint8_t *white, unsigned int i){
+    return leds[i].b;
+}
+
+// Pixel i's symbols in wire order
+template<class Format>
+static inline void pixelSymbols(uint32_t *s, const Color_t *leds, const uint8_t *white, unsigned int i,
+                                const uint32_t *const *t){
+    s[0] = t[Format::c0][channelByte<Format::c0>(leds, white, i)];
+    s[1] = t[Format::c1][channelByte<Format::c1>(leds, white, i)];
+    s[2] = t[Format::c2][channelByte<Format::c2>(leds, white, i)];
+    if(Format::channels == 4) {
+        s[3] = t[Format::c3][channelByte<Format::c3>(leds, white, i)];
+    }
+}
+
+bool WS2812Encoder::simdEnabled = WS2812Encoder::hasSIMD();
+
+// PUBLIC
+
+unsigned int WS2812Encoder::wordsForLEDs(unsigned int numLEDs, unsigned int channels){
+    return (numLEDs * channels * 24 + 31) / 32;
+}
+
+unsigned int WS2812Encoder::ledsForWords(unsigned int numWords, unsigned int channels){
+    return (numWords * 32) / (channels * 24);
+}
+
+unsigned int WS2812Encoder::encode(const Color_t *leds, unsigned int numLEDs,
+                                   unsigned int *words, unsigned int maxWords,
+                                   const SymbolLUT *lut){
+    return encodeFormat<FormatGRB>(leds, 0, numLEDs, words, maxWords, lut);
+}
+
+template<class Format>
+unsigned int WS2812Encoder::encodeFormat(const Color_t *leds, const uint8_t *white, unsigned int numLEDs,
+                                         unsigned int *words, unsigned int maxWords, const SymbolLUT *lut){
+    const uint32_t *sym = symbolTable();
+    const uint32_t *tables[4] = { sym, sym, sym, sym };
+    unsigned int done = 0;
+
+    if(numLEDs > ledsForWords(maxWords, Format::channels)) {
+        numLEDs = ledsForWords(maxWords, Format::channels);
+    }
+
+    // A table other than the identity is a per byte gather, which the
+    // scalar encoder does for free as part of its symbol lookup
+    if(lut && !lut->identity) {
+        const uint32_t *lutTables[4] = { lut->r, lut->g, lut->b, lut->w };
+        return encodeScalar<Format>(leds, white, numLEDs, words, lutTables);
+    }
+
+    // The vector kernel does whole steps straight from Color_t, which
+    // always end on a word; the scalar encoder picks up the rest. The white
+    // plane is somewhere else, so four channel formats are all scalar.
+    if(simdEnabled && Format::channels == 3) {
+        static const uint8_t order[3] = { Format::c0, Format::c1, Format::c2 };
+        done = expandSIMD(&leds->r, numLEDs * 3, words, order, 3) / 3;
+    }
+    return wordsForLEDs(done, Format::channels) +
+        encodeScalar<Format>(leds + done, white ? white + done : 0, numLEDs - done,
+                             words + wordsForLEDs(done, Format::channels), tables);
+}
+
+template unsigned int WS2812Encoder::encodeFormat<FormatGRB>(const Color_t*, const uint8_t*, unsigned int,
+                                                             unsigned int*, unsigned int, const SymbolLUT*);
+template unsigned int WS2812Encoder::encodeFormat<FormatRGB>(const Color_t*, const uint8_t*, unsigned int,
+                                                             unsigned int*, unsigned int, const SymbolLUT*);
+template unsigned int WS2812Encoder::encodeFormat<FormatGRBW>(const Color_t*, const uint8_t*, unsigned int,
+                                                              unsigned int*, unsigned int, const SymbolLUT*);
+template unsigned int WS2812Encoder::encodeFormat<FormatRGBW>(const Color_t*, const uint8_t*, unsigned int,
+                                                              unsigned int*, unsigned int, const SymbolLUT*);
+
+WS2812Encoder::EncodeFunc WS2812Encoder::encoderFor(unsigned int flags){
+    switch(flags & NEOPIXEL_FORMAT_MASK) {
+    case NEOPIXEL_RGB:
+        return &encodeFormat<FormatRGB>;
+    case NEOPIXEL_GRBW:
+        return &encodeFormat<FormatGRBW>;
+    case NEOPIXEL_RGBW:
+        return &encodeFormat<FormatRGBW>;
+    default:
+        return &encodeFormat<FormatGRB>;
+    }
+}
+
+unsigned int WS2812Encoder::channelsFor(unsigned int flags){
+    switch(flags & NEOPIXEL_FORMAT_MASK) {
+    case NEOPIXEL_GRBW:
+        return FormatGRBW::channels;
+    case NEOPIXEL_RGBW:
+        return FormatRGBW::channels;
+    default:
+        return FormatGRB::channels;
+    }
+}
+
+void WS2812Encoder::buildLUT(SymbolLUT& lut, float brightness, float gamma, Color_t white){
+    const uint32_t *sym = symbolTable();
+    uint32_t level[4];
+    uint32_t curve;
+    unsigned int v;
+
+    level[0] = (uint32_t)(brightness * white.r * 257 + 0.5f);
+    level[1] = (uint32_t)(brightness * white.g * 257 + 0.5f);
+    level[2] = (uint32_t)(brightness * white.b * 257 + 0.5f);
+    level[3] = (uint32_t)(brightness * 255 * 257 + 0.5f);
+
+    lut.identity = (gamma == 1.0f && level[0] == 65535 && level[1] == 65535 && level[2] == 65535);
+    for(v=0; v<256; v++) {
+        curve = (gamma == 1.0f) ? v : (uint32_t)(255 * pow(v / 255.0, gamma) + 0.5);
+        lut.r[v] = sym[(curve * level[0] + 32767) >> 16];
+        lut.g[v] = sym[(curve * level[1] + 32767) >> 16];
+        lut.b[v] = sym[(curve * level[2] + 32767) >> 16];
+        lut.w[v] = sym[(curve * level[3] + 32767) >> 16];
+    }
+}
+
+unsigned int WS2812Encoder::expandScalar(const uint8_t *bytes, unsigned int numBytes, uint32_t *words){
+    const uint32_t *sym = symbolTable();
+    uint32_t *w = words;
+    unsigned int i;
+
+    for(i=0; i+CHUNK_BYTES<=numBytes; i+=CHUNK_BYTES) {
+        PACK_SYMBOLS(w, sym[bytes[i]], sym[bytes[i+1]], sym[bytes[i+2]], sym[bytes[i+3]]);
+        w += CHUNK_WORDS;
+    }
+
+    // Up to three bytes left over; missing symbols are zero so the tail of
+    // the last word stays low
+    if(i < numBytes) {
+        uint32_t s[CHUNK_BYTES] = { 0 };
+        uint32_t tail[CHUNK_WORDS];
+        unsigned int k;
+
+        for(k=0; i+k<numBytes; k++) {
+            s[k] = sym[bytes[i+k]];
+        }
+        PACK_SYMBOLS(tail, s[0], s[1], s[2], s[3]);
+
+        // 24 bits per byte, rounded up to whole words
+        k = (k * 24 + 31) / 32;
+        memcpy(w, tail, k * 4);
+        w += k;
+    }
+
+    return w - words;
+}
+
+bool WS2812Encoder::hasSIMD(){
+    if(simdKernelName() == 0) {
+        return false;
+    }
+#if defined(__arm__)
+    // 32 bit ARM: Pi 1 has no NEON, Pi 2 and later do
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#elif defined(__x86_64__) || defined(__i386__)
+    return __builtin_cpu_supports("ssse3");
+#else
+    return true;
+#endif
+}
+
+bool WS2812Encoder::useSIMD(bool enable){
+    if(enable && !hasSIMD()) {
+        return false;
+    }
+    simdEnabled = enable;
+    return true;
+}
+
+const char* WS2812Encoder::kernelName(){
+    return simdEnabled ? simdKernelName() : "scalar";
+}
+
+// PRIVATE
+
+// Four LEDs at a time straight from the symbol tables into a group of words,
+// nine for three channels and twelve for four
+template<class Format>
+unsigned int WS2812Encoder::encodeScalar(const Color_t *leds, const uint8_t *white, unsigned int numLEDs,
+                                         uint32_t *words, const uint32_t *const *tables){
+    const unsigned int ch = Format::channels;
+    uint32_t *w = words;
+    uint32_t s[4 * 4];
+    uint32_t tail[Format::groupWords];
+    unsigned int i, k;
+
+    for(i=0; i+4<=numLEDs; i+=4) {
+        pixelSymbols<Format>(s, leds, white, i, tables);
+        pixelSymbols<Format>(s + ch, leds, white, i + 1, tables);
+        pixelSymbols<Format>(s + ch * 2, leds, white, i + 2, tables);
+        pixelSymbols<Format>(s + ch * 3, leds, white, i + 3, tables);
+
+        PACK_SYMBOLS(w + 0, s[0], s[1], s[2], s[3]);
+        PACK_SYMBOLS(w + 3, s[4], s[5], s[6], s[7]);
+        PACK_SYMBOLS(w + 6, s[8], s[9], s[10], s[11]);
+        if(ch == 4) {
+            PACK_SYMBOLS(w + 9, s[12], s[13], s[14], s[15]);
+        }
+        w += Format::groupWords;
+    }
+
+    // Up to three LEDs left over; missing symbols are zero so the tail of the
+    // last word stays low
+    if(i < numLEDs) {
+        memset(s, 0, sizeof(s));
+        for(k=0; i<numLEDs; i++, k+=ch) {
+            pixelSymbols<Format>(s + k, leds, white, i, tables);
+        }
+        PACK_SYMBOLS(tail + 0, s[0], s[1], s[2], s[3]);
+        PACK_SYMBOLS(tail + 3, s[4], s[5], s[6], s[7]);
+        PACK_SYMBOLS(tail + 6, s[8], s[9], s[10], s[11]);
+        if(ch == 4) {
+            PACK_SYMBOLS(tail + 9, s[12], s[13], s[14], s[15]);
+        }
+
+        k = (k * 24 + 31) / 32;
+        memcpy(w, tail, k * 4);
+        w += k;
+    }
+
+    return w - words;
+}
+
+// Built by the compiler, so there is nothing to set up at run time
+struct SymbolTable {
+    uint32_t sym[256];
+
+    constexpr SymbolTable() : sym() {
+        for(int i=0; i<256; i++) {
+            sym[i] = WS2812Encoder::symbol(i);
+        }
+    }
+};
+
+static constexpr SymbolTable symbols;
+
+const uint32_t* WS2812Encoder::symbolTable(){
+    return symbols.sym;
+}
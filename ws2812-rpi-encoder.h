@@ -0,0 +1,128 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#ifndef WS2812_RPI_ENCODER_H
+#define WS2812_RPI_ENCODER_H
+
+#include <stdint.h>
+#include "ws2812-rpi-defines.h"
+#include "ws2812-rpi-format.h"
+
+// Each colour bit goes out as a 3 bit PWM symbol (1 -> 110, 0 -> 100), so a
+// colour byte is a 24 bit symbol and an LED is 72 bits (96 with white). Four
+// colour bytes fill exactly three 32 bit PWM words, which is the unit the
+// kernels work in.
+#define SYMBOL_BITS         3
+#define LED_BITS            (24 * SYMBOL_BITS)
+#define CHUNK_BYTES         4
+#define CHUNK_WORDS         3
+
+// Wire symbols for each colour byte, one table per channel, with brightness,
+// gamma and white balance already applied. Building one costs a few thousand
+// operations; encoding through it costs nothing over the plain symbol table.
+struct SymbolLUT {
+    uint32_t r[256];
+    uint32_t g[256];
+    uint32_t b[256];
+    // Four channel strips only, brightness and gamma but no white balance
+    uint32_t w[256];
+    // Every table maps a byte to its own symbol, so the SIMD kernel can be used
+    bool identity;
+};
+
+class WS2812Encoder {
+public:
+    // One format's encoder; white is the white plane for four channel
+    // formats and ignored otherwise
+    typedef unsigned int (*EncodeFunc)(const Color_t *leds, const uint8_t *white, unsigned int numLEDs,
+                                       unsigned int *words, unsigned int maxWords, const SymbolLUT *lut);
+
+    // Number of PWM words needed to hold numLEDs worth of symbols
+    static unsigned int wordsForLEDs(unsigned int numLEDs, unsigned int channels=3);
+    // Number of whole LEDs that fit in numWords PWM words
+    static unsigned int ledsForWords(unsigned int numWords, unsigned int channels=3);
+
+    // Encode the LEDs into PWM words, MSB first, in wire (GRB) order. Unused
+    // bits at the end of the last word are zero. LEDs that don't fit in
+    // maxWords are dropped. Returns the number of words written. With a
+    // lookup table each colour byte goes out as its table entry instead.
+    static unsigned int encode(const Color_t *leds, unsigned int numLEDs,
+                               unsigned int *words, unsigned int maxWords,
+                               const SymbolLUT *lut=0);
+
+    // encode() for any PixelFormat, with the channel order and count fixed
+    // at compile time. Built for the four formats in ws2812-rpi-format.h.
+    template<class Format>
+    static unsigned int encodeFormat(const Color_t *leds, const uint8_t *white, unsigned int numLEDs,
+                                     unsigned int *words, unsigned int maxWords, const SymbolLUT *lut=0);
+    // The encodeFormat() for a NEOPIXEL_GRB, _RGB, _GRBW or _RGBW flag, and
+    // the number of colour bytes per pixel it sends
+    static EncodeFunc encoderFor(unsigned int flags);
+    static unsigned int channelsFor(unsigned int flags);
+
+    // Fills lut for the given brightness (0 to 1), gamma (1 is linear) and
+    // white point. In 16 bit fixed point, output = curve(v) * level / 65536,
+    // with curve(v) = 255 * (v/255)^gamma and level = brightness * white * 257,
+    // each rounded to nearest.
+    static void buildLUT(SymbolLUT& lut, float brightness, float gamma, Color_t white);
+
+    // Expand wire order colour bytes into PWM words. Returns the number of
+    // words written.
+    static unsigned int expandScalar(const uint8_t *bytes, unsigned int numBytes, uint32_t *words);
+
+    // The SIMD kernel (NEON on ARM, SSSE3 on x86) is used when the CPU
+    // supports it. useSIMD(false) forces the scalar kernel; useSIMD(true)
+    // returns false if there is no usable SIMD kernel.
+    static bool hasSIMD();
+    static bool useSIMD(bool enable);
+    static const char* kernelName();
+
+    // 24 bit wire symbol for a colour byte
+    static constexpr uint32_t symbol(unsigned char byte){
+        uint32_t s = 0;
+        for(int i=7; i>=0; i--) {
+            s = (s << SYMBOL_BITS) | ((byte & (1 << i)) ? 6 : 4);
+        }
+        return s;
+    }
+
+private:
+    // tables holds each channel's symbols, indexed by CHANNEL_R to _W
+    template<class Format>
+    static unsigned int encodeScalar(const Color_t *leds, const uint8_t *white, unsigned int numLEDs,
+                                     uint32_t *words, const uint32_t *const *tables);
+    static const uint32_t* symbolTable();
+    static bool simdEnabled;
+};
+
+// SIMD kernel, built from ws2812-rpi-encoder-simd.cpp with the flags for the
+// target's vector unit. Takes pixels in memory order, where wire byte p of each
+// groupBytes sized pixel is bytes[order[p]], and expands as many whole vector
+// steps as fit in numBytes. Returns the number of bytes consumed, which is
+// always a whole number of pixels and of words.
+const char* simdKernelName();
+unsigned int expandSIMD(const uint8_t *bytes, unsigned int numBytes, uint32_t *words,
+                        const uint8_t *order, unsigned int groupBytes);
+
+#endif
@@ -0,0 +1,62 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#ifndef WS2812_RPI_FORMAT_H
+#define WS2812_RPI_FORMAT_H
+
+#include "ws2812-rpi-defines.h"
+
+// Colour channels, numbered by their place in memory: the three bytes of a
+// Color_t, then the separate white plane of four channel strips
+#define CHANNEL_R   0
+#define CHANNEL_G   1
+#define CHANNEL_B   2
+#define CHANNEL_W   3
+
+// The layout of one pixel on the wire, as a type: how many colour bytes it
+// has and which channel goes out in each position. Encoders are generated
+// from it at compile time, so nothing about the format is looked at per
+// pixel. Flag is the NeoPixel constructor flag that picks it.
+template<unsigned int Channels, unsigned int C0, unsigned int C1, unsigned int C2,
+         unsigned int C3, unsigned int Flag>
+struct PixelFormat {
+    static const unsigned int channels = Channels;
+    static const unsigned int c0 = C0, c1 = C1, c2 = C2, c3 = C3;
+    static const unsigned int flag = Flag;
+    // 24 bits of symbols per colour byte. A dirty group of four pixels is a
+    // whole number of words either way: 9 for three channels, 12 for four.
+    static const unsigned int ledBits = Channels * 24;
+    static const unsigned int groupWords = DIRTY_GROUP_LEDS * ledBits / 32;
+};
+
+// WS2812 and WS2812B, the default
+typedef PixelFormat<3, CHANNEL_G, CHANNEL_R, CHANNEL_B, CHANNEL_W, NEOPIXEL_GRB> FormatGRB;
+// WS2811 driver chips and some WS2812 clones
+typedef PixelFormat<3, CHANNEL_R, CHANNEL_G, CHANNEL_B, CHANNEL_W, NEOPIXEL_RGB> FormatRGB;
+// SK6812 RGBW
+typedef PixelFormat<4, CHANNEL_G, CHANNEL_R, CHANNEL_B, CHANNEL_W, NEOPIXEL_GRBW> FormatGRBW;
+// SK6812 variants that send red first
+typedef PixelFormat<4, CHANNEL_R, CHANNEL_G, CHANNEL_B, CHANNEL_W, NEOPIXEL_RGBW> FormatRGBW;
+
+#endif
@@ -0,0 +1,347 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include <algorithm>
+
+#include "ws2812-rpi-opc.h"
+
+// Reads per client per poll(), so one fast producer can't shut out the rest
+#define OPC_READS_PER_POLL  16
+
+// PUBLIC
+
+OPCServer::OPCServer(NeoPixel& strip)
+    : strip(strip), unixFD(-1), tcpFD(-1), frameReady(false), messages(0)
+{
+    pixels = strip.getPixelData();
+    channelLEDs = strip.numPixels() / strip.getNumChannels();
+}
+
+OPCServer::~OPCServer(){
+    for(unsigned int i = 0; i < clients.size(); i++) {
+        close(clients[i].fd);
+    }
+    if(unixFD >= 0) {
+        close(unixFD);
+        unlink(unixPath.c_str());
+    }
+    if(tcpFD >= 0) {
+        close(tcpFD);
+    }
+    strip.releasePixelData();
+}
+
+bool OPCServer::listenUnix(const char *path){
+    struct sockaddr_un addr;
+    int fd;
+
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        printf("Socket path %s is too long\n", path);
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    // A socket left behind by an earlier run would make bind() fail
+    unlink(path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        printf("Unable to bind %s: %s\n", path, strerror(errno));
+        if(fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    // Producers shouldn't need to run as root to connect
+    chmod(path, 0666);
+
+    if(!listenOn(fd, path)) {
+        unlink(path);
+        return false;
+    }
+    unixFD = fd;
+    unixPath = path;
+    return true;
+}
+
+bool OPCServer::listenTCP(unsigned short port){
+    struct sockaddr_in addr;
+    int fd, on = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd >= 0) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    if(fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        printf("Unable to bind localhost port %d: %s\n", port, strerror(errno));
+        if(fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    if(!listenOn(fd, "TCP port")) {
+        return false;
+    }
+    tcpFD = fd;
+    return true;
+}
+
+unsigned short OPCServer::getTCPPort(){
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    if(tcpFD < 0 || getsockname(tcpFD, (struct sockaddr *)&addr, &len) < 0) {
+        return 0;
+    }
+    return ntohs(addr.sin_port);
+}
+
+bool OPCServer::poll(int timeoutMS){
+    std::vector<struct pollfd> fds;
+    struct pollfd pfd;
+    unsigned int i, first;
+    int completionFD = strip.getCompletionFD();
+    int wait;
+
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    pfd.fd = unixFD;
+    fds.push_back(pfd);
+    pfd.fd = tcpFD;
+    fds.push_back(pfd);
+    pfd.fd = completionFD;
+    fds.push_back(pfd);
+    first = fds.size();
+    for(i = 0; i < clients.size(); i++) {
+        pfd.fd = clients[i].fd;
+        fds.push_back(pfd);
+    }
+
+    // A frame held back for a slow client mustn't wait for ever. One held
+    // back by the wire is woken by the completion descriptor, if there is one.
+    wait = frameTimeout();
+    if(wait == 0 && completionFD < 0) {
+        wait = 1;
+    }
+    if(wait > 0 && (timeoutMS < 0 || wait < timeoutMS)) {
+        timeoutMS = wait;
+    }
+
+    if(::poll(fds.data(), fds.size(), timeoutMS) < 0) {
+        if(errno == EINTR) {
+            return true;
+        }
+        printf("Unable to poll OPC clients: %s\n", strerror(errno));
+        return false;
+    }
+
+    if(fds[2].revents) {
+        strip.handleCompletion();
+    }
+
+    // Clients that hung up or sent garbage are dropped
+    for(i = clients.size(); i-- > 0; ) {
+        if(fds[first + i].revents && !readClient(clients[i])) {
+            close(clients[i].fd);
+            clients.erase(clients.begin() + i);
+        }
+    }
+
+    if(fds[0].revents) {
+        acceptClients(unixFD);
+    }
+    if(fds[1].revents) {
+        acceptClients(tcpFD);
+    }
+
+    if(frameReady && frameTimeout() == 0 && !strip.busy()) {
+        strip.submit();
+        frameReady = false;
+    }
+    return true;
+}
+
+unsigned int OPCServer::numClients(){ return clients.size(); }
+
+unsigned long OPCServer::getMessages(){ return messages; }
+
+// PRIVATE
+
+bool OPCServer::listenOn(int fd, const char *what){
+    if(listen(fd, 16) < 0) {
+        printf("Unable to listen on %s: %s\n", what, strerror(errno));
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+void OPCServer::acceptClients(int listenFD){
+    Client client;
+    int fd;
+
+    while((fd = accept4(listenFD, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        memset(&client, 0, sizeof(client));
+        client.fd = fd;
+        clients.push_back(client);
+    }
+}
+
+// Reads whatever the socket holds, a message at a time: the payload goes
+// straight to its place in the LED buffer, and each read stops at the end of
+// the next header, which says where the following payload goes.
+bool OPCServer::readClient(Client& c){
+    struct iovec iov[3];
+    unsigned int n, rest, part, reads;
+    ssize_t got;
+
+    for(reads = 0; reads < OPC_READS_PER_POLL; reads++) {
+        n = 0;
+        if(c.headerBytes < OPC_HEADER_BYTES) {
+            iov[n].iov_base = c.header + c.headerBytes;
+            iov[n++].iov_len = OPC_HEADER_BYTES - c.headerBytes;
+        } else {
+            rest = c.payloadLeft - c.targetLeft;
+            if(c.targetLeft) {
+                iov[n].iov_base = c.target;
+                iov[n++].iov_len = c.targetLeft;
+            }
+            if(rest) {
+                iov[n].iov_base = discard;
+                iov[n++].iov_len = std::min(rest, (unsigned int)sizeof(discard));
+            }
+            if(rest <= sizeof(discard)) {
+                iov[n].iov_base = c.header;
+                iov[n++].iov_len = OPC_HEADER_BYTES;
+            }
+        }
+
+        got = readv(c.fd, iov, n);
+        if(got == 0) {
+            return false;
+        }
+        if(got < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+
+        if(c.headerBytes == 0) {
+            c.started = strip.millis();
+        }
+        if(c.headerBytes < OPC_HEADER_BYTES) {
+            c.headerBytes += got;
+            if(c.headerBytes == OPC_HEADER_BYTES) {
+                startMessage(c);
+            }
+            continue;
+        }
+
+        part = std::min((unsigned int)got, c.targetLeft);
+        c.target += part;
+        c.targetLeft -= part;
+        c.payloadLeft -= part;
+        got -= part;
+        part = std::min((unsigned int)got, c.payloadLeft);
+        c.payloadLeft -= part;
+        got -= part;
+
+        if(c.payloadLeft == 0) {
+            endMessage(c);
+            // Anything left over is the start of the next header
+            if(got > 0) {
+                c.started = strip.millis();
+                c.headerBytes = got;
+                if(c.headerBytes == OPC_HEADER_BYTES) {
+                    startMessage(c);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void OPCServer::startMessage(Client& c){
+    unsigned int channel = c.header[0];
+    unsigned int first = 0, count = 0;
+
+    c.payloadLeft = (c.header[2] << 8) | c.header[3];
+    c.setPixels = c.header[1] == OPC_SET_PIXELS &&
+        channel <= (strip.getNumChannels() > 1 ? strip.getNumChannels() : 0);
+    if(c.setPixels) {
+        first = channel ? (channel - 1) * channelLEDs : 0;
+        count = channel ? channelLEDs : strip.numPixels();
+    }
+
+    // Color_t is packed RGB, the same as OPC's pixel data
+    c.target = (uint8_t *)(pixels + first);
+    c.targetLeft = std::min(c.payloadLeft, count * 3);
+
+    if(c.payloadLeft == 0) {
+        endMessage(c);
+    }
+}
+
+void OPCServer::endMessage(Client& c){
+    if(c.setPixels) {
+        messages++;
+        frameReady = true;
+    }
+    c.headerBytes = 0;
+    c.setPixels = false;
+    c.targetLeft = 0;
+}
+
+// Milliseconds until the ready frame can go out whatever the clients are
+// doing: 0 if nothing is holding it back, -1 if there is no frame
+int OPCServer::frameTimeout(){
+    unsigned long now = strip.millis();
+    int wait = 0;
+
+    if(!frameReady) {
+        return -1;
+    }
+    for(unsigned int i = 0; i < clients.size(); i++) {
+        if(clients[i].headerBytes > 0 && now - clients[i].started < OPC_STALL_MS) {
+            wait = std::max(wait, (int)(clients[i].started + OPC_STALL_MS - now));
+        }
+    }
+    return wait;
+}
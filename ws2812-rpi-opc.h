@@ -0,0 +1,115 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#ifndef WS2812_RPI_OPC_H
+#define WS2812_RPI_OPC_H
+
+#include <stdint.h>
+
+#include <vector>
+#include <string>
+#include "ws2812-rpi.h"
+
+// Open Pixel Control: each message is a channel, a command and a big endian
+// payload length, then the payload. Command 0 sets pixels from RGB triplets.
+#define OPC_HEADER_BYTES    4
+#define OPC_MAX_PAYLOAD     0xffff
+#define OPC_SET_PIXELS      0
+#define OPC_SYSEX           255
+#define OPC_DEFAULT_PORT    7890
+
+// How long a frame that has arrived waits for another client to finish the
+// message it is part way through, before going out anyway
+#define OPC_STALL_MS        20
+
+// Serves a strip to Open Pixel Control clients on a UNIX socket and/or a TCP
+// port on localhost, so any number of producer processes can share one strip
+// without each needing root and their own hold on the hardware.
+//
+// Pixel data is read straight from the socket into the LED buffer (through
+// getPixelData()), a message at a time. A frame goes out when the wire is
+// free and no client is part way through a message, so while one frame is on
+// the wire the next ones simply overwrite each other in the buffer and only
+// the latest is sent. Producers never wait for the strip.
+//
+// OPC channel 0 is the whole strip; channels 1 and 2 are the strip's PWM
+// channels in NEOPIXEL_DUAL_CHANNEL mode. Pixels past the end of the channel
+// and messages for other channels or commands are read and dropped.
+class OPCServer {
+public:
+    OPCServer(NeoPixel& strip);
+    ~OPCServer();
+
+    // Either or both. Port 0 picks a free port; see getTCPPort().
+    bool listenUnix(const char *path);
+    bool listenTCP(unsigned short port=OPC_DEFAULT_PORT);
+    unsigned short getTCPPort();
+
+    // Waits up to timeoutMS (-1 for ever) for clients, data or the wire
+    // and deals with whatever is ready. A signal just cuts the wait short.
+    // Returns false if the wait failed.
+    bool poll(int timeoutMS);
+
+    unsigned int numClients();
+    // Set pixel messages received for this strip; how many of them made it
+    // to the wire is in the strip's getStats()
+    unsigned long getMessages();
+
+private:
+    struct Client {
+        int fd;
+        uint8_t header[OPC_HEADER_BYTES];
+        unsigned int headerBytes;
+        // Left of the current message's payload, and how much of that
+        // still goes into the LED buffer at target
+        unsigned int payloadLeft;
+        unsigned int targetLeft;
+        uint8_t *target;
+        bool setPixels;
+        // When the message in progress started arriving
+        unsigned long started;
+    };
+
+    bool listenOn(int fd, const char *what);
+    void acceptClients(int listenFD);
+    bool readClient(Client& client);
+    void startMessage(Client& client);
+    void endMessage(Client& client);
+    int frameTimeout();
+
+    NeoPixel& strip;
+    Color_t *pixels;
+    unsigned int channelLEDs;
+
+    int unixFD;
+    int tcpFD;
+    std::string unixPath;
+    std::vector<Client> clients;
+    uint8_t discard[4096];
+
+    bool frameReady;
+    unsigned long messages;
+};
+
+#endif
@@ -0,0 +1,177 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "ws2812-rpi.h"
+#include "ws2812-rpi-opc.h"
+#include "ws2812-rpi-ring.h"
+
+// Open Pixel Control daemon: owns the strip and takes frames from any number
+// of producers over a UNIX socket and/or localhost TCP, and with --shm from a
+// shared memory frame ring as well. With --loopback it
+// drives the software DMA stand-in instead of the hardware, so it can be run
+// and tested anywhere without root.
+
+static volatile sig_atomic_t stopping = 0;
+
+static void onSignal(int sig){
+    stopping = 1;
+}
+
+static void usage(const char *name){
+    printf("Usage: %s [--leds N] [--unix PATH] [--port N] [--shm NAME] [--pcm | --spi | --loopback]\n"
+           "          [--dual] [--format GRB|RGB|GRBW|RGBW] [--brightness B] [--stats FILE]\n"
+           "          [--reattach]\n"
+           "Serves N LEDs (default 60) on PATH and/or localhost port N (default %d if\n"
+           "there is no --unix or --shm), and from the frame ring NAME (such as /ws2812).\n"
+           "OPC frames are RGB, so the white channel of GRBW and RGBW strips stays off.\n"
+           "--stats writes the strip's counters to FILE every second.\n"
+           "--reattach takes over an output a previous run left set up, and leaves it\n"
+           "set up on exit, so restarting the daemon doesn't glitch the strip.\n",
+           name, OPC_DEFAULT_PORT);
+}
+
+int main(int argc, char **argv){
+    unsigned int numLEDs = 60, flags = 0;
+    int port = -1;
+    const char *unixPath = 0, *statsPath = 0, *ringName = 0;
+    float brightness = DEFAULT_BRIGHTNESS;
+    struct sigaction sa;
+    SoftDMA *dma;
+    FrameRing *ring = 0;
+    int i;
+
+    for(i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--leds") == 0 && i + 1 < argc) {
+            numLEDs = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--unix") == 0 && i + 1 < argc) {
+            unixPath = argv[++i];
+        } else if(strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+            ringName = argv[++i];
+        } else if(strcmp(argv[i], "--pcm") == 0) {
+            flags |= NEOPIXEL_PCM;
+        } else if(strcmp(argv[i], "--spi") == 0) {
+            flags |= NEOPIXEL_SPI;
+        } else if(strcmp(argv[i], "--loopback") == 0) {
+            flags |= NEOPIXEL_LOOPBACK;
+        } else if(strcmp(argv[i], "--reattach") == 0) {
+            flags |= NEOPIXEL_REATTACH;
+        } else if(strcmp(argv[i], "--dual") == 0) {
+            flags |= NEOPIXEL_DUAL_CHANNEL;
+        } else if(strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if(strcmp(argv[i], "GRB") == 0) {
+                flags = (flags & ~NEOPIXEL_FORMAT_MASK) | NEOPIXEL_GRB;
+            } else if(strcmp(argv[i], "RGB") == 0) {
+                flags = (flags & ~NEOPIXEL_FORMAT_MASK) | NEOPIXEL_RGB;
+            } else if(strcmp(argv[i], "GRBW") == 0) {
+                flags = (flags & ~NEOPIXEL_FORMAT_MASK) | NEOPIXEL_GRBW;
+            } else if(strcmp(argv[i], "RGBW") == 0) {
+                flags = (flags & ~NEOPIXEL_FORMAT_MASK) | NEOPIXEL_RGBW;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--brightness") == 0 && i + 1 < argc) {
+            brightness = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            statsPath = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(numLEDs == 0 || port > 65535) {
+        usage(argv[0]);
+        return 1;
+    }
+    if(!unixPath && !ringName && port < 0) {
+        port = OPC_DEFAULT_PORT;
+    }
+
+    NeoPixel strip(numLEDs, flags);
+    strip.setBrightness(brightness);
+    if(statsPath) {
+        strip.setStatsFile(statsPath);
+    }
+    dma = strip.getSoftDMA();
+
+    OPCServer server(strip);
+    if((unixPath && !server.listenUnix(unixPath)) || (port >= 0 && !server.listenTCP(port))) {
+        return 1;
+    }
+    if(ringName && !(ring = FrameRing::create(ringName, strip.numPixels()))) {
+        return 1;
+    }
+    printf("Serving %d LEDs on %s", strip.numPixels(), strip.getTransportName());
+    if(unixPath) {
+        printf(", %s", unixPath);
+    }
+    if(ringName) {
+        printf(", frame ring %s", ringName);
+    }
+    if(port >= 0) {
+        printf(", localhost port %d", server.getTCPPort());
+    }
+    if(strip.reattached()) {
+        printf(", reattached");
+    }
+    printf("\n");
+
+    // No SA_RESTART, so a signal cuts the poll short
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // Ring producers don't wake anyone up, so with a ring the loop looks for
+    // a new frame every few milliseconds whenever the wire is free
+    while(!stopping) {
+        if(!server.poll(ring ? FRAME_RING_POLL_MS : 1000)) {
+            break;
+        }
+        if(ring && !strip.busy() && ring->consume(strip)) {
+            strip.submit();
+        }
+        // The stand-in records every frame; only the latest few matter here
+        if(dma && dma->numFrames() > 16) {
+            dma->clearFrames();
+        }
+    }
+
+    // Leave the strip dark, unless the next run is to take over the last
+    // frame as it is
+    delete ring;
+    if(!(flags & NEOPIXEL_REATTACH)) {
+        strip.clear();
+        strip.show();
+    }
+    return stopping ? 0 : 1;
+}
@@ -27,6 +27,194 @@
 using namespace boost::python;
 
 #include "ws2812-rpi.h"
+#include "ws2812-rpi-effects.h"
+#include "ws2812-rpi-ring.h"
+
+// The LED buffer as a writable (N, 3) uint8 buffer for memoryview and NumPy.
+// Each exported view holds the strip's Python object, and getPixelData()
+// for as long as it is open so show() picks up what is written to it.
+struct PixelBufferObject {
+    PyObject_HEAD
+    PyObject *owner;
+    NeoPixel *strip;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+};
+
+static PyTypeObject PixelBufferType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+static int pixelBufferGet(PyObject *self, Py_buffer *view, int flags){
+    PixelBufferObject *pb = (PixelBufferObject*)self;
+
+    view->buf = pb->strip->getPixelData();
+    view->obj = self;
+    Py_INCREF(self);
+    view->len = pb->shape[0] * pb->shape[1];
+    view->readonly = 0;
+    view->itemsize = 1;
+    view->format = (flags & PyBUF_FORMAT) ? (char*)"B" : NULL;
+    view->ndim = (flags & PyBUF_ND) ? 2 : 1;
+    view->shape = (flags & PyBUF_ND) ? pb->shape : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? pb->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static void pixelBufferRelease(PyObject *self, Py_buffer *view){
+    ((PixelBufferObject*)self)->strip->releasePixelData();
+}
+
+static void pixelBufferDealloc(PyObject *self){
+    Py_XDECREF(((PixelBufferObject*)self)->owner);
+    PyObject_Del(self);
+}
+
+static PyBufferProcs pixelBufferProcs;
+
+static object getBuffer(object self){
+    NeoPixel& strip = extract<NeoPixel&>(self);
+    PixelBufferObject *pb = PyObject_New(PixelBufferObject, &PixelBufferType);
+
+    if(pb == NULL) {
+        throw_error_already_set();
+    }
+    pb->owner = self.ptr();
+    Py_INCREF(pb->owner);
+    pb->strip = &strip;
+    pb->shape[0] = strip.numPixels();
+    pb->shape[1] = 3;
+    pb->strides[0] = 3;
+    pb->strides[1] = 1;
+
+    handle<> exporter((PyObject*)pb);
+    return object(handle<>(PyMemoryView_FromObject(exporter.get())));
+}
+
+// Anything with the buffer protocol (bytes, bytearray, memoryview, a NumPy
+// uint8 array...) holding whole RGB triples, copied in at pixel offset
+static unsigned char setPixels(NeoPixel& strip, object data, unsigned int offset=0){
+    Py_buffer view;
+    unsigned char ok;
+
+    if(PyObject_GetBuffer(data.ptr(), &view, PyBUF_C_CONTIGUOUS) != 0) {
+        throw_error_already_set();
+    }
+    if(view.len % 3 != 0) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "pixel data must be whole RGB triples");
+        throw_error_already_set();
+    }
+    ok = strip.setPixels(offset, (const Color_t*)view.buf, view.len / 3);
+    PyBuffer_Release(&view);
+    return ok;
+}
+
+BOOST_PYTHON_FUNCTION_OVERLOADS(setPixelsOverloads, setPixels, 2, 3)
+
+// The same for a frame ring producer: one copy into shared memory and no
+// system call at all
+static bool ringPublish(FrameRing& ring, object data){
+    Py_buffer view;
+    bool ok;
+
+    if(PyObject_GetBuffer(data.ptr(), &view, PyBUF_C_CONTIGUOUS) != 0) {
+        throw_error_already_set();
+    }
+    if(view.len % 3 != 0) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "pixel data must be whole RGB triples");
+        throw_error_already_set();
+    }
+    ok = ring.publish((const Color_t*)view.buf, view.len / 3);
+    PyBuffer_Release(&view);
+    return ok;
+}
+
+BOOST_PYTHON_FUNCTION_OVERLOADS(ringCreateOverloads, FrameRing::create, 2, 3)
+
+// A whole frame for a recording, numPixels() RGB triples
+static bool recorderAddFrame(AnimationRecorder& recorder, object data, unsigned long timeMS){
+    Py_buffer view;
+    bool ok;
+
+    if(PyObject_GetBuffer(data.ptr(), &view, PyBUF_C_CONTIGUOUS) != 0) {
+        throw_error_already_set();
+    }
+    if(view.len != recorder.numPixels() * 3) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "frame must be numPixels() RGB triples");
+        throw_error_already_set();
+    }
+    ok = recorder.addFrame((const Color_t*)view.buf, timeMS);
+    PyBuffer_Release(&view);
+    return ok;
+}
+
+BOOST_PYTHON_FUNCTION_OVERLOADS(recorderCreateOverloads, AnimationRecorder::create, 2, 3)
+
+// Drops the GIL for as long as it is in scope. Everything that waits for the
+// wire or sleeps between frames runs under one, so other Python threads keep
+// going meanwhile. Nothing inside may touch a Python object, nor the pixels
+// and dirty state another thread could be changing at the same time.
+class ReleaseGIL {
+public:
+    ReleaseGIL() : state(PyEval_SaveThread()) {}
+    ~ReleaseGIL(){ PyEval_RestoreThread(state); }
+
+private:
+    PyThreadState *state;
+};
+
+// The frame is encoded with the GIL held, so no other thread can be setting
+// pixels or writing through getBuffer() while they are read and marked clean;
+// only the wait for the previous frame to latch goes without it. submit() and
+// handleCompletion() never wait, so they keep it throughout.
+static void show(NeoPixel& strip){
+    if(strip.encodeFrame()) {
+        ReleaseGIL unlocked;
+        strip.sendFrame();
+    }
+}
+
+static void segmentShow(NeoPixelSegment& segment){ show(*segment.getStrip()); }
+static unsigned long schedulerNext(FrameScheduler& scheduler){ ReleaseGIL unlocked; return scheduler.next(); }
+
+static void colorWipe(NeoPixel& strip, Color_t c, uint8_t wait){ ReleaseGIL unlocked; strip.colorWipe(c, wait); }
+static void rainbow(NeoPixel& strip, uint8_t wait){ ReleaseGIL unlocked; strip.rainbow(wait); }
+static void rainbowCycle(NeoPixel& strip, uint8_t wait){ ReleaseGIL unlocked; strip.rainbowCycle(wait); }
+static void theaterChase(NeoPixel& strip, Color_t c, uint8_t wait){ ReleaseGIL unlocked; strip.theaterChase(c, wait); }
+static void theaterChaseRainbow(NeoPixel& strip, uint8_t wait){ ReleaseGIL unlocked; strip.theaterChaseRainbow(wait); }
+static void effectsDemo(NeoPixel& strip){ ReleaseGIL unlocked; strip.effectsDemo(); }
+
+static void gradient(NeoPixel& strip, std::vector<Color_t>& scheme, int repeat, int speedMS){
+    ReleaseGIL unlocked;
+    strip.gradient(scheme, repeat, speedMS);
+}
+
+static void bars(NeoPixel& strip, std::vector<Color_t>& scheme, int width, int speedMS){
+    ReleaseGIL unlocked;
+    strip.bars(scheme, width, speedMS);
+}
+
+static void playerPlay(AnimationPlayer& player, NeoPixel& strip, bool loop=false){
+    ReleaseGIL unlocked;
+    player.play(strip, loop);
+}
+
+BOOST_PYTHON_FUNCTION_OVERLOADS(playerPlayOverloads, playerPlay, 2, 3)
+
+// The histograms as lists, bucket b counting times under 2^b microseconds
+static list histList(const unsigned long *hist){
+    list buckets;
+    for(unsigned int b = 0; b < STATS_BUCKETS; b++) {
+        buckets.append(hist[b]);
+    }
+    return buckets;
+}
+
+static list encodeHist(const NeoPixelStats& stats){ return histList(stats.encodeHist); }
+static list waitHist(const NeoPixelStats& stats){ return histList(stats.waitHist); }
 
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(
     setPixelColor1, NeoPixel::setPixelColor, 4, 4
@@ -36,8 +224,50 @@ BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(
     setPixelColor2, NeoPixel::setPixelColor, 2, 2
 )
 
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(
+    setStatsFileOverloads, NeoPixel::setStatsFile, 1, 2
+)
+
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(
+    startRecordingOverloads, NeoPixel::startRecording, 1, 2
+)
+
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(
+    segmentSetPixelColor1, NeoPixelSegment::setPixelColor, 4, 4
+)
+
+BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(
+    segmentSetPixelColor2, NeoPixelSegment::setPixelColor, 2, 2
+)
+
 BOOST_PYTHON_MODULE(NeoPixel){
-    class_<Color_t>("Color")
+    pixelBufferProcs.bf_getbuffer = pixelBufferGet;
+    pixelBufferProcs.bf_releasebuffer = pixelBufferRelease;
+    PixelBufferType.tp_name = "NeoPixel.PixelBuffer";
+    PixelBufferType.tp_basicsize = sizeof(PixelBufferObject);
+    PixelBufferType.tp_dealloc = pixelBufferDealloc;
+    PixelBufferType.tp_as_buffer = &pixelBufferProcs;
+#if PY_MAJOR_VERSION < 3
+    PixelBufferType.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER;
+#else
+    PixelBufferType.tp_flags = Py_TPFLAGS_DEFAULT;
+#endif
+    if(PyType_Ready(&PixelBufferType) < 0) {
+        throw_error_already_set();
+    }
+
+    scope().attr("SOFT_DMA") = NEOPIXEL_SOFT_DMA;
+    scope().attr("DUAL_CHANNEL") = NEOPIXEL_DUAL_CHANNEL;
+    scope().attr("PCM") = NEOPIXEL_PCM;
+    scope().attr("SPI") = NEOPIXEL_SPI;
+    scope().attr("LOOPBACK") = NEOPIXEL_LOOPBACK;
+    scope().attr("REATTACH") = NEOPIXEL_REATTACH;
+    scope().attr("GRB") = NEOPIXEL_GRB;
+    scope().attr("RGB") = NEOPIXEL_RGB;
+    scope().attr("GRBW") = NEOPIXEL_GRBW;
+    scope().attr("RGBW") = NEOPIXEL_RGBW;
+
+    class_<Color_t>("Color", init<optional<unsigned char, unsigned char, unsigned char> >())
         .def_readwrite("r", &Color_t::r)
         .def_readwrite("g", &Color_t::g)
         .def_readwrite("b", &Color_t::b);
@@ -45,9 +275,123 @@ BOOST_PYTHON_MODULE(NeoPixel){
     class_<std::vector<Color_t> >("Color_t_vector")
         .def(vector_indexing_suite<std::vector<Color_t> >());
 
-    class_<NeoPixel>("NeoPixel", init<unsigned int>())
+    // Python code paces itself with start() and next()
+    class_<FrameScheduler>("FrameScheduler", init<optional<float, bool> >())
+        .def("start", &FrameScheduler::start)
+        .def("next", &schedulerNext)
+        .def("setDropLate", &FrameScheduler::setDropLate)
+        .def("getFPS", &FrameScheduler::getFPS)
+        .def("getFrames", &FrameScheduler::getFrames)
+        .def("getDroppedFrames", &FrameScheduler::getDroppedFrames)
+        .def("getLateFrames", &FrameScheduler::getLateFrames)
+        .def("getAchievedFPS", &FrameScheduler::getAchievedFPS)
+        .def("getJitterPercentile", &FrameScheduler::getJitterPercentile);
+
+    class_<NeoPixelStats>("NeoPixelStats", no_init)
+        .def_readonly("framesShown", &NeoPixelStats::framesShown)
+        .def_readonly("framesSkipped", &NeoPixelStats::framesSkipped)
+        .def_readonly("framesReplaced", &NeoPixelStats::framesReplaced)
+        .def_readonly("underruns", &NeoPixelStats::underruns)
+        .def_readonly("fifoErrors", &NeoPixelStats::fifoErrors)
+        .def_readonly("dmaErrors", &NeoPixelStats::dmaErrors)
+        .def_readonly("rangeErrors", &NeoPixelStats::rangeErrors)
+        .add_property("encodeHist", &encodeHist)
+        .def_readonly("encodeMaxUS", &NeoPixelStats::encodeMaxUS)
+        .def_readonly("encodeLastUS", &NeoPixelStats::encodeLastUS)
+        .def_readonly("encodeSumUS", &NeoPixelStats::encodeSumUS)
+        .add_property("waitHist", &waitHist)
+        .def_readonly("waitMaxUS", &NeoPixelStats::waitMaxUS)
+        .def_readonly("waitLastUS", &NeoPixelStats::waitLastUS)
+        .def_readonly("waitSumUS", &NeoPixelStats::waitSumUS);
+
+    // create() and attach() return None if the ring can't be set up
+    class_<FrameRing, boost::noncopyable>("FrameRing", no_init)
+        .def("create", &FrameRing::create, ringCreateOverloads()[return_value_policy<manage_new_object>()])
+        .staticmethod("create")
+        .def("attach", &FrameRing::attach, return_value_policy<manage_new_object>())
+        .staticmethod("attach")
+        .def("numPixels", &FrameRing::numPixels)
+        .def("publish", &ringPublish)
+        .def("consume", &FrameRing::consume)
+        .def("getSkipped", &FrameRing::getSkipped);
+
+    class_<AnimationRecorder, boost::noncopyable>("AnimationRecorder", no_init)
+        .def("create", &AnimationRecorder::create,
+             recorderCreateOverloads()[return_value_policy<manage_new_object>()])
+        .staticmethod("create")
+        .def("addFrame", &recorderAddFrame)
+        .def("close", &AnimationRecorder::close)
+        .def("numPixels", &AnimationRecorder::numPixels)
+        .def("numFrames", &AnimationRecorder::numFrames)
+        .def("size", &AnimationRecorder::size);
+
+    class_<AnimationPlayer, boost::noncopyable>("AnimationPlayer", no_init)
+        .def("open", &AnimationPlayer::open, return_value_policy<manage_new_object>())
+        .staticmethod("open")
+        .def("numPixels", &AnimationPlayer::numPixels)
+        .def("numFrames", &AnimationPlayer::numFrames)
+        .def("durationMS", &AnimationPlayer::durationMS)
+        .def("next", &AnimationPlayer::next)
+        .def("frame", &AnimationPlayer::frame)
+        .def("frameTime", &AnimationPlayer::frameTime)
+        .def("seek", &AnimationPlayer::seek)
+        .def("seekTime", &AnimationPlayer::seekTime)
+        .def("play", &playerPlay, playerPlayOverloads());
+
+    class_<NeoPixelSegment>("NeoPixelSegment",
+                            init<NeoPixel*, unsigned int, unsigned int>()[with_custodian_and_ward<1, 2>()])
+        .def("setPixelColor",
+             static_cast<unsigned char(NeoPixelSegment::*)(unsigned int, unsigned char, unsigned char, unsigned char)>(&NeoPixelSegment::setPixelColor),
+             segmentSetPixelColor1())
+        .def("setPixelColor",
+             static_cast<unsigned char(NeoPixelSegment::*)(unsigned int, Color_t)>(&NeoPixelSegment::setPixelColor),
+             segmentSetPixelColor2())
+        .def("getPixelColor", &NeoPixelSegment::getPixelColor)
+        .def("fill", &NeoPixelSegment::fill)
+        .def("setPixelWhite", &NeoPixelSegment::setPixelWhite)
+        .def("numPixels", &NeoPixelSegment::numPixels)
+        .def("clear", &NeoPixelSegment::clear)
+        .def("show", &segmentShow);
+
+    // Owned by the strip, which each view keeps alive
+    class_<NeoPixelView, bases<NeoPixelSegment>, boost::noncopyable>("NeoPixelView", no_init)
+        .def("commit", &NeoPixelView::commit)
+        .def("committed", &NeoPixelView::committed);
+
+    // Effects and the engine hold plain pointers, so each keeps what was
+    // added to it alive
+    class_<Effect, boost::noncopyable>("Effect", no_init)
+        .def("duration", &Effect::duration)
+        .def("render", &Effect::render);
+
+    class_<ColorWipeEffect, bases<Effect> >("ColorWipeEffect", init<Color_t, unsigned int, unsigned int>());
+    class_<RainbowEffect, bases<Effect> >("RainbowEffect", init<unsigned int, optional<unsigned int, bool> >());
+    class_<TheaterChaseEffect, bases<Effect> >("TheaterChaseEffect", init<Color_t, unsigned int, unsigned int, optional<bool> >());
+    class_<EffectSequence, bases<Effect> >("EffectSequence")
+        .def("add", &EffectSequence::add, with_custodian_and_ward<1, 2>());
+
+    class_<EffectEngine>("EffectEngine")
+        .def("add",
+             static_cast<unsigned int(EffectEngine::*)(Effect*, NeoPixelSegment)>(&EffectEngine::add),
+             with_custodian_and_ward<1, 2>())
+        .def("add",
+             static_cast<unsigned int(EffectEngine::*)(Effect*, NeoPixelSegment, unsigned long)>(&EffectEngine::add),
+             with_custodian_and_ward<1, 2>())
+        .def("stop", &EffectEngine::stop)
+        .def("clear", &EffectEngine::clear)
+        .def("running", &EffectEngine::running)
+        .def("numRunning", &EffectEngine::numRunning)
+        .def("step", static_cast<unsigned int(EffectEngine::*)()>(&EffectEngine::step))
+        .def("step", static_cast<unsigned int(EffectEngine::*)(unsigned long)>(&EffectEngine::step))
+        .def("millis", &EffectEngine::millis).staticmethod("millis");
+
+    class_<NeoPixel>("NeoPixel", init<unsigned int, optional<unsigned int> >())
         .def("begin", &NeoPixel::begin)
-        .def("show", &NeoPixel::show)
+        .def("show", &show)
+        .def("submit", &NeoPixel::submit)
+        .def("getCompletionFD", &NeoPixel::getCompletionFD)
+        .def("handleCompletion", &NeoPixel::handleCompletion)
+        .def("busy", &NeoPixel::busy)
         .def("setPixelColor",
              static_cast<unsigned char(NeoPixel::*)(unsigned int, unsigned char, unsigned char, unsigned char)>(&NeoPixel::setPixelColor),
              setPixelColor1())
@@ -55,18 +399,50 @@ BOOST_PYTHON_MODULE(NeoPixel){
              static_cast<unsigned char(NeoPixel::*)(unsigned int, Color_t)>(&NeoPixel::setPixelColor), 
              setPixelColor2())
         .def("setBrightness", &NeoPixel::setBrightness)
+        .def("setGamma", &NeoPixel::setGamma)
+        .def("setWhiteBalance", &NeoPixel::setWhiteBalance)
         .def("getPixels", &NeoPixel::getPixels)
+        .def("getBuffer", &getBuffer)
+        .def("setPixels", &setPixels, setPixelsOverloads())
         .def("getBrightness", &NeoPixel::getBrightness)
+        .def("getGamma", &NeoPixel::getGamma)
+        .def("getWhiteBalance", &NeoPixel::getWhiteBalance)
         .def("getPixelColor", &NeoPixel::getPixelColor)
+        .def("setPixelWhite", &NeoPixel::setPixelWhite)
+        .def("getPixelWhite", &NeoPixel::getPixelWhite)
+        .def("getColorChannels", &NeoPixel::getColorChannels)
+        .def("fill", &NeoPixel::fill)
+        .def("copyWithin", &NeoPixel::copyWithin)
+        .def("getRangeErrors", &NeoPixel::getRangeErrors)
+        .def("getStats", &NeoPixel::getStats)
+        .def("writeStats", &NeoPixel::writeStats)
+        .def("setStatsFile", &NeoPixel::setStatsFile, setStatsFileOverloads())
+        .def("startRecording", &NeoPixel::startRecording, startRecordingOverloads())
+        .def("stopRecording", &NeoPixel::stopRecording)
         .def("numPixels", &NeoPixel::numPixels)
         .def("clear", &NeoPixel::clear)
-        .def("colorWipe", &NeoPixel::colorWipe)
-        .def("rainbow", &NeoPixel::rainbow)
-        .def("rainbowCycle", &NeoPixel::rainbowCycle)
-        .def("theaterChase", &NeoPixel::theaterChase)
-        .def("theaterChaseRainbow", &NeoPixel::theaterChaseRainbow)
-        .def("gradient", &NeoPixel::gradient)
-        .def("bars", &NeoPixel::bars)
-        .def("effectsDemo", &NeoPixel::effectsDemo)
+        .def("getEncodedPercent", &NeoPixel::getEncodedPercent)
+        .def("setEncodeThreads", &NeoPixel::setEncodeThreads)
+        .def("getEncodeThreads", &NeoPixel::getEncodeThreads)
+        .def("setDirectEncode", &NeoPixel::setDirectEncode)
+        .def("getNumChannels", &NeoPixel::getNumChannels)
+        .def("getTransportName", &NeoPixel::getTransportName)
+        .def("reattached", &NeoPixel::reattached)
+        // The segment keeps the strip alive
+        .def("channel", &NeoPixel::channel, with_custodian_and_ward_postcall<0, 1>())
+        .def("createView", &NeoPixel::createView, return_internal_reference<>())
+        // An owner going away has to release its view, or the rest wait on it
+        // forever; the view mustn't be used after
+        .def("releaseView", &NeoPixel::releaseView)
+        .def("numViews", &NeoPixel::numViews)
+        .def("colorWipe", &colorWipe)
+        .def("rainbow", &rainbow)
+        .def("rainbowCycle", &rainbowCycle)
+        .def("theaterChase", &theaterChase)
+        .def("theaterChaseRainbow", &theaterChaseRainbow)
+        .def("gradient", &gradient)
+        .def("bars", &bars)
+        .def("effectsDemo", &effectsDemo)
+        .def("getScheduler", &NeoPixel::getScheduler, return_internal_reference<>())
 	;
 }
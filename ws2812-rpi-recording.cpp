@@ -0,0 +1,413 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "ws2812-rpi-recording.h"
+#include "ws2812-rpi.h"
+
+// PUBLIC
+
+AnimationRecorder* AnimationRecorder::create(const char *path, unsigned int numPixels,
+                                             unsigned int keyInterval){
+    FILE *file;
+
+    if(numPixels == 0) {
+        printf("A recording needs pixels\n");
+        return 0;
+    }
+    file = fopen(path, "wb");
+    if(!file) {
+        printf("Unable to create recording %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    return new AnimationRecorder(file, numPixels, keyInterval ? keyInterval : 1);
+}
+
+AnimationRecorder::~AnimationRecorder(){
+    close();
+}
+
+bool AnimationRecorder::addFrame(const Color_t *pixels, unsigned long timeMS){
+    FrameRecord record;
+    KeyFrameEntry entry;
+    bool key = header.numFrames % keyInterval == 0;
+
+    if(!file) {
+        return false;
+    }
+
+    encode(pixels, key);
+    record.timeMS = timeMS;
+    record.flags = key ? RECORDING_KEY_FRAME : 0;
+    record.length = ops.size();
+    if(key) {
+        entry.frame = header.numFrames;
+        entry.timeMS = timeMS;
+        entry.offset = written;
+        index.push_back(entry);
+    }
+    if(fwrite(&record, sizeof(record), 1, file) != 1 ||
+       (ops.size() && fwrite(ops.data(), ops.size(), 1, file) != 1)) {
+        printf("Unable to write to recording: %s\n", strerror(errno));
+        fclose(file);
+        file = 0;
+        return false;
+    }
+    written += sizeof(record) + ops.size();
+
+    memcpy(previous.data(), pixels, previous.size() * sizeof(Color_t));
+    header.numFrames++;
+    header.durationMS = timeMS;
+    return true;
+}
+
+bool AnimationRecorder::close(){
+    bool ok;
+
+    if(!file) {
+        return false;
+    }
+    header.numKeyFrames = index.size();
+    header.indexOffset = written;
+    ok = (index.empty() || fwrite(index.data(), index.size() * sizeof(KeyFrameEntry), 1, file) == 1) &&
+        fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    file = 0;
+    if(!ok) {
+        printf("Unable to finish recording: %s\n", strerror(errno));
+    }
+    return ok;
+}
+
+unsigned int AnimationRecorder::numPixels(){ return header.numPixels; }
+
+unsigned int AnimationRecorder::numFrames(){ return header.numFrames; }
+
+unsigned long AnimationRecorder::size(){ return written; }
+
+AnimationPlayer* AnimationPlayer::open(const char *path){
+    const RecordingHeader *header;
+    struct stat st;
+    uint8_t *data;
+    int fd;
+
+    fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        printf("Unable to open recording %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(RecordingHeader)) {
+        printf("%s is too short to be a recording\n", path);
+        ::close(fd);
+        return 0;
+    }
+    data = (uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) {
+        printf("Unable to map recording %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    header = (const RecordingHeader *)data;
+    if(header->magic != RECORDING_MAGIC || header->version != RECORDING_VERSION ||
+       header->numPixels == 0 || header->numKeyFrames == 0 ||
+       header->indexOffset < sizeof(RecordingHeader) ||
+       header->indexOffset + header->numKeyFrames * sizeof(KeyFrameEntry) > (uint64_t)st.st_size) {
+        printf("%s isn't a finished recording\n", path);
+        munmap(data, st.st_size);
+        return 0;
+    }
+
+    // Frames are read front to back, and each only once
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    return new AnimationPlayer(data, st.st_size);
+}
+
+AnimationPlayer::~AnimationPlayer(){
+    munmap((void *)data, size);
+}
+
+unsigned int AnimationPlayer::numPixels(){ return header->numPixels; }
+
+unsigned int AnimationPlayer::numFrames(){ return header->numFrames; }
+
+unsigned long AnimationPlayer::durationMS(){ return header->durationMS; }
+
+bool AnimationPlayer::next(NeoPixel& strip){
+    FrameRecord r;
+
+    if(!record(r) || !decode(strip, r, data + offset + sizeof(FrameRecord))) {
+        return false;
+    }
+    offset += sizeof(FrameRecord) + r.length;
+    lastTime = r.timeMS;
+    nextFrame++;
+    return true;
+}
+
+unsigned int AnimationPlayer::frame(){ return nextFrame ? nextFrame - 1 : 0; }
+
+unsigned long AnimationPlayer::frameTime(){ return lastTime; }
+
+bool AnimationPlayer::seek(NeoPixel& strip, unsigned int n){
+    unsigned int lo = 0, hi = header->numKeyFrames, mid;
+
+    if(n >= header->numFrames) {
+        return false;
+    }
+    // The last key frame at or before n
+    while(hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if(keyFrame(mid).frame <= n) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    rewind(lo);
+    while(nextFrame <= n) {
+        if(!next(strip)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AnimationPlayer::seekTime(NeoPixel& strip, unsigned long timeMS){
+    unsigned int lo = 0, hi = header->numKeyFrames, mid;
+    FrameRecord r;
+
+    while(hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if(keyFrame(mid).timeMS <= timeMS) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    rewind(lo);
+    if(!next(strip)) {
+        return false;
+    }
+    while(record(r) && r.timeMS <= timeMS) {
+        if(!next(strip)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AnimationPlayer::play(NeoPixel& strip, bool loop){
+    FrameRecord r;
+    struct timespec start, due;
+    unsigned long long ns;
+    unsigned long first;
+
+    if(!record(r)) {
+        if(!loop) {
+            return;
+        }
+        rewind(0);
+        record(r);
+    }
+
+    // Frames are due at their recorded times from now, whatever show() takes
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    first = r.timeMS;
+    for(;;) {
+        if(!record(r)) {
+            if(!loop) {
+                return;
+            }
+            // Straight round to the first frame again
+            rewind(0);
+            record(r);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            first = r.timeMS;
+        }
+
+        ns = (unsigned long long)(r.timeMS - first) * 1000000ULL + start.tv_nsec;
+        due.tv_sec = start.tv_sec + ns / 1000000000ULL;
+        due.tv_nsec = ns % 1000000000ULL;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR);
+
+        if(!next(strip)) {
+            return;
+        }
+        strip.show();
+    }
+}
+
+// PRIVATE
+
+AnimationRecorder::AnimationRecorder(FILE *file, unsigned int numPixels, unsigned int keyInterval)
+    : file(file), keyInterval(keyInterval), previous(numPixels), written(sizeof(RecordingHeader))
+{
+    // The header is written for real by close(); until then the index
+    // offset stays 0 and players won't touch the file
+    memset(&header, 0, sizeof(header));
+    header.magic = RECORDING_MAGIC;
+    header.version = RECORDING_VERSION;
+    header.numPixels = numPixels;
+    fwrite(&header, sizeof(header), 1, file);
+}
+
+// Greedy: runs of unchanged pixels are skipped, runs of one colour filled
+// and anything else copied, each op covering at most RECORDING_MAX_RUN
+void AnimationRecorder::encode(const Color_t *pixels, bool key){
+    const Color_t black;
+    const Color_t *was = key ? 0 : previous.data();
+    unsigned int n = previous.size(), i = 0, run;
+    // Where the latest run of skips starts, and whether it is still going
+    size_t skips = 0;
+    bool skipping = false;
+
+#define UNCHANGED(j) (pixels[j] == (was ? was[j] : black))
+
+    ops.clear();
+    while(i < n) {
+        run = 1;
+        if(UNCHANGED(i)) {
+            while(i + run < n && run < RECORDING_MAX_RUN && UNCHANGED(i + run)) {
+                run++;
+            }
+            if(!skipping) {
+                skips = ops.size();
+                skipping = true;
+            }
+            ops.push_back(RECORDING_OP_SKIP | (run - 1));
+        } else {
+            skipping = false;
+            while(i + run < n && run < RECORDING_MAX_RUN && pixels[i + run] == pixels[i]) {
+                run++;
+            }
+            if(run >= 2) {
+                ops.push_back(RECORDING_OP_FILL | (run - 1));
+                ops.insert(ops.end(), (const uint8_t *)&pixels[i], (const uint8_t *)&pixels[i + 1]);
+            } else {
+                // Up to the next unchanged pixel or run of one colour
+                while(i + run < n && run < RECORDING_MAX_RUN && !UNCHANGED(i + run) &&
+                      !(i + run + 1 < n && pixels[i + run] == pixels[i + run + 1])) {
+                    run++;
+                }
+                ops.push_back(RECORDING_OP_COPY | (run - 1));
+                ops.insert(ops.end(), (const uint8_t *)&pixels[i], (const uint8_t *)&pixels[i + run]);
+            }
+        }
+        i += run;
+    }
+
+#undef UNCHANGED
+
+    // Whatever is left of a delta frame at the end is unchanged anyway
+    if(!key && skipping) {
+        ops.resize(skips);
+    }
+}
+
+AnimationPlayer::AnimationPlayer(const uint8_t *data, size_t size)
+    : data(data), size(size), header((const RecordingHeader *)data),
+      index(data + ((const RecordingHeader *)data)->indexOffset),
+      nextFrame(0), offset(sizeof(RecordingHeader)), lastTime(0)
+{
+}
+
+// The next frame's record, if it is there and whole. Records follow each
+// other's ops, so they and the index after them can be at any offset in the
+// file; both are copied out rather than read in place, which on ARM can fault
+// on the index's 64 bit offsets.
+bool AnimationPlayer::record(FrameRecord& r){
+    if(nextFrame >= header->numFrames || offset + sizeof(FrameRecord) > header->indexOffset) {
+        return false;
+    }
+    memcpy(&r, data + offset, sizeof(r));
+    return offset + sizeof(FrameRecord) + r.length <= header->indexOffset;
+}
+
+KeyFrameEntry AnimationPlayer::keyFrame(unsigned int i){
+    KeyFrameEntry entry;
+
+    memcpy(&entry, index + i * sizeof(KeyFrameEntry), sizeof(entry));
+    return entry;
+}
+
+bool AnimationPlayer::decode(NeoPixel& strip, const FrameRecord& r, const uint8_t *op){
+    const uint8_t *end = op + r.length;
+    unsigned int limit = std::min(header->numPixels, strip.numPixels());
+    unsigned int pos = 0, count, n;
+    bool key = r.flags & RECORDING_KEY_FRAME;
+
+    // A key frame is drawn from black, so anything it doesn't cover is black
+    if(key) {
+        strip.fill(0, limit, Color_t());
+    }
+
+    while(op < end) {
+        count = (*op & ~RECORDING_OP_MASK) + 1;
+        n = pos < limit ? std::min(count, limit - pos) : 0;
+
+        switch(*op++ & RECORDING_OP_MASK) {
+        case RECORDING_OP_SKIP:
+            break;
+        case RECORDING_OP_FILL:
+            if(end - op < 3) {
+                return false;
+            }
+            if(n) {
+                strip.fill(pos, n, *(const Color_t *)op);
+            }
+            op += 3;
+            break;
+        case RECORDING_OP_COPY:
+            if((unsigned int)(end - op) < count * 3) {
+                return false;
+            }
+            if(n) {
+                strip.setPixels(pos, (const Color_t *)op, n);
+            }
+            op += count * 3;
+            break;
+        default:
+            return false;
+        }
+        pos += count;
+    }
+    return true;
+}
+
+void AnimationPlayer::rewind(unsigned int key){
+    KeyFrameEntry entry = keyFrame(key);
+
+    nextFrame = entry.frame;
+    offset = entry.offset;
+}
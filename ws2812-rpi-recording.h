@@ -0,0 +1,164 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#ifndef WS2812_RPI_RECORDING_H
+#define WS2812_RPI_RECORDING_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <vector>
+#include "ws2812-rpi-defines.h"
+
+class NeoPixel;
+
+// Recorded animation files. After the header come the frames, each a
+// FrameRecord and its ops, then the key frame index. Everything is little
+// endian, as it is on the Pi.
+#define RECORDING_MAGIC         0x4e415357  // "WSAN"
+#define RECORDING_VERSION       1
+#define RECORDING_KEY_INTERVAL  100
+
+// A frame is a list of ops against the frame before it, or against black for
+// a key frame. Each op is one byte, the op in the top two bits and the pixel
+// count less one in the rest: skip n unchanged pixels, fill n pixels with the
+// one colour that follows, or copy the n colours that follow.
+#define RECORDING_OP_SKIP       0x00
+#define RECORDING_OP_FILL       0x40
+#define RECORDING_OP_COPY       0x80
+#define RECORDING_OP_MASK       0xc0
+#define RECORDING_MAX_RUN       64
+
+#define RECORDING_KEY_FRAME     1
+
+struct RecordingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numPixels;
+    uint32_t numFrames;
+    uint32_t numKeyFrames;
+    uint32_t durationMS;
+    // 0 until the recording is closed
+    uint64_t indexOffset;
+};
+
+struct FrameRecord {
+    uint32_t timeMS;
+    uint32_t flags;
+    // Bytes of ops that follow
+    uint32_t length;
+};
+
+struct KeyFrameEntry {
+    uint32_t frame;
+    uint32_t timeMS;
+    uint64_t offset;
+};
+
+// Writes frames to a recording, each delta and run length coded against the
+// one before, with a key frame every keyInterval frames to seek to. In a key
+// frame a skip means black. NeoPixel's startRecording() feeds one with every
+// frame shown; it can also be fed directly to render a show offline, faster
+// than real time.
+class AnimationRecorder {
+public:
+    static AnimationRecorder* create(const char *path, unsigned int numPixels,
+                                     unsigned int keyInterval=RECORDING_KEY_INTERVAL);
+    // Closes the recording if that hasn't been done
+    ~AnimationRecorder();
+
+    // numPixels() pixels, shown timeMS after the start
+    bool addFrame(const Color_t *pixels, unsigned long timeMS);
+    // Writes the index. The file can't be played until this has been done.
+    bool close();
+
+    unsigned int numPixels();
+    unsigned int numFrames();
+    // Bytes written so far
+    unsigned long size();
+
+private:
+    AnimationRecorder(FILE *file, unsigned int numPixels, unsigned int keyInterval);
+    void encode(const Color_t *pixels, bool key);
+
+    FILE *file;
+    RecordingHeader header;
+    unsigned int keyInterval;
+    std::vector<Color_t> previous;
+    std::vector<uint8_t> ops;
+    std::vector<KeyFrameEntry> index;
+    unsigned long written;
+};
+
+// Plays a recording back from a read only mapping of the file, so memory use
+// is the same however long it is. Each frame's ops are applied straight to
+// the strip's LED buffer: skips cost nothing, fills and copies go through
+// fill() and setPixels(), so only what changed is re-encoded at show().
+//
+// The ops are relative to the frame before, so the player has to be the only
+// thing drawing on the strip between seek() and the last next().
+class AnimationPlayer {
+public:
+    static AnimationPlayer* open(const char *path);
+    ~AnimationPlayer();
+
+    unsigned int numPixels();
+    unsigned int numFrames();
+    unsigned long durationMS();
+
+    // Decodes the next frame into the strip; false once past the last
+    bool next(NeoPixel& strip);
+    // The frame next() last decoded, and its time
+    unsigned int frame();
+    unsigned long frameTime();
+
+    // Decodes frame n into the strip, starting from the key frame before it
+    bool seek(NeoPixel& strip, unsigned int n);
+    // Seeks to the frame showing at timeMS
+    bool seekTime(NeoPixel& strip, unsigned long timeMS);
+
+    // Shows the frames from the next one on, each at its time, and returns
+    // at the end or, with loop, starts again from the beginning
+    void play(NeoPixel& strip, bool loop=false);
+
+private:
+    AnimationPlayer(const uint8_t *data, size_t size);
+    bool record(FrameRecord& record);
+    KeyFrameEntry keyFrame(unsigned int i);
+    bool decode(NeoPixel& strip, const FrameRecord& record, const uint8_t *ops);
+    void rewind(unsigned int key);
+
+    const uint8_t *data;
+    size_t size;
+    const RecordingHeader *header;
+    // KeyFrameEntry records, unaligned; see keyFrame()
+    const uint8_t *index;
+
+    // Next frame to decode, and where it is
+    unsigned int nextFrame;
+    size_t offset;
+    unsigned long lastTime;
+};
+
+#endif
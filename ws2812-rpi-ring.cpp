@@ -0,0 +1,244 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "ws2812-rpi-ring.h"
+#include "ws2812-rpi.h"
+
+// PUBLIC
+
+FrameRing* FrameRing::create(const char *name, unsigned int numPixels, unsigned int numSlots){
+    FrameRingHeader *header;
+    uint32_t slotBytes;
+    size_t size;
+    uint8_t *base;
+    int fd;
+
+    if(numPixels == 0 || numSlots < 2) {
+        printf("A frame ring needs pixels and at least two slots\n");
+        return 0;
+    }
+    size = sizeFor(numPixels, numSlots, slotBytes);
+
+    // Start afresh; producers still attached to an old ring keep that one
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if(fd < 0) {
+        printf("Unable to create frame ring %s: %s\n", name, strerror(errno));
+        return 0;
+    }
+    // Whatever the umask, producers shouldn't need to be root
+    fchmod(fd, 0666);
+    if(ftruncate(fd, size) < 0) {
+        printf("Unable to size frame ring %s: %s\n", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return 0;
+    }
+    base = (uint8_t *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) {
+        printf("Unable to map frame ring %s: %s\n", name, strerror(errno));
+        shm_unlink(name);
+        return 0;
+    }
+
+    // The new memory is all zeros, which is an empty ring. The magic goes
+    // in last so a producer never attaches to a half made header.
+    header = (FrameRingHeader *)base;
+    header->version = FRAME_RING_VERSION;
+    header->numPixels = numPixels;
+    header->numSlots = numSlots;
+    header->slotBytes = slotBytes;
+    __atomic_store_n(&header->magic, FRAME_RING_MAGIC, __ATOMIC_RELEASE);
+
+    return new FrameRing(base, size, name, true);
+}
+
+FrameRing* FrameRing::attach(const char *name){
+    FrameRingHeader *header;
+    uint32_t slotBytes;
+    struct stat st;
+    uint8_t *base;
+    int fd;
+
+    fd = shm_open(name, O_RDWR, 0);
+    if(fd < 0) {
+        printf("Unable to open frame ring %s: %s\n", name, strerror(errno));
+        return 0;
+    }
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(FrameRingHeader)) {
+        printf("Frame ring %s isn't ready\n", name);
+        close(fd);
+        return 0;
+    }
+    base = (uint8_t *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) {
+        printf("Unable to map frame ring %s: %s\n", name, strerror(errno));
+        return 0;
+    }
+
+    header = (FrameRingHeader *)base;
+    if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != FRAME_RING_MAGIC ||
+       header->version != FRAME_RING_VERSION || header->numPixels == 0 || header->numSlots < 2 ||
+       sizeFor(header->numPixels, header->numSlots, slotBytes) != (size_t)st.st_size ||
+       header->slotBytes != slotBytes) {
+        printf("%s isn't a frame ring this library understands\n", name);
+        munmap(base, st.st_size);
+        return 0;
+    }
+    return new FrameRing(base, st.st_size, name, false);
+}
+
+FrameRing::~FrameRing(){
+    munmap(base, size);
+    if(owner) {
+        shm_unlink(name.c_str());
+    }
+}
+
+unsigned int FrameRing::numPixels(){ return ringPixels; }
+
+Color_t* FrameRing::beginFrame(){
+    FrameRingSlot *s;
+    uint32_t frame, seq;
+    unsigned int tries;
+
+    if(writing) {
+        return writing->pixels;
+    }
+
+    // A slot is free unless a producer is part way through it (odd), or it
+    // already holds a later frame than the one being claimed
+    for(tries = 0; tries < numSlots; tries++) {
+        frame = __atomic_fetch_add(&header->next, 1, __ATOMIC_RELAXED);
+        s = slot(frame);
+        seq = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+        if((seq & 1) == 0 && (int32_t)(seq - (2 * frame + 1)) < 0 &&
+           __atomic_compare_exchange_n(&s->seq, &seq, 2 * frame + 1, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            writing = s;
+            writingFrame = frame;
+            return s->pixels;
+        }
+    }
+    return 0;
+}
+
+void FrameRing::commitFrame(){
+    uint32_t latest;
+
+    if(!writing) {
+        return;
+    }
+    __atomic_store_n(&writing->seq, 2 * writingFrame + 2, __ATOMIC_RELEASE);
+
+    // Newest wins: only move latest forward
+    latest = __atomic_load_n(&header->latest, __ATOMIC_RELAXED);
+    while((int32_t)(writingFrame - latest) > 0 &&
+          !__atomic_compare_exchange_n(&header->latest, &latest, writingFrame, true,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    writing = 0;
+}
+
+bool FrameRing::publish(const Color_t *pixels, unsigned int count){
+    Color_t *frame = beginFrame();
+
+    if(!frame) {
+        return false;
+    }
+    count = std::min(count, ringPixels);
+    memcpy(frame, pixels, count * sizeof(Color_t));
+    std::fill(frame + count, frame + ringPixels, Color_t(0, 0, 0));
+    commitFrame();
+    return true;
+}
+
+// A seqlock read: the slot's sequence must be the same complete frame before
+// and after the copy. The copy goes to scratch first, so a torn one never
+// reaches the strip.
+bool FrameRing::consume(NeoPixel& strip){
+    uint32_t frame = __atomic_load_n(&header->latest, __ATOMIC_ACQUIRE);
+    FrameRingSlot *s = slot(frame);
+    unsigned int count = std::min(ringPixels, strip.numPixels());
+    uint32_t seq;
+
+    if(consumed && frame == lastConsumed) {
+        return false;
+    }
+    seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    if(seq != 2 * frame + 2) {
+        // Nothing published yet, or the slot is already being rewritten
+        return false;
+    }
+
+    scratch.resize(count);
+    memcpy(scratch.data(), s->pixels, count * sizeof(Color_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq) {
+        return false;
+    }
+    strip.setPixels(0, scratch.data(), count);
+
+    if(consumed) {
+        skipped += frame - lastConsumed - 1;
+    }
+    consumed = true;
+    lastConsumed = frame;
+    return true;
+}
+
+unsigned long FrameRing::getSkipped(){ return skipped; }
+
+// PRIVATE
+
+FrameRing::FrameRing(uint8_t *base, size_t size, const char *name, bool owner)
+    : base(base), size(size), header((FrameRingHeader *)base), name(name), owner(owner),
+      writing(0), writingFrame(0), consumed(false), lastConsumed(0), skipped(0)
+{
+    ringPixels = header->numPixels;
+    numSlots = header->numSlots;
+    slotBytes = header->slotBytes;
+}
+
+size_t FrameRing::sizeFor(unsigned int numPixels, unsigned int numSlots, uint32_t& slotBytes){
+    slotBytes = offsetof(FrameRingSlot, pixels) + numPixels * sizeof(Color_t);
+    slotBytes = (slotBytes + FRAME_RING_ALIGN - 1) / FRAME_RING_ALIGN * FRAME_RING_ALIGN;
+    return sizeof(FrameRingHeader) + (size_t)numSlots * slotBytes;
+}
+
+FrameRingSlot* FrameRing::slot(uint32_t frame){
+    return (FrameRingSlot *)(base + sizeof(FrameRingHeader) + (frame % numSlots) * slotBytes);
+}
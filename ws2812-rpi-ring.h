@@ -0,0 +1,134 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#ifndef WS2812_RPI_RING_H
+#define WS2812_RPI_RING_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include "ws2812-rpi-defines.h"
+
+class NeoPixel;
+
+#define FRAME_RING_MAGIC    0x57533238
+#define FRAME_RING_VERSION  1
+#define FRAME_RING_SLOTS    4
+// Everything the producers and the owner both write gets a cache line of
+// its own
+#define FRAME_RING_ALIGN    64
+// How often an owner with nothing else to wake it should look for a frame
+#define FRAME_RING_POLL_MS  2
+
+// The shared memory, as laid out in /dev/shm. The counters are only ever
+// touched with atomics. Frame n goes in slot n % numSlots, whose sequence is
+// 2n + 1 while a producer is writing it and 2n + 2 once it is complete.
+struct FrameRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numPixels;
+    uint32_t numSlots;
+    uint32_t slotBytes;
+    uint8_t pad0[FRAME_RING_ALIGN - 5 * 4];
+    // Next frame number to hand out
+    uint32_t next;
+    uint8_t pad1[FRAME_RING_ALIGN - 4];
+    // Newest complete frame
+    uint32_t latest;
+    uint8_t pad2[FRAME_RING_ALIGN - 4];
+};
+
+struct FrameRingSlot {
+    uint32_t seq;
+    uint8_t pad[FRAME_RING_ALIGN - 4];
+    // numPixels of them
+    Color_t pixels[1];
+};
+
+// A ring of frames in shared memory, for producers in other processes that
+// run too fast for a socket. Once attached, a producer publishes a frame
+// without a single system call or lock: it claims a slot, fills it and marks
+// it complete. The process owning the strip takes the newest complete frame
+// whenever it is ready for one, so frames published faster than the strip
+// can show them are simply skipped.
+//
+// A producer that stalls part way through a frame holds on to its slot and
+// nothing else; the others carry on with the remaining slots.
+class FrameRing {
+public:
+    // For the owner: creates the ring name (a POSIX shared memory name such
+    // as "/ws2812-rpi"), replacing any left over, readable and writable by
+    // anyone so producers needn't be root. It goes when the owner deletes it.
+    static FrameRing* create(const char *name, unsigned int numPixels,
+                             unsigned int numSlots=FRAME_RING_SLOTS);
+    // For producers: attaches to a ring the owner has created
+    static FrameRing* attach(const char *name);
+    ~FrameRing();
+
+    unsigned int numPixels();
+
+    // Claims a free slot and returns its pixels, numPixels() long, or 0 if
+    // every slot is being written. The frame is published by commitFrame().
+    Color_t* beginFrame();
+    void commitFrame();
+    // beginFrame(), copy count pixels (the rest are black), commitFrame()
+    bool publish(const Color_t *pixels, unsigned int count);
+
+    // For the owner: copies the newest complete frame into the strip if it
+    // hasn't had it yet, and returns true if so. If a producer overtook the
+    // frame while it was being copied, false is returned and the strip is
+    // left as it was.
+    bool consume(NeoPixel& strip);
+    // Complete frames the owner never took because a newer one came first
+    unsigned long getSkipped();
+
+private:
+    FrameRing(uint8_t *base, size_t size, const char *name, bool owner);
+    static size_t sizeFor(unsigned int numPixels, unsigned int numSlots, uint32_t& slotBytes);
+    FrameRingSlot* slot(uint32_t frame);
+
+    uint8_t *base;
+    size_t size;
+    FrameRingHeader *header;
+    std::string name;
+    bool owner;
+    // Copied out of the header once checked, which another process could
+    // scribble over
+    unsigned int ringPixels;
+    unsigned int numSlots;
+    unsigned int slotBytes;
+
+    // The frame this producer is writing, if any
+    FrameRingSlot *writing;
+    uint32_t writingFrame;
+
+    bool consumed;
+    uint32_t lastConsumed;
+    unsigned long skipped;
+    // Where consume() copies a frame to until it is known not to be torn
+    std::vector<Color_t> scratch;
+};
+
+#endif
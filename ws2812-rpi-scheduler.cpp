@@ -0,0 +1,156 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <errno.h>
+
+#include <algorithm>
+
+#include "ws2812-rpi-scheduler.h"
+
+// PUBLIC
+
+FrameScheduler::FrameScheduler(float fps, bool dropLate)
+    : dropLate(dropLate)
+{
+    start(fps);
+}
+
+void FrameScheduler::start(float fps){
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    this->fps = fps > 0 ? fps : 0;
+    periodNS = fps > 0 ? (long long)(1e9 / fps + 0.5) : 0;
+    startNS = toNS(now);
+    lastNS = startNS;
+    frame = 0;
+
+    frames = 1;
+    dropped = 0;
+    late = 0;
+    jitter.clear();
+    jitterPos = 0;
+}
+
+unsigned long FrameScheduler::next(){
+    struct timespec now, deadline;
+    long long nowNS, dueNS, wokeNS;
+    unsigned long due;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    nowNS = toNS(now);
+    frame++;
+    frames++;
+
+    if(periodNS == 0) {
+        lastNS = nowNS;
+        return frame;
+    }
+
+    dueNS = startNS + frame * periodNS;
+    if(nowNS >= dueNS) {
+        late++;
+        // Already into a later frame's slot; skip to it
+        due = (nowNS - startNS) / periodNS;
+        if(dropLate && due > frame) {
+            dropped += due - frame;
+            frame = due;
+            dueNS = startNS + frame * periodNS;
+        }
+        wokeNS = nowNS;
+    } else {
+        deadline.tv_sec = dueNS / 1000000000LL;
+        deadline.tv_nsec = dueNS % 1000000000LL;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        wokeNS = toNS(now);
+    }
+
+    if(jitter.size() < JITTER_SAMPLES) {
+        jitter.push_back(wokeNS - dueNS);
+    } else {
+        jitter[jitterPos] = wokeNS - dueNS;
+        jitterPos = (jitterPos + 1) % JITTER_SAMPLES;
+    }
+    lastNS = wokeNS;
+
+    return frame;
+}
+
+unsigned long FrameScheduler::run(FrameCallback render, void *arg, unsigned long numFrames){
+    unsigned long run = 0;
+    unsigned long f = frame;
+
+    while(numFrames == 0 || run < numFrames) {
+        run++;
+        if(!render(f, arg)) {
+            break;
+        }
+        if(numFrames == 0 || run < numFrames) {
+            f = next();
+        }
+    }
+    return run;
+}
+
+void FrameScheduler::setDropLate(bool drop){ dropLate = drop; }
+
+float FrameScheduler::getFPS(){ return fps; }
+
+unsigned long FrameScheduler::getFrames(){ return frames; }
+
+unsigned long FrameScheduler::getDroppedFrames(){ return dropped; }
+
+unsigned long FrameScheduler::getLateFrames(){ return late; }
+
+// Frames started over the time from the first to the last
+float FrameScheduler::getAchievedFPS(){
+    if(frames < 2 || lastNS == startNS) {
+        return 0;
+    }
+    return (frames - 1) * 1e9 / (lastNS - startNS);
+}
+
+float FrameScheduler::getJitterPercentile(float p){
+    std::vector<long long> sorted(jitter);
+    unsigned int k;
+
+    if(sorted.empty()) {
+        return 0;
+    }
+    if(p < 0) {
+        p = 0;
+    } else if(p > 100) {
+        p = 100;
+    }
+    k = (unsigned int)(p / 100 * (sorted.size() - 1) + 0.5);
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return sorted[k] / 1000.0;
+}
+
+// PRIVATE
+
+long long FrameScheduler::toNS(const struct timespec& ts){
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
@@ -0,0 +1,88 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#ifndef WS2812_RPI_SCHEDULER_H
+#define WS2812_RPI_SCHEDULER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <vector>
+#include "ws2812-rpi-defines.h"
+
+// Paces frames against absolute CLOCK_MONOTONIC deadlines, frame k being due
+// at start + k / fps. Time spent rendering, encoding and on the wire doesn't
+// push later frames back, so an animation driven by the frame number runs at
+// the same speed whatever the strip length.
+//
+// When a frame is more than a whole period late, the frames whose slots have
+// already passed are dropped (counted, and skipped in the returned frame
+// number) unless dropping is turned off, in which case they are run back to
+// back to catch up.
+class FrameScheduler {
+public:
+    // Return false to stop run()
+    typedef bool (*FrameCallback)(unsigned long frame, void *arg);
+
+    FrameScheduler(float fps=0, bool dropLate=true);
+
+    // Frame 0 is due now. An fps of 0 doesn't pace at all.
+    void start(float fps);
+    // Waits for the next frame that is due and returns its number
+    unsigned long next();
+    // Calls render for each frame until it returns false or numFrames
+    // (0 for no limit) frames have been run. Returns the frames run.
+    unsigned long run(FrameCallback render, void *arg, unsigned long numFrames=0);
+
+    void setDropLate(bool drop);
+    float getFPS();
+
+    // Statistics since start()
+    unsigned long getFrames();
+    unsigned long getDroppedFrames();
+    // Frames that were already due when next() was called
+    unsigned long getLateFrames();
+    float getAchievedFPS();
+    // Wake up time after the deadline, in microseconds, at percentile p
+    // (0 to 100) of the last JITTER_SAMPLES frames
+    float getJitterPercentile(float p);
+
+private:
+    static long long toNS(const struct timespec& ts);
+
+    float fps;
+    bool dropLate;
+    long long periodNS;
+    long long startNS;
+    unsigned long frame;
+
+    unsigned long frames;
+    unsigned long dropped;
+    unsigned long late;
+    long long lastNS;
+    std::vector<long long> jitter;
+    unsigned int jitterPos;
+};
+
+#endif
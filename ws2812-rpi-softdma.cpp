@@ -0,0 +1,139 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "ws2812-rpi-softdma.h"
+
+// PUBLIC
+
+SoftDMA::SoftDMA(uint8_t *virtbase, page_map_t *page_map, unsigned int numPages,
+                 unsigned int channels)
+    : virtbase(virtbase), page_map(page_map), numPages(numPages), channels(channels),
+      running(false), cbAddr(0), offset(0), delivered(0), errorCount(0)
+{
+    for(unsigned int i=0; i<numPages; i++) {
+        physIndex.push_back(std::make_pair(page_map[i].physaddr, i));
+    }
+    std::sort(physIndex.begin(), physIndex.end());
+}
+
+void SoftDMA::start(uint32_t addr){
+    if(running) {
+        // The real controller would just pick up the new chain, dropping the
+        // rest of the frame on the floor
+        printf("SoftDMA: transfer started while another was active\n");
+        errorCount++;
+    }
+    running = true;
+    cbAddr = addr;
+    offset = 0;
+    delivered = 0;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    frames.push_back(std::vector<uint32_t>());
+}
+
+bool SoftDMA::active(){
+    struct timespec now;
+    double elapsedNS;
+
+    if(!running) {
+        return false;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsedNS = (now.tv_sec - startTime.tv_sec) * 1e9 + (now.tv_nsec - startTime.tv_nsec);
+    deliver((unsigned int)(elapsedNS / (32 * PWM_BIT_NSEC)) * channels - delivered);
+
+    return running;
+}
+
+void SoftDMA::abort(){
+    running = false;
+}
+
+unsigned int SoftDMA::numFrames(){ return frames.size(); }
+
+const std::vector<uint32_t>& SoftDMA::frame(unsigned int i){ return frames[i]; }
+
+void SoftDMA::clearFrames(){
+    if(running) {
+        // Keep the frame in flight
+        frames.erase(frames.begin(), frames.end() - 1);
+    } else {
+        frames.clear();
+    }
+}
+
+unsigned int SoftDMA::errors(){ return errorCount; }
+
+// PRIVATE
+
+void* SoftDMA::busToVirt(uint32_t addr){
+    unsigned int pg_offset = addr & (PAGE_SIZE - 1);
+    std::vector<std::pair<uint32_t, unsigned int> >::iterator it;
+
+    it = std::lower_bound(physIndex.begin(), physIndex.end(), std::make_pair(addr - pg_offset, 0u));
+    if(it != physIndex.end() && it->first == addr - pg_offset) {
+        return page_map[it->second].virtaddr + pg_offset;
+    }
+    return 0;
+}
+
+void SoftDMA::deliver(unsigned int words){
+    while(words > 0 && running) {
+        dma_cb_t *cbp = (dma_cb_t*)busToVirt(cbAddr);
+        uint32_t *src = 0;
+
+        if(cbp == 0) {
+            printf("SoftDMA: bad control block address %08x\n", cbAddr);
+            errorCount++;
+            running = false;
+            break;
+        }
+
+        // Translate every word, a source may cross into a different page
+        for(; words > 0 && offset < cbp->length; offset += 4, words--) {
+            if((src = (uint32_t*)busToVirt(cbp->src + offset)) == 0) {
+                printf("SoftDMA: bad source address %08x\n", cbp->src + offset);
+                errorCount++;
+                running = false;
+                return;
+            }
+            frames.back().push_back(*src);
+            delivered++;
+        }
+
+        if(offset >= cbp->length) {
+            cbAddr = cbp->next;
+            offset = 0;
+            if(cbAddr == 0) {
+                running = false;
+            }
+        }
+    }
+}
@@ -0,0 +1,80 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#ifndef WS2812_RPI_SOFTDMA_H
+#define WS2812_RPI_SOFTDMA_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <vector>
+#include "ws2812-rpi-defines.h"
+
+// Software stand-in for the DMA channel feeding the PWM FIFO, so the DMA path
+// can be run and tested on a machine without /dev/mem.
+//
+// It follows the control block chain through the same page map as the real
+// hardware and reads the sample words lazily, at the rate the PWM would
+// consume them. Anything that writes to a buffer while it is still being
+// transferred therefore shows up as a corrupted frame. With both PWM channels
+// reading the FIFO, words are consumed channels at a time.
+class SoftDMA {
+public:
+    SoftDMA(uint8_t *virtbase, page_map_t *page_map, unsigned int numPages,
+            unsigned int channels=1);
+
+    // Equivalent of writing DMA_CONBLK_AD and setting DMA_CS_ACTIVE
+    void start(uint32_t cbAddr);
+    // Equivalent of reading DMA_CS_ACTIVE; advances the transfer to now
+    bool active();
+    void abort();
+
+    // Words delivered to the PWM FIFO, one entry per transfer
+    unsigned int numFrames();
+    const std::vector<uint32_t>& frame(unsigned int i);
+    void clearFrames();
+
+    unsigned int errors();
+
+private:
+    void* busToVirt(uint32_t addr);
+    void deliver(unsigned int words);
+
+    uint8_t *virtbase;
+    page_map_t *page_map;
+    unsigned int numPages;
+    unsigned int channels;
+    std::vector<std::pair<uint32_t, unsigned int> > physIndex;
+
+    bool running;
+    uint32_t cbAddr;
+    unsigned int offset;
+    unsigned int delivered;
+    struct timespec startTime;
+    unsigned int errorCount;
+
+    std::vector<std::vector<uint32_t> > frames;
+};
+
+#endif
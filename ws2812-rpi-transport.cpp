@@ -0,0 +1,634 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <stdio.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ws2812-rpi-transport.h"
+
+// The registers every DMA transport in the process shares, and which
+// transport holds each DMA channel. /dev/mem is opened once, by the first
+// transport, and every peripheral is mapped through that one descriptor.
+struct HardwareContext {
+    HardwareContext() : refs(0), memFD(-1), dma_block(0), clk_reg(0), gpio_reg(0), owners() {}
+
+    unsigned int refs;
+    int memFD;
+    volatile unsigned int *dma_block;
+    volatile unsigned int *clk_reg;
+    volatile unsigned int *gpio_reg;
+    DMATransport *owners[DMA_CHANNELS];
+};
+
+static HardwareContext hardware = HardwareContext();
+
+// PUBLIC
+
+WS2812Transport* WS2812Transport::create(unsigned int flags){
+    bool reattach = flags & NEOPIXEL_REATTACH;
+
+    if(flags & NEOPIXEL_LOOPBACK) {
+        return new LoopbackTransport();
+    }
+    if(flags & NEOPIXEL_PCM) {
+        return new PCMTransport(reattach);
+    }
+    if(flags & NEOPIXEL_SPI) {
+        return new SPITransport(reattach);
+    }
+    return new PWMTransport(reattach);
+}
+
+// DMATransport
+
+DMATransport::DMATransport(bool reattach)
+    : channels(1), frameBytes(0), dma_reg(0), clk_reg(0), gpio_reg(0), claimed(-1),
+      reattach(reattach), attached(false)
+{
+}
+
+DMATransport::~DMATransport(){
+    releaseHardware();
+}
+
+uint32_t DMATransport::dmaInfo(){
+    return DMA_TI_DREQWORD(dreq());
+}
+
+bool DMATransport::init(uint8_t * /* virtbase */, page_map_t * /* page_map */, unsigned int /* numPages */,
+                        unsigned int channels, unsigned int frameBytes){
+    this->channels = channels;
+    this->frameBytes = frameBytes;
+
+    // Set up peripheral access
+    if(!acquireHardware() || !mapPeripheral()) {
+        return false;
+    }
+
+    // A channel that is still running was left by a process that didn't get
+    // to stop it, and reads memory that process no longer owns
+    if(dma_reg[DMA_CS] & (1 << DMA_CS_ACTIVE)) {
+        dma_reg[DMA_CS] |= (1 << DMA_CS_ABORT);
+    }
+    dma_reg[DMA_CS] = (1 << DMA_CS_RESET);
+    if(!waitFor(&dma_reg[DMA_CS], 1 << DMA_CS_ACTIVE, 0, REG_TIMEOUT_USEC)) {
+        printf("DMA channel %d didn't reset\n", claimed);
+        return false;
+    }
+
+    if(reattach && configured()) {
+        attached = true;
+    } else if(!initPeripheral()) {
+        return false;
+    }
+
+    // Both are cleared by writing a one
+    SETBIT(dma_reg[DMA_CS], DMA_CS_INT);
+    SETBIT(dma_reg[DMA_CS], DMA_CS_END);
+    dma_reg[DMA_DEBUG] = 7;
+
+    return true;
+}
+
+void DMATransport::start(uint32_t cbAddr){
+    // Writing END clears it, it is set again when this transfer completes
+    dma_reg[DMA_CONBLK_AD] = cbAddr;
+    dma_reg[DMA_CS] = DMA_CS_CONFIGWORD | (1 << DMA_CS_END) | (1 << DMA_CS_ACTIVE);
+    waitForFIFO();
+
+    startPeripheral();
+}
+
+bool DMATransport::active(){
+    return !(dma_reg[DMA_CS] & (1 << DMA_CS_END)) || (dma_reg[DMA_CS] & (1 << DMA_CS_ACTIVE));
+}
+
+void DMATransport::collectErrors(TransportErrors& errors){
+    // DEBUG holds the read, FIFO and last-not-set errors, which CS ERROR
+    // summarises; writing them back clears them
+    if((dma_reg[DMA_CS] & (1 << DMA_CS_ERROR)) || (dma_reg[DMA_DEBUG] & 7)) {
+        errors.dmaErrors++;
+        dma_reg[DMA_DEBUG] = 7;
+    }
+    peripheralErrors(errors);
+}
+
+void DMATransport::stop(){
+    if(dma_reg) {
+        CLRBIT(dma_reg[DMA_CS], DMA_CS_ACTIVE);
+        SETBIT(dma_reg[DMA_CS], DMA_CS_RESET);
+        waitFor(&dma_reg[DMA_CS], 1 << DMA_CS_ACTIVE, 0, REG_TIMEOUT_USEC);
+    }
+    // Left for the next process to reattach to
+    if(!reattach) {
+        stopPeripheral();
+    }
+}
+
+bool DMATransport::reattached(){ return attached; }
+
+// PROTECTED
+
+volatile unsigned int* DMATransport::map_peripheral(uint32_t base, uint32_t len){
+    void * vaddr;
+
+    if (hardware.memFD < 0) {
+        return 0;
+    }
+    vaddr = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, hardware.memFD, base);
+    if (vaddr == MAP_FAILED) {
+        printf("Failed to map peripheral at 0x%08x: %m\n", base);
+        return 0;
+    }
+
+    return (volatile unsigned int*)vaddr;
+}
+
+void DMATransport::unmap_peripheral(volatile unsigned int *&reg, uint32_t len){
+    if(reg) {
+        munmap((void*)reg, len);
+        reg = 0;
+    }
+}
+
+// Runs a peripheral clock from PLLD divided by idiv. The divider can only be
+// changed once BUSY says the clock has stopped.
+bool DMATransport::setClock(unsigned int ctl, unsigned int div, unsigned int idiv){
+    unsigned short fdiv = 0;
+
+    clk_reg[ctl] = CM_PASSWD | (1 << CM_KILL);
+    if(!waitFor(&clk_reg[ctl], 1 << CM_BUSY, 0, REG_TIMEOUT_USEC)) {
+        printf("%s clock didn't stop\n", name());
+        return false;
+    }
+
+    clk_reg[div] = CM_PASSWD | (idiv << 12) | fdiv;
+    clk_reg[ctl] = CM_PASSWD | CM_ENAB_PLLD;
+    if(!waitFor(&clk_reg[ctl], 1 << CM_BUSY, 1 << CM_BUSY, REG_TIMEOUT_USEC)) {
+        printf("%s clock didn't start\n", name());
+        return false;
+    }
+    return true;
+}
+
+// True if the clock is running from PLLD divided by idiv. The password
+// field reads back as zero.
+bool DMATransport::clockRunning(unsigned int ctl, unsigned int div, unsigned int idiv){
+    uint32_t ctlMask = (1 << CM_BUSY) | CM_ENAB_PLLD | 0xF;
+
+    return (clk_reg[ctl] & ctlMask) == ((1 << CM_BUSY) | CM_ENAB_PLLD) &&
+           (clk_reg[div] & 0xFFFFFF) == (idiv << 12);
+}
+
+// Polls until the masked register reads value, for at most timeoutUS.
+// Register writes show within a few peripheral clocks, so this is normally
+// over long before the first check of the time.
+bool DMATransport::waitFor(volatile unsigned int *reg, uint32_t mask, uint32_t value,
+                           unsigned int timeoutUS){
+    struct timespec start, now;
+
+    if((*reg & mask) == value) {
+        return true;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        if((*reg & mask) == value) {
+            return true;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while((now.tv_sec - start.tv_sec) * 1000000LL + (now.tv_nsec - start.tv_nsec) / 1000 < timeoutUS);
+
+    return (*reg & mask) == value;
+}
+
+// Writes a register clocked by the peripheral rather than the bus, and
+// waits for the value to read back
+bool DMATransport::setRegister(volatile unsigned int *reg, uint32_t value){
+    *reg = value;
+    if(!waitFor(reg, 0xFFFFFFFF, value, REG_TIMEOUT_USEC)) {
+        printf("%s register didn't take 0x%08x\n", name(), value);
+        return false;
+    }
+    return true;
+}
+
+// PRIVATE
+
+bool DMATransport::acquireHardware(){
+    unsigned int c = dmaChannel();
+
+    if(hardware.owners[c]) {
+        printf("%s output is already driven by another strip, which can be shared through its views\n",
+               name());
+        return false;
+    }
+    if(hardware.refs == 0) {
+        if((hardware.memFD = open("/dev/mem", O_RDWR | O_SYNC)) < 0) {
+            printf("Failed to open /dev/mem: %m\n");
+            return false;
+        }
+        hardware.dma_block = map_peripheral(DMA_BASE, DMA_BLOCK_LEN);
+        hardware.clk_reg = map_peripheral(CLK_BASE, CLK_LEN);
+        hardware.gpio_reg = map_peripheral(GPIO_BASE, GPIO_LEN);
+        if(hardware.dma_block == 0 || hardware.clk_reg == 0 || hardware.gpio_reg == 0) {
+            unmap_peripheral(hardware.dma_block, DMA_BLOCK_LEN);
+            unmap_peripheral(hardware.clk_reg, CLK_LEN);
+            unmap_peripheral(hardware.gpio_reg, GPIO_LEN);
+            close(hardware.memFD);
+            hardware.memFD = -1;
+            return false;
+        }
+    }
+    hardware.refs++;
+    hardware.owners[c] = this;
+    claimed = c;
+
+    dma_reg = hardware.dma_block + c * DMA_CHANNEL_SIZE / 4;
+    clk_reg = hardware.clk_reg;
+    gpio_reg = hardware.gpio_reg;
+    return true;
+}
+
+// Called from the destructor, so the channel is the one remembered from
+// acquireHardware() rather than asked for again
+void DMATransport::releaseHardware(){
+    if(claimed < 0) {
+        return;
+    }
+    hardware.owners[claimed] = 0;
+    claimed = -1;
+    dma_reg = 0;
+    clk_reg = 0;
+    gpio_reg = 0;
+
+    if(--hardware.refs == 0) {
+        unmap_peripheral(hardware.dma_block, DMA_BLOCK_LEN);
+        unmap_peripheral(hardware.clk_reg, CLK_LEN);
+        unmap_peripheral(hardware.gpio_reg, GPIO_LEN);
+        close(hardware.memFD);
+        hardware.memFD = -1;
+    }
+}
+
+// PWMTransport
+
+// What initPeripheral() programs, and configured() looks for. CTL is
+// serialiser mode reading the FIFO, without repeat, silence or inversion,
+// for each channel in use; the enable bits are left to startPeripheral().
+static const uint32_t PWM_DMAC_WORD =
+    (1 << PWM_DMAC_ENAB) |
+    (8 << PWM_DMAC_PANIC) |
+    (8 << PWM_DMAC_DREQ);
+
+static uint32_t pwmCtlMask(unsigned int channels){
+    uint32_t mask =
+        (1 << PWM_CTL_MSEN1) | (1 << PWM_CTL_USEF1) | (1 << PWM_CTL_POLA1) |
+        (1 << PWM_CTL_SBIT1) | (1 << PWM_CTL_RPTL1) | (1 << PWM_CTL_MODE1);
+    return channels > 1 ? mask | (mask << 8) : mask;
+}
+
+// With both channels reading the FIFO they take alternate words
+static uint32_t pwmCtlWord(unsigned int channels){
+    uint32_t word = (1 << PWM_CTL_USEF1) | (1 << PWM_CTL_MODE1);
+    return channels > 1 ? word | (word << 8) : word;
+}
+
+PWMTransport::PWMTransport(bool reattach) : DMATransport(reattach), pwm_reg(0) {}
+
+PWMTransport::~PWMTransport(){
+    unmap_peripheral(pwm_reg, PWM_LEN);
+}
+
+const char* PWMTransport::name(){ return "pwm"; }
+
+unsigned int PWMTransport::maxChannels(){ return 2; }
+
+uint32_t PWMTransport::fifoAddress(){ return PWM_FIFO_BUS; }
+
+unsigned int PWMTransport::dreq(){ return DMA_DREQ_PWM; }
+
+unsigned int PWMTransport::dmaChannel(){ return DMA_CHANNEL_PWM; }
+
+bool PWMTransport::mapPeripheral(){
+    return (pwm_reg = map_peripheral(PWM_BASE, PWM_LEN)) != 0;
+}
+
+bool PWMTransport::configured(){
+    return GET_GPIO_FSEL(18) == GPIO_ALT_FSEL(5) &&
+           (channels == 1 || GET_GPIO_FSEL(19) == GPIO_ALT_FSEL(5)) &&
+           clockRunning(PWM_CLK_CNTL, PWM_CLK_DIV, CM_DIV_WS2812) &&
+           pwm_reg[PWM_RNG1] == 32 &&
+           (channels == 1 || pwm_reg[PWM_RNG2] == 32) &&
+           pwm_reg[PWM_DMAC] == PWM_DMAC_WORD &&
+           (pwm_reg[PWM_CTL] & pwmCtlMask(channels)) == pwmCtlWord(channels);
+}
+
+bool PWMTransport::initPeripheral(){
+    // Set PWM alternate function for GPIO18, and GPIO19 for channel 2
+    SET_GPIO_ALT(18, 5);
+    if(channels > 1) {
+        SET_GPIO_ALT(19, 5);
+    }
+
+    // Stop the PWM and its DMA requests while the clock changes
+    pwm_reg[PWM_DMAC] = 0;
+    pwm_reg[PWM_CTL] = 0;
+
+    // PWM Clock
+    if(!setClock(PWM_CLK_CNTL, PWM_CLK_DIV, CM_DIV_WS2812)) {
+        return false;
+    }
+
+    // PWM. The registers are clocked by the PWM clock, so each write is
+    // read back before the next rather than slept after.
+    if(!setRegister(&pwm_reg[PWM_RNG1], 32) ||
+       !setRegister(&pwm_reg[PWM_RNG2], 32) ||
+       !setRegister(&pwm_reg[PWM_DMAC], PWM_DMAC_WORD)) {
+        return false;
+    }
+
+    pwm_reg[PWM_CTL] = (1 << PWM_CTL_CLRF1);
+    return setRegister(&pwm_reg[PWM_CTL], pwmCtlWord(channels));
+}
+
+// The DMA fills the FIFO within a few bus cycles; if it hasn't, the PWM
+// starts on an empty FIFO, which only lengthens the reset before the frame
+void PWMTransport::waitForFIFO(){
+    waitFor(&pwm_reg[PWM_STA], 1 << PWM_STA_EMPT1, 0, 100);
+}
+
+void PWMTransport::startPeripheral(){
+    SETBIT(pwm_reg[PWM_CTL], PWM_CTL_PWEN1);    
+    if(channels > 1) {
+        SETBIT(pwm_reg[PWM_CTL], PWM_CTL_PWEN2);
+    }
+}
+
+void PWMTransport::stopPeripheral(){
+    if(pwm_reg) {
+        CLRBIT(pwm_reg[PWM_CTL], PWM_CTL_PWEN1);
+        CLRBIT(pwm_reg[PWM_CTL], PWM_CTL_PWEN2);
+        waitFor(&pwm_reg[PWM_CTL], (1 << PWM_CTL_PWEN1) | (1 << PWM_CTL_PWEN2), 0, REG_TIMEOUT_USEC);
+        pwm_reg[PWM_CTL] = (1 << PWM_CTL_CLRF1);
+    }
+}
+
+// The FIFO runs dry at the end of every frame, so the gap flags (GAPO1/2)
+// are set every time and don't say anything; they are just cleared. Gaps in
+// the middle of a frame make the transfer overrun, which NeoPixel catches.
+void PWMTransport::peripheralErrors(TransportErrors& errors){
+    uint32_t sta = pwm_reg[PWM_STA];
+    uint32_t bad = (1 << PWM_STA_BERR) | (1 << PWM_STA_WERR1) | (1 << PWM_STA_RERR1);
+
+    if(sta & bad) {
+        errors.fifoErrors++;
+    }
+    pwm_reg[PWM_STA] = bad | (1 << PWM_STA_GAPO1) | (1 << PWM_STA_GAPO2);
+}
+
+// PCMTransport
+
+// 32 clock frames with one 32 bit channel filling each, so the words go
+// out back to back MSB first just as they do from the PWM
+static const uint32_t PCM_MODE_WORD = (31 << PCM_MODE_FLEN) | (1 << PCM_MODE_FSLEN);
+static const uint32_t PCM_TXC_WORD =
+    (1 << PCM_TXC_CH1WEX) |
+    (1 << PCM_TXC_CH1EN) |
+    (0 << PCM_TXC_CH1POS) |
+    (8 << PCM_TXC_CH1WID);
+static const uint32_t PCM_DREQ_WORD =
+    (0x10 << PCM_DREQ_TX_PANIC) |
+    (0x30 << PCM_DREQ_TX);
+
+PCMTransport::PCMTransport(bool reattach) : DMATransport(reattach), pcm_reg(0) {}
+
+PCMTransport::~PCMTransport(){
+    unmap_peripheral(pcm_reg, PCM_LEN);
+}
+
+const char* PCMTransport::name(){ return "pcm"; }
+
+unsigned int PCMTransport::maxChannels(){ return 1; }
+
+uint32_t PCMTransport::fifoAddress(){ return PCM_FIFO_BUS; }
+
+unsigned int PCMTransport::dreq(){ return DMA_DREQ_PCM_TX; }
+
+unsigned int PCMTransport::dmaChannel(){ return DMA_CHANNEL_PCM; }
+
+bool PCMTransport::mapPeripheral(){
+    return (pcm_reg = map_peripheral(PCM_BASE, PCM_LEN)) != 0;
+}
+
+bool PCMTransport::configured(){
+    uint32_t enabled = (1 << PCM_CS_EN) | (1 << PCM_CS_DMAEN);
+
+    return GET_GPIO_FSEL(21) == GPIO_ALT_FSEL(0) &&
+           clockRunning(PCM_CLK_CNTL, PCM_CLK_DIV, CM_DIV_WS2812) &&
+           pcm_reg[PCM_MODE] == PCM_MODE_WORD &&
+           pcm_reg[PCM_TXC] == PCM_TXC_WORD &&
+           pcm_reg[PCM_DREQ] == PCM_DREQ_WORD &&
+           (pcm_reg[PCM_CS] & enabled) == enabled;
+}
+
+bool PCMTransport::initPeripheral(){
+    // PCM_DOUT is ALT0 on GPIO21
+    SET_GPIO_ALT(21, 0);
+
+    pcm_reg[PCM_CS] = 0;
+
+    // Same bit clock as the PWM
+    if(!setClock(PCM_CLK_CNTL, PCM_CLK_DIV, CM_DIV_WS2812)) {
+        return false;
+    }
+
+    pcm_reg[PCM_MODE] = PCM_MODE_WORD;
+    pcm_reg[PCM_TXC] = PCM_TXC_WORD;
+    pcm_reg[PCM_DREQ] = PCM_DREQ_WORD;
+
+    SETBIT(pcm_reg[PCM_CS], PCM_CS_EN);
+    SETBIT(pcm_reg[PCM_CS], PCM_CS_TXCLR);
+    if(!sync()) {
+        return false;
+    }
+
+    SETBIT(pcm_reg[PCM_CS], PCM_CS_DMAEN);
+
+    return true;
+}
+
+void PCMTransport::waitForFIFO(){
+    waitFor(&pcm_reg[PCM_CS], 1 << PCM_CS_TXE, 0, 100);
+}
+
+void PCMTransport::startPeripheral(){
+    SETBIT(pcm_reg[PCM_CS], PCM_CS_TXON);
+}
+
+void PCMTransport::stopPeripheral(){
+    if(pcm_reg) {
+        CLRBIT(pcm_reg[PCM_CS], PCM_CS_TXON);
+        sync();
+        pcm_reg[PCM_CS] = 0;
+    }
+}
+
+// TXERR is the PCM's underrun flag, which like the PWM's gap flags is set
+// at the end of every frame; clear it for the next one. It can't tell a
+// starved FIFO mid-frame from the end of the data, and the PCM has no other
+// transmit error flag, so nothing is counted here: a stall mid-frame shows
+// up as an underrun when the transfer outlasts its frame time.
+void PCMTransport::peripheralErrors(TransportErrors& /* errors */){
+    SETBIT(pcm_reg[PCM_CS], PCM_CS_TXERR);
+}
+
+// PRIVATE
+
+// Writes to CS take two PCM clocks to act, and SYNC echoes whatever was
+// written to it after the same two, so flipping it and waiting for the echo
+// says everything before it has gone through
+bool PCMTransport::sync(){
+    uint32_t echo = ~pcm_reg[PCM_CS] & (1 << PCM_CS_SYNC);
+
+    pcm_reg[PCM_CS] = (pcm_reg[PCM_CS] & ~(1 << PCM_CS_SYNC)) | echo;
+    if(!waitFor(&pcm_reg[PCM_CS], 1 << PCM_CS_SYNC, echo, REG_TIMEOUT_USEC)) {
+        printf("pcm didn't sync\n");
+        return false;
+    }
+    return true;
+}
+
+// SPITransport
+
+static const uint32_t SPI_DC_WORD =
+    (0x30 << SPI_DC_TPANIC) |
+    (0x20 << SPI_DC_TDREQ);
+
+SPITransport::SPITransport(bool reattach) : DMATransport(reattach), spi_reg(0) {}
+
+SPITransport::~SPITransport(){
+    unmap_peripheral(spi_reg, SPI_LEN);
+}
+
+const char* SPITransport::name(){ return "spi"; }
+
+unsigned int SPITransport::maxChannels(){ return 1; }
+
+// SPI shifts each FIFO word out a byte at a time from the lowest address
+bool SPITransport::swapBytes(){ return true; }
+
+uint32_t SPITransport::fifoAddress(){ return SPI_FIFO_BUS; }
+
+unsigned int SPITransport::dreq(){ return DMA_DREQ_SPI_TX; }
+
+unsigned int SPITransport::dmaChannel(){ return DMA_CHANNEL_SPI; }
+
+bool SPITransport::mapPeripheral(){
+    if(frameBytes > 0xFFFF) {
+        printf("SPI can't send frames over 65535 bytes (%d bytes needed)\n", frameBytes);
+        return false;
+    }
+    return (spi_reg = map_peripheral(SPI_BASE, SPI_LEN)) != 0;
+}
+
+// SPI runs from the core clock, so there is no clock of its own to check
+bool SPITransport::configured(){
+    return GET_GPIO_FSEL(10) == GPIO_ALT_FSEL(0) &&
+           spi_reg[SPI_CLK] == SPI_CDIV &&
+           spi_reg[SPI_DC] == SPI_DC_WORD;
+}
+
+bool SPITransport::initPeripheral(){
+    // SPI0_MOSI is ALT0 on GPIO10
+    SET_GPIO_ALT(10, 0);
+
+    spi_reg[SPI_CS] = (1 << SPI_CS_CLEAR_TX) | (1 << SPI_CS_CLEAR_RX);
+    spi_reg[SPI_CLK] = SPI_CDIV;
+    spi_reg[SPI_DC] = SPI_DC_WORD;
+
+    return true;
+}
+
+// Each transfer has to be told its length, and the controller drops TA again
+// once that many bytes have gone
+void SPITransport::startPeripheral(){
+    spi_reg[SPI_DLEN] = frameBytes;
+    spi_reg[SPI_CS] = (1 << SPI_CS_DMAEN) | (1 << SPI_CS_ADCS) | (1 << SPI_CS_TA);
+}
+
+void SPITransport::stopPeripheral(){
+    if(spi_reg) {
+        spi_reg[SPI_CS] = (1 << SPI_CS_CLEAR_TX) | (1 << SPI_CS_CLEAR_RX);
+    }
+}
+
+// LoopbackTransport
+
+LoopbackTransport::LoopbackTransport() : softDMA(0), softErrors(0) {}
+
+LoopbackTransport::~LoopbackTransport(){
+    delete softDMA;
+}
+
+const char* LoopbackTransport::name(){ return "loopback"; }
+
+unsigned int LoopbackTransport::maxChannels(){ return 2; }
+
+bool LoopbackTransport::emulated(){ return true; }
+
+uint32_t LoopbackTransport::fifoAddress(){ return PWM_FIFO_BUS; }
+
+uint32_t LoopbackTransport::dmaInfo(){ return DMA_TI_CONFIGWORD; }
+
+bool LoopbackTransport::init(uint8_t *virtbase, page_map_t *page_map, unsigned int numPages,
+                             unsigned int channels, unsigned int /* frameBytes */){
+    softDMA = new SoftDMA(virtbase, page_map, numPages, channels);
+    return true;
+}
+
+void LoopbackTransport::start(uint32_t cbAddr){
+    softDMA->start(cbAddr);
+}
+
+bool LoopbackTransport::active(){
+    return softDMA->active();
+}
+
+// The stand-in's errors are transfers started while another was still
+// running, and control block or source addresses it couldn't translate
+void LoopbackTransport::collectErrors(TransportErrors& errors){
+    errors.dmaErrors += softDMA->errors() - softErrors;
+    softErrors = softDMA->errors();
+}
+
+void LoopbackTransport::stop(){
+    if(softDMA) {
+        softDMA->abort();
+    }
+}
+
+SoftDMA* LoopbackTransport::getSoftDMA(){ return softDMA; }
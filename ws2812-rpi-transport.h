@@ -0,0 +1,249 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#ifndef WS2812_RPI_TRANSPORT_H
+#define WS2812_RPI_TRANSPORT_H
+
+#include <stdint.h>
+
+#include "ws2812-rpi-defines.h"
+#include "ws2812-rpi-softdma.h"
+
+// Hardware errors seen since the last collectErrors()
+struct TransportErrors {
+    unsigned int fifoErrors;
+    unsigned int dmaErrors;
+};
+
+// Gets the DMA buffers onto the wire. NeoPixel owns the buffers and their
+// control block chains; the transport says where the DMA has to write and how
+// it is paced, sets up the peripheral and runs the transfers.
+class WS2812Transport {
+public:
+    virtual ~WS2812Transport() {}
+
+    // Picks the transport from the NeoPixel constructor flags
+    static WS2812Transport* create(unsigned int flags);
+
+    virtual const char* name() = 0;
+    // Channels that can be sent side by side from one interleaved buffer
+    virtual unsigned int maxChannels() = 0;
+    // True if the words have to be byte swapped, for peripherals that send
+    // the FIFO a byte at a time from the least significant end
+    virtual bool swapBytes() { return false; }
+    // True if the buffers don't need real bus addresses
+    virtual bool emulated() { return false; }
+
+    // Destination and TI word for the control blocks
+    virtual uint32_t fifoAddress() = 0;
+    virtual uint32_t dmaInfo() = 0;
+
+    // Called once the DMA memory is allocated, with the size of one buffer.
+    // Returns false if the peripheral couldn't be set up.
+    virtual bool init(uint8_t *virtbase, page_map_t *page_map, unsigned int numPages,
+                      unsigned int channels, unsigned int frameBytes) = 0;
+    virtual void start(uint32_t cbAddr) = 0;
+    virtual bool active() = 0;
+    virtual void stop() = 0;
+    // Called once each transfer has finished. Adds any errors the DMA
+    // controller or peripheral flagged during it to errors and clears them.
+    virtual void collectErrors(TransportErrors& errors) = 0;
+
+    // True if init() found the output already set up the way it would have
+    // set it, and took it over without touching it
+    virtual bool reattached() { return false; }
+
+    // Only the loopback transport has one
+    virtual SoftDMA* getSoftDMA() { return 0; }
+};
+
+// Shared by the hardware transports: one DMA channel feeding a peripheral
+// FIFO through /dev/mem. The DMA, clock and GPIO registers are one hardware
+// context for the whole process, mapped by the first transport to need them
+// and unmapped by the last. A transport claims its DMA channel in init(); if
+// another strip already drives it, init() fails without touching anything.
+//
+// With reattach set, init() leaves the clock and peripheral alone if they
+// are already configured as it would configure them, and stop() leaves them
+// running with an empty FIFO, which holds the line low just as it is between
+// frames. A process restarting on the same output then never glitches it.
+class DMATransport : public WS2812Transport {
+public:
+    DMATransport(bool reattach);
+    ~DMATransport();
+
+    uint32_t dmaInfo();
+
+    bool init(uint8_t *virtbase, page_map_t *page_map, unsigned int numPages,
+              unsigned int channels, unsigned int frameBytes);
+    void start(uint32_t cbAddr);
+    bool active();
+    void stop();
+    void collectErrors(TransportErrors& errors);
+    bool reattached();
+
+protected:
+    virtual unsigned int dreq() = 0;
+    virtual unsigned int dmaChannel() = 0;
+    virtual bool mapPeripheral() = 0;
+    // True if the clock, pins and peripheral registers already hold what
+    // initPeripheral() would write
+    virtual bool configured() = 0;
+    virtual bool initPeripheral() = 0;
+    // Waits, briefly, for the DMA to put the first words in the FIFO
+    virtual void waitForFIFO() {}
+    virtual void startPeripheral() = 0;
+    virtual void stopPeripheral() = 0;
+    // The peripheral's own error flags, if it has any
+    virtual void peripheralErrors(TransportErrors& /* errors */) {}
+
+    volatile unsigned int* map_peripheral(uint32_t base, uint32_t len);
+    void unmap_peripheral(volatile unsigned int *&reg, uint32_t len);
+    bool setClock(unsigned int ctl, unsigned int div, unsigned int idiv);
+    bool clockRunning(unsigned int ctl, unsigned int div, unsigned int idiv);
+    bool waitFor(volatile unsigned int *reg, uint32_t mask, uint32_t value, unsigned int timeoutUS);
+    bool setRegister(volatile unsigned int *reg, uint32_t value);
+
+    unsigned int channels;
+    unsigned int frameBytes;
+
+    volatile unsigned int *dma_reg;
+    volatile unsigned int *clk_reg;
+    volatile unsigned int *gpio_reg;
+
+private:
+    bool acquireHardware();
+    void releaseHardware();
+
+    // The DMA channel this transport holds, or -1
+    int claimed;
+    bool reattach;
+    bool attached;
+};
+
+// PWM serialiser on GPIO18, and GPIO19 for a second channel
+class PWMTransport : public DMATransport {
+public:
+    PWMTransport(bool reattach);
+    ~PWMTransport();
+
+    const char* name();
+    unsigned int maxChannels();
+    uint32_t fifoAddress();
+
+protected:
+    unsigned int dreq();
+    unsigned int dmaChannel();
+    bool mapPeripheral();
+    bool configured();
+    bool initPeripheral();
+    void startPeripheral();
+    void stopPeripheral();
+    void waitForFIFO();
+    void peripheralErrors(TransportErrors& errors);
+
+private:
+    volatile unsigned int *pwm_reg;
+};
+
+// PCM transmit on GPIO21. Leaves the PWM, and so the analog audio, alone.
+class PCMTransport : public DMATransport {
+public:
+    PCMTransport(bool reattach);
+    ~PCMTransport();
+
+    const char* name();
+    unsigned int maxChannels();
+    uint32_t fifoAddress();
+
+protected:
+    unsigned int dreq();
+    unsigned int dmaChannel();
+    bool mapPeripheral();
+    bool configured();
+    bool initPeripheral();
+    void startPeripheral();
+    void stopPeripheral();
+    void waitForFIFO();
+    void peripheralErrors(TransportErrors& errors);
+
+private:
+    bool sync();
+
+    volatile unsigned int *pcm_reg;
+};
+
+// SPI0 MOSI on GPIO10, for boards where PWM and PCM are both spoken for.
+// DLEN is 16 bits, so a frame can be at most 64kB.
+class SPITransport : public DMATransport {
+public:
+    SPITransport(bool reattach);
+    ~SPITransport();
+
+    const char* name();
+    unsigned int maxChannels();
+    bool swapBytes();
+    uint32_t fifoAddress();
+
+protected:
+    unsigned int dreq();
+    unsigned int dmaChannel();
+    bool mapPeripheral();
+    bool configured();
+    bool initPeripheral();
+    void startPeripheral();
+    void stopPeripheral();
+
+private:
+    volatile unsigned int *spi_reg;
+};
+
+// Records every frame to memory through the software DMA stand-in instead of
+// sending it anywhere. Behaves like PWM, including two channels.
+class LoopbackTransport : public WS2812Transport {
+public:
+    LoopbackTransport();
+    ~LoopbackTransport();
+
+    const char* name();
+    unsigned int maxChannels();
+    bool emulated();
+    uint32_t fifoAddress();
+    uint32_t dmaInfo();
+
+    bool init(uint8_t *virtbase, page_map_t *page_map, unsigned int numPages,
+              unsigned int channels, unsigned int frameBytes);
+    void start(uint32_t cbAddr);
+    bool active();
+    void stop();
+    void collectErrors(TransportErrors& errors);
+
+    SoftDMA* getSoftDMA();
+
+private:
+    SoftDMA *softDMA;
+    unsigned int softErrors;
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ws2812-rpi-workers.h"
+
+// PUBLIC
+
+WorkerPool* WorkerPool::create(unsigned int threads){
+    WorkerPool *pool = new WorkerPool();
+    unsigned int i;
+    pthread_t thread;
+    int err;
+
+    for(i = 1; i < threads; i++) {
+        if((err = pthread_create(&thread, 0, threadMain, pool)) != 0) {
+            printf("Unable to start worker thread %d of %d: %s\n", i, threads - 1, strerror(err));
+            delete pool;
+            return 0;
+        }
+        pool->threads.push_back(thread);
+    }
+    return pool;
+}
+
+WorkerPool::~WorkerPool(){
+    unsigned int i;
+
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+    for(i = 0; i < threads.size(); i++) {
+        pthread_join(threads[i], 0);
+    }
+
+    pthread_cond_destroy(&done);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+}
+
+unsigned int WorkerPool::numThreads(){ return threads.size() + 1; }
+
+void WorkerPool::run(Task task, void *arg, unsigned int count){
+    unsigned int i;
+
+    // Not worth a wake up
+    if(threads.empty() || count < 2) {
+        for(i = 0; i < count; i++) {
+            task(arg, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    this->task = task;
+    this->arg = arg;
+    this->count = count;
+    next = 0;
+    busy = threads.size();
+    generation++;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+
+    work();
+
+    // Every thread checks in for every batch, even one that found nothing
+    // left to take, so none can still be reading this one when the next
+    // is handed out
+    pthread_mutex_lock(&lock);
+    while(busy > 0) {
+        pthread_cond_wait(&done, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+unsigned int WorkerPool::numCores(){
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
+
+// PRIVATE
+
+WorkerPool::WorkerPool()
+    : task(0), arg(0), count(0), next(0), generation(0), busy(0), stopping(false)
+{
+    pthread_mutex_init(&lock, 0);
+    pthread_cond_init(&wake, 0);
+    pthread_cond_init(&done, 0);
+}
+
+void* WorkerPool::threadMain(void *pool){
+    WorkerPool *p = (WorkerPool*)pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&p->lock);
+    for(;;) {
+        while(!p->stopping && p->generation == seen) {
+            pthread_cond_wait(&p->wake, &p->lock);
+        }
+        if(p->stopping) {
+            break;
+        }
+        seen = p->generation;
+        pthread_mutex_unlock(&p->lock);
+
+        p->work();
+
+        pthread_mutex_lock(&p->lock);
+        if(--p->busy == 0) {
+            pthread_cond_signal(&p->done);
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
+
+// Takes tasks until there are none left
+void WorkerPool::work(){
+    unsigned int i;
+
+    while((i = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED)) < count) {
+        task(arg, i);
+    }
+}
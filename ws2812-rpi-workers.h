@@ -0,0 +1,77 @@
+/*
+###############################################################################
+#                                                                             #
+# WS2812-RPi                                                                  #
+# ==========                                                                  #
+# A C++ library for driving WS2812 RGB LED's (known as 'NeoPixels' by         #
+#     Adafruit) directly from a Raspberry Pi with accompanying Python wrapper #
+# Copyright (C) 2014 Rob Kent                                                 #
+#                                                                             #
+# This program is free software: you can redistribute it and/or modify        #
+# it under the terms of the GNU General Public License as published by        #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# This program is distributed in the hope that it will be useful,             #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.       #
+#                                                                             #
+###############################################################################
+*/
+#ifndef WS2812_RPI_WORKERS_H
+#define WS2812_RPI_WORKERS_H
+
+#include <pthread.h>
+
+#include <vector>
+
+// A fixed set of threads that runs batches of independent tasks, for
+// spreading the encoding of a long strip over the cores. The threads are
+// started once and sleep between batches, so a frame costs a wake up rather
+// than a thread creation. The calling thread works through the batch too.
+class WorkerPool {
+public:
+    typedef void (*Task)(void *arg, unsigned int index);
+
+    // threads counts the calling thread, so threads - 1 are started.
+    // Returns 0 if they couldn't be.
+    static WorkerPool* create(unsigned int threads);
+    ~WorkerPool();
+
+    unsigned int numThreads();
+
+    // Calls task(arg, i) for every i below count, each exactly once on
+    // whichever thread gets to it first, and returns once all have returned.
+    // Not to be called from more than one thread at a time.
+    void run(Task task, void *arg, unsigned int count);
+
+    // Cores online, for picking a thread count
+    static unsigned int numCores();
+
+private:
+    WorkerPool();
+    static void* threadMain(void *pool);
+    void work();
+
+    std::vector<pthread_t> threads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+
+    // The batch, handed out under lock by generation; next is taken with
+    // atomics by the threads working through it
+    Task task;
+    void *arg;
+    unsigned int count;
+    unsigned int next;
+    unsigned long generation;
+    // Started threads still working on this generation
+    unsigned int busy;
+    bool stopping;
+};
+
+#endif
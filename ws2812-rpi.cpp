@@ -23,101 +23,192 @@
 ###############################################################################
 */
 #include "ws2812-rpi.h"
-
-struct control_data_s* NeoPixel::ctl=0;
-uint8_t* NeoPixel::virtbase=0;
-volatile unsigned int* NeoPixel::pwm_reg=0;
-volatile unsigned int* NeoPixel::clk_reg=0;
-volatile unsigned int* NeoPixel::dma_reg=0;
-volatile unsigned int* NeoPixel::gpio_reg=0;
+#include "ws2812-rpi-effects.h"
 
 // PUBLIC
 
-NeoPixel::NeoPixel(unsigned int n)
-    : numLEDs(n)
+NeoPixel::NeoPixel(unsigned int n, unsigned int flags)
+    : flags(flags), encodePool(0), encodeWords(0), directEncode(false),
+      rangeErrors(0), overran(false), statsInterval(0), statsWritten(0),
+      recorder(0), recordStart(0), viewsReady(0),
+      pixelDataRefs(0), pixelDataMapped(false),
+      page_map(0), virtbase(0), numPages(0),
+      backBuffer(0), transferPending(false), framePending(false),
+      completionFD(-1)
 {
-    LEDBuffer.resize(n);
+    transport = WS2812Transport::create(flags);
+    swapBytes = transport->swapBytes();
+
+    // In dual channel mode n is the length of each strip, and the second
+    // strip follows the first in the LED buffer
+    numChannels = (flags & NEOPIXEL_DUAL_CHANNEL) ? 2 : 1;
+    if(numChannels > transport->maxChannels()) {
+        printf("%s output has only one channel, driving one strip\n", transport->name());
+        numChannels = 1;
+    }
+    channelLEDs = n;
+    numLEDs = n * numChannels;
+    LEDBuffer.resize(numLEDs);
+
+    // The pixel format's encoder is picked once here; every frame after that
+    // goes through the one compiled for it
+    encodeFn = WS2812Encoder::encoderFor(flags);
+    colorChannels = WS2812Encoder::channelsFor(flags);
+    groupWords = DIRTY_GROUP_LEDS * colorChannels * 3 / 4;
+    if(colorChannels == 4) {
+        whiteBuffer.resize(numLEDs);
+    }
     brightness=DEFAULT_BRIGHTNESS;
+    gamma=DEFAULT_GAMMA;
+    whiteBalance=Color_t(255, 255, 255);
+    WS2812Encoder::buildLUT(lut, brightness, gamma, whiteBalance);
+
+    // Every frame ends with a zero word to leave the line low. The channels
+    // share the FIFO, so the DMA buffer holds their words interleaved.
+    channelWords = WS2812Encoder::wordsForLEDs(n, colorChannels) + 1;
+    frameWords = channelWords * numChannels;
+
+    // One bit per group of DIRTY_GROUP_LEDS, numbered per channel so a group
+    // never straddles two strips. Everything starts dirty so the first
+    // show() always goes out.
+    channelGroups = (n + DIRTY_GROUP_LEDS - 1) / DIRTY_GROUP_LEDS;
+    dirtyMap.resize((channelGroups * numChannels + 1 + 31) / 32);
+    frameDirty.resize(dirtyMap.size());
+    for(unsigned int i = 0; i < NUM_BUFFERS; i++) {
+        staleMap[i].resize(dirtyMap.size());
+    }
+    dirtyGroups = 0;
+    encodedPixels = 0;
+    markAllDirty();
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_init(&viewLock, NULL);
 
     initHardware();
     clearLEDBuffer();
 }
 
 NeoPixel::~NeoPixel(){
+    for(unsigned int i = 0; i < views.size(); i++) {
+        delete views[i];
+    }
+    stopRecording();
     terminate(0);
+    delete encodePool;
+    pthread_mutex_destroy(&viewLock);
     //delete LEDBuffer;
 }
 
 void NeoPixel::begin(){};
 
 void NeoPixel::show(){
-    int i, j;
-    unsigned int LEDBuffeWordPos = 0;
-    unsigned int PWMWaveformBitPos = 0;
-    unsigned int colorBits = 0;
-    unsigned char colorBit = 0;
-    unsigned int wireBit = 0;
-    Color_t color;
-
-    for(i=0; i<numLEDs; i++) {
-        LEDBuffer[i].r *= brightness;
-        LEDBuffer[i].g *= brightness;
-        LEDBuffer[i].b *= brightness;
-        colorBits = ((unsigned int)LEDBuffer[i].r << 8) | ((unsigned int)LEDBuffer[i].g << 16) | LEDBuffer[i].b;
-
-        for(j=23; j>=0; j--) {
-            colorBit = (colorBits & (1 << j)) ? 1 : 0;
-            switch(colorBit) {
-                case 1:
-                    setPWMBit(wireBit++, 1);
-                    setPWMBit(wireBit++, 1);
-                    setPWMBit(wireBit++, 0);
-                    break;
-                case 0:
-                    setPWMBit(wireBit++, 1);
-                    setPWMBit(wireBit++, 0);
-                    setPWMBit(wireBit++, 0);
-                    break;
-            }
-        }
+    if(encodeFrame()) {
+        sendFrame();
+    }
+};
+
+bool NeoPixel::encodeFrame(){
+    // Nothing changed, nothing to send
+    if(!prepareFrame()) {
+        statAdd(stats.framesSkipped);
+        statsTick();
+        return false;
+    }
+    if(recorder) {
+        recordFrame();
     }
+    return true;
+}
+
+void NeoPixel::sendFrame(){
+    struct timespec waitStart;
+
+    // The idle buffer was filled while the previous frame was still on the
+    // wire, hand it over as soon as that one has latched
+    clock_gettime(CLOCK_MONOTONIC, &waitStart);
+    waitTransfer();
+    statTime(stats.waitHist, stats.waitMaxUS, stats.waitLastUS, stats.waitSumUS, waitStart);
+    startTransfer(backBuffer);
+    backBuffer = (backBuffer + 1) % NUM_BUFFERS;
+    framePending = false;
+    statsTick();
+}
 
-    ctl = (struct control_data_s *)virtbase;
-    dma_cb_t *cbp = ctl->cb;
+bool NeoPixel::submit(){
+    if(!prepareFrame()) {
+        statAdd(stats.framesSkipped);
+        statsTick();
+        return !framePending;
+    }
+    if(recorder) {
+        recordFrame();
+    }
+    if(transferPending && !transferFinished()) {
+        // Goes out from handleCompletion() once the wire is free. Submitting
+        // again before then just replaces it.
+        if(framePending) {
+            statAdd(stats.framesReplaced);
+        }
+        framePending = true;
+        statsTick();
+        return false;
+    }
+    startTransfer(backBuffer);
+    backBuffer = (backBuffer + 1) % NUM_BUFFERS;
+    framePending = false;
+    statsTick();
+    return true;
+}
 
-    for(i = 0; i < (cbp->length / 4); i++) {
-        ctl->sample[i] = PWMWaveform[i];
+int NeoPixel::getCompletionFD(){
+    if(completionFD < 0) {
+        completionFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if(completionFD < 0) {
+            printf("Unable to create completion timer: %s\n", strerror(errno));
+        } else if(transferPending) {
+            armCompletion();
+        }
     }
+    return completionFD;
+}
 
-    startTransfer();
+bool NeoPixel::handleCompletion(){
+    uint64_t expirations;
 
-    float bitTimeUSec = (float)(NUM_DATA_WORDS * 32) * 0.4;
-    usleep((int)bitTimeUSec);
-};
+    if(completionFD >= 0) {
+        while(read(completionFD, &expirations, sizeof(expirations)) > 0);
+    }
 
-unsigned char NeoPixel::setPixelColor(unsigned int pixel, unsigned char r, unsigned char g, unsigned char b){
-    if(pixel < 0) {
-        printf("Unable to set pixel %d (less than zero?)\n", pixel);
-        return false;
+    if(!transferPending) {
+        return true;
     }
-    if(pixel > numLEDs - 1) {
-        printf("Unable to set pixel %d (LED buffer is %d pixels long)\n", pixel, numLEDs);
+    if(!transferFinished()) {
+        // Woken early or the DMA is running late; look again shortly
+        armCompletion();
         return false;
     }
-    LEDBuffer[pixel] = RGB2Color(r, g, b);
+
+    if(framePending) {
+        startTransfer(backBuffer);
+        backBuffer = (backBuffer + 1) % NUM_BUFFERS;
+        framePending = false;
+    }
     return true;
 }
 
+bool NeoPixel::busy(){
+    return (transferPending && !transferFinished()) || framePending;
+}
+
+unsigned char NeoPixel::setPixelColor(unsigned int pixel, unsigned char r, unsigned char g, unsigned char b){
+    return setPixelColor(pixel, RGB2Color(r, g, b));
+}
+
 unsigned char NeoPixel::setPixelColor(unsigned int pixel, Color_t c){
-    if(pixel < 0) {
-        printf("Unable to set pixel %d (less than zero?)\n", pixel);
-        return false;
-    }
-    if(pixel > numLEDs - 1) {
-        printf("Unable to set pixel %d (LED buffer is %d pixels long)\n", pixel, numLEDs);
+    if(pixel >= numLEDs) {
+        rangeError();
         return false;
     }
-    LEDBuffer[pixel] = c;
+    setPixelUnchecked(pixel, c);
     return true;
 }
 
@@ -130,22 +221,241 @@ bool NeoPixel::setBrightness(float b){
         printf("Brightness can't be set above 1.\n");
         return false;
     }
-    brightness = b;
+    if(b != brightness) {
+        brightness = b;
+        WS2812Encoder::buildLUT(lut, brightness, gamma, whiteBalance);
+        markAllDirty();
+    }
+    return true;
+}
+
+bool NeoPixel::setGamma(float g){
+    if(g <= 0) {
+        printf("Gamma must be above 0.\n");
+        return false;
+    }
+    if(g != gamma) {
+        gamma = g;
+        WS2812Encoder::buildLUT(lut, brightness, gamma, whiteBalance);
+        markAllDirty();
+    }
+    return true;
+}
+
+void NeoPixel::setWhiteBalance(unsigned char r, unsigned char g, unsigned char b){
+    Color_t white(r, g, b);
+
+    if(!(white == whiteBalance)) {
+        whiteBalance = white;
+        WS2812Encoder::buildLUT(lut, brightness, gamma, whiteBalance);
+        markAllDirty();
+    }
+}
+
+unsigned char NeoPixel::setPixelWhite(unsigned int pixel, unsigned char w){
+    if(pixel >= whiteBuffer.size()) {
+        rangeError();
+        return false;
+    }
+    if(whiteBuffer[pixel] != w) {
+        whiteBuffer[pixel] = w;
+        markDirty(pixel);
+    }
     return true;
 }
 
+unsigned char NeoPixel::getPixelWhite(unsigned int pixel){
+    if(pixel >= whiteBuffer.size()) {
+        rangeError();
+        return 0;
+    }
+    return whiteBuffer[pixel];
+}
+
+unsigned int NeoPixel::getColorChannels(){ return colorChannels; }
+
 //Color_t* NeoPixel::getPixels(){ return &LEDBuffer[0]; }
 std::vector<Color_t> NeoPixel::getPixels(){ return LEDBuffer; }
 
+unsigned char NeoPixel::setPixels(unsigned int first, const Color_t *colors, unsigned int count){
+    unsigned int i;
+
+    if(!inRange(first, count)) {
+        return false;
+    }
+    for(i=0; i<count; i++) {
+        setPixelUnchecked(first + i, colors[i]);
+    }
+    return true;
+}
+
+unsigned char NeoPixel::fill(unsigned int first, unsigned int count, Color_t c){
+    unsigned int i;
+
+    if(!inRange(first, count)) {
+        return false;
+    }
+    for(i=0; i<count; i++) {
+        setPixelUnchecked(first + i, c);
+    }
+    return true;
+}
+
+unsigned char NeoPixel::copyWithin(unsigned int dest, unsigned int src, unsigned int count){
+    unsigned int i;
+
+    if(!inRange(dest, count) || !inRange(src, count)) {
+        return false;
+    }
+    // Copy away from the overlap, like memmove
+    if(dest < src) {
+        for(i=0; i<count; i++) {
+            setPixelUnchecked(dest + i, LEDBuffer[src + i]);
+            if(!whiteBuffer.empty()) {
+                setPixelWhite(dest + i, whiteBuffer[src + i]);
+            }
+        }
+    } else if(dest > src) {
+        for(i=count; i>0; i--) {
+            setPixelUnchecked(dest + i - 1, LEDBuffer[src + i - 1]);
+            if(!whiteBuffer.empty()) {
+                setPixelWhite(dest + i - 1, whiteBuffer[src + i - 1]);
+            }
+        }
+    }
+    return true;
+}
+
+unsigned long NeoPixel::getRangeErrors(){ return statLoad(rangeErrors); }
+
+NeoPixelStats NeoPixel::getStats(){
+    NeoPixelStats s;
+    unsigned int i;
+
+    s.framesShown = statLoad(stats.framesShown);
+    s.framesSkipped = statLoad(stats.framesSkipped);
+    s.framesReplaced = statLoad(stats.framesReplaced);
+    s.underruns = statLoad(stats.underruns);
+    s.fifoErrors = statLoad(stats.fifoErrors);
+    s.dmaErrors = statLoad(stats.dmaErrors);
+    s.rangeErrors = statLoad(rangeErrors);
+    for(i = 0; i < STATS_BUCKETS; i++) {
+        s.encodeHist[i] = statLoad(stats.encodeHist[i]);
+        s.waitHist[i] = statLoad(stats.waitHist[i]);
+    }
+    s.encodeMaxUS = statLoad(stats.encodeMaxUS);
+    s.encodeLastUS = statLoad(stats.encodeLastUS);
+    s.encodeSumUS = statLoad(stats.encodeSumUS);
+    s.waitMaxUS = statLoad(stats.waitMaxUS);
+    s.waitLastUS = statLoad(stats.waitLastUS);
+    s.waitSumUS = statLoad(stats.waitSumUS);
+    return s;
+}
+
+bool NeoPixel::writeStats(const char *path){
+    static const char *hists[] = { "encode", "wait" };
+    NeoPixelStats s = getStats();
+    std::string tmp = std::string(path) + ".tmp";
+    FILE *f;
+    unsigned long count;
+    unsigned int h, b;
+
+    f = fopen(tmp.c_str(), "w");
+    if(!f) {
+        printf("Unable to write statistics to %s: %s\n", tmp.c_str(), strerror(errno));
+        return false;
+    }
+
+    fprintf(f, "# TYPE ws2812_frames_shown_total counter\n");
+    fprintf(f, "ws2812_frames_shown_total %lu\n", s.framesShown);
+    fprintf(f, "# TYPE ws2812_frames_skipped_total counter\n");
+    fprintf(f, "ws2812_frames_skipped_total %lu\n", s.framesSkipped);
+    fprintf(f, "# TYPE ws2812_frames_replaced_total counter\n");
+    fprintf(f, "ws2812_frames_replaced_total %lu\n", s.framesReplaced);
+    fprintf(f, "# TYPE ws2812_underruns_total counter\n");
+    fprintf(f, "ws2812_underruns_total %lu\n", s.underruns);
+    fprintf(f, "# TYPE ws2812_fifo_errors_total counter\n");
+    fprintf(f, "ws2812_fifo_errors_total %lu\n", s.fifoErrors);
+    fprintf(f, "# TYPE ws2812_dma_errors_total counter\n");
+    fprintf(f, "ws2812_dma_errors_total %lu\n", s.dmaErrors);
+    fprintf(f, "# TYPE ws2812_range_errors_total counter\n");
+    fprintf(f, "ws2812_range_errors_total %lu\n", s.rangeErrors);
+
+    // Bucket b holds whole microsecond times up to 2^b - 1
+    for(h = 0; h < 2; h++) {
+        unsigned long *hist = h ? s.waitHist : s.encodeHist;
+
+        fprintf(f, "# TYPE ws2812_%s_us histogram\n", hists[h]);
+        for(b = 0, count = 0; b < STATS_BUCKETS; b++) {
+            count += hist[b];
+            if(b < STATS_BUCKETS - 1) {
+                fprintf(f, "ws2812_%s_us_bucket{le=\"%lu\"} %lu\n", hists[h], (1UL << b) - 1, count);
+            } else {
+                fprintf(f, "ws2812_%s_us_bucket{le=\"+Inf\"} %lu\n", hists[h], count);
+            }
+        }
+        fprintf(f, "ws2812_%s_us_sum %lu\n", hists[h], h ? s.waitSumUS : s.encodeSumUS);
+        fprintf(f, "ws2812_%s_us_count %lu\n", hists[h], count);
+        fprintf(f, "# TYPE ws2812_%s_max_us gauge\n", hists[h]);
+        fprintf(f, "ws2812_%s_max_us %lu\n", hists[h], h ? s.waitMaxUS : s.encodeMaxUS);
+    }
+
+    if(fclose(f) != 0 || rename(tmp.c_str(), path) != 0) {
+        printf("Unable to write statistics to %s: %s\n", path, strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool NeoPixel::startRecording(const char *path, unsigned int keyInterval){
+    stopRecording();
+    recorder = AnimationRecorder::create(path, numLEDs, keyInterval);
+    recordStart = millis();
+    return recorder != 0;
+}
+
+bool NeoPixel::stopRecording(){
+    bool ok;
+
+    if(!recorder) {
+        return false;
+    }
+    ok = recorder->close();
+    delete recorder;
+    recorder = 0;
+    return ok;
+}
+
+void NeoPixel::setStatsFile(const char *path, unsigned int intervalMS){
+    statsPath = path ? path : "";
+    statsInterval = intervalMS;
+    statsWritten = 0;
+}
+
+Color_t* NeoPixel::getPixelData(){
+    if(pixelDataRefs++ == 0 && !pixelDataMapped) {
+        shownPixels = LEDBuffer;
+        pixelDataMapped = true;
+    }
+    return LEDBuffer.data();
+}
+
+void NeoPixel::releasePixelData(){
+    if(pixelDataRefs > 0) {
+        pixelDataRefs--;
+    }
+}
+
 float NeoPixel::getBrightness(){ return brightness; }
 
+float NeoPixel::getGamma(){ return gamma; }
+
+Color_t NeoPixel::getWhiteBalance(){ return whiteBalance; }
+
 Color_t NeoPixel::getPixelColor(unsigned int pixel){
-    if(pixel < 0) {
-        printf("Unable to get pixel %d (less than zero?)\n", pixel);
-        return RGB2Color(0, 0, 0);
-    }
-    if(pixel > numLEDs - 1) {
-        printf("Unable to get pixel %d (LED buffer is %d pixels long)\n", pixel, numLEDs);
+    if(pixel >= numLEDs) {
+        rangeError();
         return RGB2Color(0, 0, 0);
     }
     return LEDBuffer[pixel];
@@ -155,7 +465,331 @@ unsigned int NeoPixel::numPixels(){ return numLEDs; }
 
 void NeoPixel::clear(){ clearLEDBuffer(); }
 
+float NeoPixel::getEncodedPercent(){
+    return numLEDs ? 100.0 * encodedPixels / numLEDs : 0;
+}
+
+bool NeoPixel::setEncodeThreads(unsigned int threads){
+    WorkerPool *pool = 0;
+
+    if(threads == 0) {
+        threads = WorkerPool::numCores();
+    }
+    if(threads > 1 && (pool = WorkerPool::create(threads)) == 0) {
+        return false;
+    }
+    delete encodePool;
+    encodePool = pool;
+    return true;
+}
+
+unsigned int NeoPixel::getEncodeThreads(){ return encodePool ? encodePool->numThreads() : 1; }
+
+bool NeoPixel::setDirectEncode(bool direct){
+    directEncode = direct && virtbase && numChannels == 1;
+    if(directEncode) {
+        std::vector<unsigned int>().swap(PWMWaveform);
+    } else {
+        clearPWMBuffer();
+    }
+    // Neither the buffers nor PWMWaveform can be trusted to be up to date
+    markAllDirty();
+    return directEncode;
+}
+
+unsigned int NeoPixel::getNumChannels(){ return numChannels; }
+
+NeoPixelSegment NeoPixel::channel(unsigned int c){
+    if(c >= numChannels) {
+        printf("Unable to get channel %d (strip has %d channels)\n", c, numChannels);
+        return NeoPixelSegment(this, 0, 0);
+    }
+    return NeoPixelSegment(this, c * channelLEDs, channelLEDs);
+}
+
+NeoPixelView* NeoPixel::createView(unsigned int offset, unsigned int length){
+    NeoPixelView *view;
+
+    if(!inRange(offset, length)) {
+        printf("Unable to create a view of %d pixels at %d (strip has %d)\n", length, offset, numLEDs);
+        return 0;
+    }
+    view = new NeoPixelView(this, offset, length);
+    pthread_mutex_lock(&viewLock);
+    views.push_back(view);
+    pthread_mutex_unlock(&viewLock);
+    return view;
+}
+
+void NeoPixel::releaseView(NeoPixelView *view){
+    std::vector<NeoPixelView*>::iterator it;
+
+    pthread_mutex_lock(&viewLock);
+    it = std::find(views.begin(), views.end(), view);
+    if(it != views.end()) {
+        if(view->ready) {
+            viewsReady--;
+        }
+        views.erase(it);
+        delete view;
+
+        // The rest may have been waiting on this one
+        if(!views.empty()) {
+            flushViews();
+        }
+    }
+    pthread_mutex_unlock(&viewLock);
+}
+
+unsigned int NeoPixel::numViews(){
+    unsigned int n;
+
+    pthread_mutex_lock(&viewLock);
+    n = views.size();
+    pthread_mutex_unlock(&viewLock);
+    return n;
+}
+
 // PRIVATE
+
+// Sends the frame once every view has committed to it. Called with viewLock
+// held, so only one commit can send it.
+bool NeoPixel::flushViews(){
+    if(viewsReady < views.size()) {
+        return false;
+    }
+    for(unsigned int i = 0; i < views.size(); i++) {
+        views[i]->ready = false;
+    }
+    viewsReady = 0;
+    submit();
+    return true;
+}
+
+bool NeoPixel::prepareFrame(){
+    struct timespec encodeStart;
+    unsigned int first, last, g, i;
+
+    if(pixelDataMapped) {
+        findMappedChanges();
+    }
+
+    if(__atomic_load_n(&dirtyGroups, __ATOMIC_RELAXED) == 0) {
+        encodedPixels = 0;
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &encodeStart);
+
+    if(directEncode) {
+        // Every buffer is now out of date where pixels changed, and the idle
+        // one is brought up to date by encoding straight into it, which is
+        // safe while the other one is still on the wire. Groups that changed
+        // for the last frame are encoded again, as they were only written to
+        // the buffer that frame went out from. A strip whose output couldn't
+        // be set up has no buffers at all.
+        markStale();
+        encodedPixels = virtbase ? encodeGroups(staleMap[backBuffer], sample[backBuffer]) : 0;
+        std::fill(staleMap[backBuffer].begin(), staleMap[backBuffer].end(), 0);
+
+        statTime(stats.encodeHist, stats.encodeMaxUS, stats.encodeLastUS, stats.encodeSumUS, encodeStart);
+        return true;
+    }
+
+    // Re-encode runs of dirty groups into the master waveform and note that
+    // every DMA buffer is now out of date there
+    markStale();
+    encodedPixels = encodeGroups(frameDirty, &PWMWaveform[0]);
+
+    // Bring the idle buffer up to date, which is safe while the other one is
+    // still on the wire. With two channels their words alternate in the FIFO.
+    for(g = 0; virtbase && nextGroup(staleMap[backBuffer], g, first, last); ) {
+        unsigned int c = first / channelGroups;
+        unsigned int *words = &PWMWaveform[c * channelWords];
+        uint32_t *dst = sample[backBuffer] + c;
+        unsigned int start = (first - c * channelGroups) * groupWords;
+        unsigned int end;
+
+        g = std::min(last, (c + 1) * channelGroups);
+        end = std::min((g - c * channelGroups) * groupWords, channelWords);
+
+        if(swapBytes) {
+            for(i = start; i < end; i++) {
+                dst[i * numChannels] = __builtin_bswap32(words[i]);
+            }
+        } else if(numChannels == 1) {
+            memcpy(dst + start, words + start, (end - start) * 4);
+        } else {
+            for(i = start; i < end; i++) {
+                dst[i * numChannels] = words[i];
+            }
+        }
+    }
+    std::fill(staleMap[backBuffer].begin(), staleMap[backBuffer].end(), 0);
+
+    statTime(stats.encodeHist, stats.encodeMaxUS, stats.encodeLastUS, stats.encodeSumUS, encodeStart);
+    return true;
+}
+
+// Takes the dirty bits a word at a time, so a bit set meanwhile by another
+// thread is either in this frame or left for the next, never lost
+void NeoPixel::markStale(){
+    unsigned int i, b;
+    uint32_t bits;
+
+    for(i = 0; i < dirtyMap.size(); i++) {
+        bits = __atomic_exchange_n(&dirtyMap[i], 0, __ATOMIC_ACQUIRE);
+        for(b = 0; b < NUM_BUFFERS; b++) {
+            staleMap[b][i] |= bits;
+        }
+        frameDirty[i] = bits;
+        if(bits) {
+            __atomic_fetch_sub(&dirtyGroups, __builtin_popcount(bits), __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Encodes the groups set in map into words, channelWords apiece per channel,
+// and returns the number of LEDs encoded
+unsigned int NeoPixel::encodeGroups(const std::vector<uint32_t>& map, unsigned int *words){
+    unsigned int first, last, g, i, piece = numLEDs, groups = 0, encoded = 0;
+    EncodeJob job;
+
+    // With workers, the LEDs are shared out evenly in whole groups, but no
+    // thread gets fewer than PARALLEL_ENCODE_MIN_LEDS
+    if(encodePool) {
+        for(i = 0; i < map.size(); i++) {
+            groups += __builtin_popcount(map[i]);
+        }
+        piece = groups * DIRTY_GROUP_LEDS / encodePool->numThreads();
+        piece = (piece + DIRTY_GROUP_LEDS - 1) / DIRTY_GROUP_LEDS * DIRTY_GROUP_LEDS;
+        piece = std::max(piece, (unsigned int)PARALLEL_ENCODE_MIN_LEDS);
+    }
+
+    encodeWords = words;
+    encodeJobs.clear();
+    for(g = 0; nextGroup(map, g, first, last); ) {
+        unsigned int c = first / channelGroups;
+        unsigned int end;
+
+        // Runs are split at the end of a channel
+        job.channel = c;
+        job.start = (first - c * channelGroups) * DIRTY_GROUP_LEDS;
+        g = std::min(last, (c + 1) * channelGroups);
+        end = std::min((g - c * channelGroups) * DIRTY_GROUP_LEDS, channelLEDs);
+
+        for(; job.start < end; job.start = job.end) {
+            job.end = std::min(end, job.start + piece);
+            encodeJobs.push_back(job);
+            encoded += job.end - job.start;
+        }
+    }
+    if(encodePool) {
+        encodePool->run(encodeTask, this, encodeJobs.size());
+    } else {
+        for(i = 0; i < encodeJobs.size(); i++) {
+            encodeTask(this, i);
+        }
+    }
+    return encoded;
+}
+
+// Brightness and gamma are applied by the lookup table on the way through,
+// the LED buffer keeps what was set. Jobs start on a group boundary, so each
+// writes its own whole words. Straight into an SPI buffer, they are swapped
+// in place while still in the cache.
+void NeoPixel::encodeTask(void *strip, unsigned int job){
+    NeoPixel *n = (NeoPixel*)strip;
+    const EncodeJob& j = n->encodeJobs[job];
+    unsigned int offset = j.start / DIRTY_GROUP_LEDS * n->groupWords;
+    unsigned int *words = n->encodeWords + j.channel * n->channelWords + offset;
+    const uint8_t *white = n->whiteBuffer.empty() ? 0 : &n->whiteBuffer[j.channel * n->channelLEDs + j.start];
+    unsigned int written, i;
+
+    written = n->encodeFn(&n->LEDBuffer[j.channel * n->channelLEDs + j.start], white, j.end - j.start,
+                          words, n->channelWords - offset, &n->lut);
+    if(n->directEncode && n->swapBytes) {
+        for(i = 0; i < written; i++) {
+            words[i] = __builtin_bswap32(words[i]);
+        }
+    }
+}
+
+// Writes through getPixelData() don't go through setPixelColor(), so while
+// it is in use each frame is compared with the last, a group at a time. The
+// first frame after the last release still needs the check.
+void NeoPixel::findMappedChanges(){
+    unsigned int i, n;
+
+    for(i = 0; i < numLEDs; i += n) {
+        n = std::min(numLEDs - i, (unsigned int)DIRTY_GROUP_LEDS);
+        if(memcmp(&LEDBuffer[i], &shownPixels[i], n * sizeof(Color_t)) != 0) {
+            memcpy(&shownPixels[i], &LEDBuffer[i], n * sizeof(Color_t));
+            markDirty(i);
+        }
+    }
+    if(pixelDataRefs == 0) {
+        pixelDataMapped = false;
+        std::vector<Color_t>().swap(shownPixels);
+    }
+}
+
+void NeoPixel::markDirty(unsigned int pixel){
+    unsigned int c = pixel / channelLEDs;
+    unsigned int g = c * channelGroups + (pixel - c * channelLEDs) / DIRTY_GROUP_LEDS;
+    uint32_t bit = 1u << (g & 31);
+
+    // Only the first change to a group in a frame pays for the atomics. The
+    // release pairs with markStale(), so the pixel is there when it is seen.
+    if(!(__atomic_load_n(&dirtyMap[g >> 5], __ATOMIC_RELAXED) & bit) &&
+       !(__atomic_fetch_or(&dirtyMap[g >> 5], bit, __ATOMIC_RELEASE) & bit)) {
+        __atomic_fetch_add(&dirtyGroups, 1, __ATOMIC_RELAXED);
+    }
+}
+
+bool NeoPixel::inRange(unsigned int first, unsigned int count){
+    if(first > numLEDs || count > numLEDs - first) {
+        rangeError();
+        return false;
+    }
+    return true;
+}
+
+void NeoPixel::markAllDirty(){
+    unsigned int groups = channelGroups * numChannels;
+    unsigned int i, n;
+    uint32_t bits, was;
+
+    for(i = 0; i * 32 < groups; i++) {
+        n = std::min(groups - i * 32, 32u);
+        bits = n == 32 ? 0xffffffffu : (1u << n) - 1;
+        was = __atomic_fetch_or(&dirtyMap[i], bits, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&dirtyGroups, __builtin_popcount(bits & ~was), __ATOMIC_RELAXED);
+    }
+}
+
+// Finds the next run of set bits at or after group g, as [first, last)
+bool NeoPixel::nextGroup(const std::vector<uint32_t>& map, unsigned int g,
+                         unsigned int& first, unsigned int& last){
+    unsigned int size = map.size() * 32;
+    uint32_t bits;
+
+    while(g < size) {
+        bits = map[g >> 5] >> (g & 31);
+        if(bits == 0) {
+            g = (g | 31) + 1;
+            continue;
+        }
+        g += __builtin_ctz(bits);
+        first = g;
+        while(g < size && (map[g >> 5] & (1u << (g & 31)))) {
+            g++;
+        }
+        last = g;
+        return true;
+    }
+    return false;
+}
+
 void NeoPixel::printBinary(unsigned int i, unsigned int bits){
     int x;
     for(x=bits-1; x>=0; x--) {
@@ -183,27 +817,41 @@ unsigned int NeoPixel::reverseWord(unsigned int word){
 }
 
 void NeoPixel::terminate(int dummy){
-    if(dma_reg) {
-        CLRBIT(dma_reg[DMA_CS], DMA_CS_ACTIVE);
-        usleep(100);
-        SETBIT(dma_reg[DMA_CS], DMA_CS_RESET);
-        usleep(100);
+    // Let the last frame finish rather than cutting it off
+    if(virtbase) {
+        waitTransfer();
+        if(framePending) {
+            startTransfer(backBuffer);
+            framePending = false;
+            waitTransfer();
+        }
     }
 
-    // Shut down PWM
-    if(pwm_reg) {
-        CLRBIT(pwm_reg[PWM_CTL], PWM_CTL_PWEN1);
-        usleep(100);
-        pwm_reg[PWM_CTL] = (1 << PWM_CTL_CLRF1);
+    if(transport) {
+        transport->stop();
     }
     
+    if(completionFD >= 0) {
+        close(completionFD);
+        completionFD = -1;
+    }
+
     // Free the allocated memory
+    if(transport != 0) {
+        delete transport;
+        transport = 0;
+    }
     if(page_map != 0) {
         free(page_map);
+        page_map = 0;
+    }
+    if(virtbase != 0) {
+        munmap(virtbase, numPages * PAGE_SIZE);
+        virtbase = 0;
     }
 }
 
-void NeoPixel::fatal(char *fmt, ...){
+void NeoPixel::fatal(const char *fmt, ...){
     va_list ap;
     va_start(ap, fmt);
     vfprintf(stderr, fmt, ap);
@@ -216,46 +864,29 @@ unsigned int NeoPixel::mem_virt_to_phys(void *virt){
     return page_map[offset >> PAGE_SHIFT].physaddr + (offset % PAGE_SIZE);    
 }
 
-unsigned int NeoPixel::mem_phys_to_virt(uint32_t phys){
+uint8_t* NeoPixel::mem_phys_to_virt(uint32_t phys){
     unsigned int pg_offset = phys & (PAGE_SIZE - 1);
     unsigned int pg_addr = phys - pg_offset;
-    int i;
+    std::vector<std::pair<uint32_t, unsigned int> >::iterator it;
 
-    for (i = 0; i < NUM_PAGES; i++) {
-        if (page_map[i].physaddr == pg_addr) {
-            return (uint32_t)virtbase + i * PAGE_SIZE + pg_offset;
-        }
+    it = std::lower_bound(physIndex.begin(), physIndex.end(), std::make_pair(pg_addr, 0u));
+    if (it != physIndex.end() && it->first == pg_addr) {
+        return virtbase + it->second * PAGE_SIZE + pg_offset;
     }
     fatal("Failed to reverse map phys addr %08x\n", phys);
 
     return 0;    
 }
 
-void* NeoPixel::map_peripheral(uint32_t base, uint32_t len){
-    int fd = open("/dev/mem", O_RDWR);
-    void * vaddr;
-
-    if (fd < 0)
-        fatal("Failed to open /dev/mem: %m\n");
-    vaddr = mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, base);
-    if (vaddr == MAP_FAILED)
-        fatal("Failed to map peripheral at 0x%08x: %m\n", base);
-    close(fd);
-
-    return vaddr;    
-}
-
 void NeoPixel::clearPWMBuffer(){
-    memset(PWMWaveform, 0, NUM_DATA_WORDS * 4);
+    PWMWaveform.assign(frameWords, 0);
 }
 
 void NeoPixel::clearLEDBuffer(){
-    int i;
-    for(i=0; i<numLEDs; i++) {
-        LEDBuffer[i].r = 0;
-        LEDBuffer[i].g = 0;
-        LEDBuffer[i].b = 0;
-    }    
+    fill(0, numLEDs, RGB2Color(0, 0, 0));
+    for(unsigned int i = 0; i < whiteBuffer.size(); i++) {
+        setPixelWhite(i, 0);
+    }
 }
 
 Color_t NeoPixel::RGB2Color(unsigned char r, unsigned char g, unsigned char b){
@@ -268,200 +899,301 @@ Color_t NeoPixel::Color(unsigned char r, unsigned char g, unsigned char b){
     return RGB2Color(r, g, b);
 }
 
-void NeoPixel::setPWMBit(unsigned int bitPos, unsigned char bit){
-    unsigned int wordOffset = (int)(bitPos / 32);
-    unsigned int bitIdx = bitPos - (wordOffset * 32);
-
-    switch(bit) {
-        case 1:
-            PWMWaveform[wordOffset] |= (1 << (31 - bitIdx));
-            break;
-        case 0:
-            PWMWaveform[wordOffset] &= ~(1 << (31 - bitIdx));
-            break;
-    }
-}
-
-unsigned char NeoPixel::getPWMBit(unsigned int bitPos){
-    unsigned int wordOffset = (int)(bitPos / 32);
-    unsigned int bitIdx = bitPos - (wordOffset * 32);
-
-    if(PWMWaveform[wordOffset] & (1 << bitIdx)) {
-        return true;
-    } else {
-        return false;
-    }    
-}
-
-void NeoPixel::initHardware(){
-    int i = 0;
+// Each buffer is sized for the strip and gets a chain of control blocks, one
+// per run of physically contiguous pages, so the pages can be anywhere
+void NeoPixel::allocDMAMemory(){
+    unsigned int pagesPerBuffer = (frameWords * 4 + PAGE_SIZE - 1) / PAGE_SIZE;
+    unsigned int cbPages = (NUM_BUFFERS * pagesPerBuffer * sizeof(dma_cb_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    unsigned int i, b;
     int pid;
     int fd;
     char pagemap_fn[64];
 
-    // Clear the PWM buffer
-    clearPWMBuffer();
-
-    // Set up peripheral access
-    dma_reg = (unsigned int*) map_peripheral(DMA_BASE, DMA_LEN);
-    dma_reg += 0x000;
-    pwm_reg = (unsigned int*)map_peripheral(PWM_BASE, PWM_LEN);
-    clk_reg = (unsigned int*)map_peripheral(CLK_BASE, CLK_LEN);
-    gpio_reg = (unsigned int*)map_peripheral(GPIO_BASE, GPIO_LEN);
-
-
-    // Set PWM alternate function for GPIO18
-    SET_GPIO_ALT(18, 5);
-
-    // Allocate memory for the DMA control block & data to be sent
+    numPages = cbPages + NUM_BUFFERS * pagesPerBuffer;
     virtbase = (uint8_t*) mmap(
         NULL,
-        NUM_PAGES * PAGE_SIZE,
+        numPages * PAGE_SIZE,
         PROT_READ | PROT_WRITE,
         MAP_SHARED |
         MAP_ANONYMOUS |
         MAP_NORESERVE |
-        MAP_LOCKED,
+        (transport->emulated() ? 0 : MAP_LOCKED),
         -1,
         0);
 
     if (virtbase == MAP_FAILED) {
+        virtbase = 0;
         fatal("Failed to mmap physical pages: %m\n");
+        return;
     }
 
+    // fatal() tears everything down, the transport and these pages
+    // included, so nothing here may carry on after one
     if ((unsigned long)virtbase & (PAGE_SIZE-1)) {
         fatal("Virtual address is not page aligned\n");
+        return;
     }
 
     // Allocate page map (pointers to the control block(s) and data for each CB
-    page_map =(page_map_t*) malloc(NUM_PAGES * sizeof(*page_map));
-    if (page_map == 0)
+    page_map =(page_map_t*) malloc(numPages * sizeof(*page_map));
+    if (page_map == 0) {
         fatal("Failed to malloc page_map: %m\n");
-
-    pid = getpid();
-    sprintf(pagemap_fn, "/proc/%d/pagemap", pid);
-    fd = open(pagemap_fn, O_RDONLY);
-
-    if (fd < 0) {
-        fatal("Failed to open %s: %m\n", pagemap_fn);
+        return;
     }
 
-    if (lseek(fd, (unsigned long)virtbase >> 9, SEEK_SET) != (unsigned long)virtbase >> 9) {
-        fatal("Failed to seek on %s: %m\n", pagemap_fn);
-    }
+    if(transport->emulated()) {
+        // Any distinct page aligned bus addresses will do for the stand-in.
+        // Swapping pairs of pages gives runs of two contiguous pages with
+        // jumps between them, so the chaining gets exercised.
+        for (i = 0; i < numPages; i++) {
+            page_map[i].virtaddr = virtbase + i * PAGE_SIZE;
+            page_map[i].physaddr = ((i ^ 2) << PAGE_SHIFT) | 0x40000000;
+        }
+    } else {
+        pid = getpid();
+        sprintf(pagemap_fn, "/proc/%d/pagemap", pid);
+        fd = open(pagemap_fn, O_RDONLY);
 
-    for (i = 0; i < NUM_PAGES; i++) {
-        uint64_t pfn;
-        page_map[i].virtaddr = virtbase + i * PAGE_SIZE;
+        if (fd < 0) {
+            fatal("Failed to open %s: %m\n", pagemap_fn);
+            return;
+        }
 
-        page_map[i].virtaddr[0] = 0;
+        for (i = 0; i < numPages; i++) {
+            page_map[i].virtaddr = virtbase + i * PAGE_SIZE;
+            page_map[i].virtaddr[0] = 0;
+        }
 
-        if (read(fd, &pfn, sizeof(pfn)) != sizeof(pfn)) {
+        // One 8 byte entry per page, so the whole range comes in one read
+        // rather than a system call per page
+        std::vector<uint64_t> pfns(numPages);
+        ssize_t bytes = numPages * sizeof(uint64_t);
+        if (pread(fd, &pfns[0], bytes, (unsigned long)virtbase >> 9) != bytes) {
+            close(fd);
             fatal("Failed to read %s: %m\n", pagemap_fn);
+            return;
         }
+        close(fd);
+
+        for (i = 0; i < numPages; i++) {
+            // Bit 63 is page present
+            if (!(pfns[i] & (1ULL << 63))) {
+                fatal("Page %d not present (pfn 0x%016llx)\n", i, pfns[i]);
+                return;
+            }
 
-        if ((pfn >> 55)&0xfbf != 0x10c) {
-            fatal("Page %d not present (pfn 0x%016llx)\n", i, pfn);
+            page_map[i].physaddr = (unsigned int)pfns[i] << PAGE_SHIFT | 0x40000000;
         }
+    }
 
-        page_map[i].physaddr = (unsigned int)pfn << PAGE_SHIFT | 0x40000000;
+    // Sorted by bus address for mem_phys_to_virt()
+    physIndex.resize(numPages);
+    for (i = 0; i < numPages; i++) {
+        physIndex[i] = std::make_pair(page_map[i].physaddr, i);
     }
+    std::sort(physIndex.begin(), physIndex.end());
 
-    // Set up control block
-    ctl = (struct control_data_s *)virtbase;
-    dma_cb_t *cbp = ctl->cb;
-    unsigned int phys_pwm_fifo_addr = 0x7e20c000 + 0x18;
+    for (b = 0; b < NUM_BUFFERS; b++) {
+        cbs[b] = (dma_cb_t*)virtbase + b * pagesPerBuffer;
+        sample[b] = (uint32_t*)(virtbase + (cbPages + b * pagesPerBuffer) * PAGE_SIZE);
+        buildChain(b);
+    }
+}
 
-    cbp->info = DMA_TI_CONFIGWORD;
+void NeoPixel::buildChain(unsigned int buffer){
+    uint8_t *src = (uint8_t*)sample[buffer];
+    unsigned int bytes = frameWords * 4;
+    unsigned int offset = 0, length;
+    dma_cb_t *cbp = cbs[buffer];
+
+    while (offset < bytes) {
+        // Extend the run while the next page follows on physically
+        length = PAGE_SIZE;
+        while (offset + length < bytes &&
+               mem_virt_to_phys(src + offset + length) == mem_virt_to_phys(src + offset) + length) {
+            length += PAGE_SIZE;
+        }
+        if (offset + length > bytes) {
+            length = bytes - offset;
+        }
 
-    cbp->src = mem_virt_to_phys(ctl->sample);   
+        cbp->info = transport->dmaInfo();
+        cbp->src = mem_virt_to_phys(src + offset);
+        cbp->dst = transport->fifoAddress();
+        cbp->length = length;
+        cbp->stride = 0;
+        cbp->pad[0] = 0;
+        cbp->pad[1] = 0;
+
+        offset += length;
+        cbp->next = offset < bytes ? mem_virt_to_phys(cbp + 1) : 0;
+        cbp++;
+    }
+}
 
-    cbp->dst = phys_pwm_fifo_addr;
+void NeoPixel::initHardware(){
+    // Allocate memory for the DMA control blocks & data to be sent
+    allocDMAMemory();
+    setDirectEncode(true);
+    if(virtbase == 0 || page_map == 0 || transport == 0) {
+        return;
+    }
 
-    cbp->length = ((numLEDs * 2.25) + 1) * 4;
-    if(cbp->length > NUM_DATA_WORDS * 4) {
-        cbp->length = NUM_DATA_WORDS * 4;
+    if(!transport->init(virtbase, page_map, numPages, numChannels, frameWords * 4)) {
+        fatal("Unable to set up %s output\n", transport->name());
     }
+}
 
-    cbp->stride = 0;  
-    cbp->pad[0] = 0;
-    cbp->pad[1] = 0;   
-    cbp->next = 0;
+void NeoPixel::startTransfer(unsigned int buffer){
+    struct timespec now;
+    unsigned long long ns;
+
+    // The frame has latched once its words have gone out and the line has
+    // been held low for the latch time. The channels run side by side, so
+    // that is one channel's worth of words.
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = (unsigned long long)channelWords * 32 * PWM_BIT_NSEC +
+        LATCH_USEC * 1000ULL + now.tv_nsec;
+    transferEnd.tv_sec = now.tv_sec + ns / 1000000000ULL;
+    transferEnd.tv_nsec = ns % 1000000000ULL;
+    transferPending = true;
+    overran = false;
+    statAdd(stats.framesShown);
+    armCompletion();
+
+    if(transport) {
+        transport->start(mem_virt_to_phys(cbs[buffer]));
+    }
+}
 
-    dma_reg[DMA_CS] |= (1 << DMA_CS_ABORT);
-    usleep(100);
-    dma_reg[DMA_CS] = (1 << DMA_CS_RESET);
-    usleep(100);
+bool NeoPixel::transferActive(){
+    return transport && transport->active();
+}
 
+bool NeoPixel::transferFinished(){
+    struct timespec now;
 
-    // PWM Clock
-    clk_reg[PWM_CLK_CNTL] = 0x5A000000 | (1 << 5);
-    usleep(100);
+    if(!transferPending) {
+        return true;
+    }
 
-    CLRBIT(pwm_reg[PWM_DMAC], PWM_DMAC_ENAB);
-    usleep(100);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(now.tv_sec < transferEnd.tv_sec ||
+       (now.tv_sec == transferEnd.tv_sec && now.tv_nsec < transferEnd.tv_nsec)) {
+        return false;
+    }
+    if(transferActive()) {
+        // Should have latched by now, so the DMA has stalled somewhere
+        if(!overran) {
+            overran = true;
+            statAdd(stats.underruns);
+        }
+        return false;
+    }
+    transferPending = false;
 
-    unsigned int idiv = 400;
-    unsigned short fdiv = 0;
-    clk_reg[PWM_CLK_DIV] = 0x5A000000 | (idiv << 12) | fdiv;
-    usleep(100);
+    if(transport) {
+        TransportErrors errors = { 0, 0 };
+        transport->collectErrors(errors);
+        if(errors.fifoErrors) {
+            statAdd(stats.fifoErrors, errors.fifoErrors);
+        }
+        if(errors.dmaErrors) {
+            statAdd(stats.dmaErrors, errors.dmaErrors);
+        }
+    }
+    return true;
+}
 
-    clk_reg[PWM_CLK_CNTL] = 0x5A000015;
-    usleep(100);
+void NeoPixel::armCompletion(){
+    struct itimerspec its;
+    struct timespec now;
 
+    if(completionFD < 0) {
+        return;
+    }
 
-    // PWM
-    pwm_reg[PWM_CTL] = 0;
+    // Never arm for a time already passed with a zero value, that would
+    // disarm the timer instead
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    its.it_interval.tv_sec = 0;
+    its.it_interval.tv_nsec = 0;
+    its.it_value = transferEnd;
+    if(now.tv_sec > transferEnd.tv_sec ||
+       (now.tv_sec == transferEnd.tv_sec && now.tv_nsec >= transferEnd.tv_nsec)) {
+        // Late, so poll again in 100us
+        its.it_value = now;
+        its.it_value.tv_nsec += 100000;
+        if(its.it_value.tv_nsec >= 1000000000) {
+            its.it_value.tv_sec++;
+            its.it_value.tv_nsec -= 1000000000;
+        }
+    }
+    timerfd_settime(completionFD, TFD_TIMER_ABSTIME, &its, NULL);
+}
 
-    pwm_reg[PWM_RNG1] = 32;
-    usleep(100);
-    
-    pwm_reg[PWM_DMAC] =
-        (1 << PWM_DMAC_ENAB) |
-        (8 << PWM_DMAC_PANIC) |
-        (8 << PWM_DMAC_DREQ);
-    usleep(1000);
-    
-    SETBIT(pwm_reg[PWM_CTL], PWM_CTL_CLRF1);
-    usleep(100);
-    
-    CLRBIT(pwm_reg[PWM_CTL], PWM_CTL_RPTL1);
-    usleep(100);
-    
-    CLRBIT(pwm_reg[PWM_CTL], PWM_CTL_SBIT1);
-    usleep(100);
-    
-    CLRBIT(pwm_reg[PWM_CTL], PWM_CTL_POLA1);
-    usleep(100);
-    
-    SETBIT(pwm_reg[PWM_CTL], PWM_CTL_MODE1);
-    usleep(100);
-    
-    SETBIT(pwm_reg[PWM_CTL], PWM_CTL_USEF1);
-    usleep(100);
+void NeoPixel::waitTransfer(){
+    if(!transferPending) {
+        return;
+    }
 
-    CLRBIT(pwm_reg[PWM_CTL], PWM_CTL_MSEN1);
-    usleep(100);   
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &transferEnd, NULL) == EINTR);
+    while(!transferFinished()) {
+        usleep(10);
+    }
+}
 
-    SETBIT(dma_reg[DMA_CS], DMA_CS_INT);
-    usleep(100);
-    
-    SETBIT(dma_reg[DMA_CS], DMA_CS_END);
-    usleep(100);
-    
-    dma_reg[DMA_CONBLK_AD] = mem_virt_to_phys(ctl->cb);
-    usleep(100);
+// Only the strip's own thread writes the counters, so a plain add is enough;
+// the relaxed store just keeps other threads from seeing a torn value
+void NeoPixel::statAdd(unsigned long& counter, unsigned long n){
+    __atomic_store_n(&counter, counter + n, __ATOMIC_RELAXED);
+}
+
+unsigned long NeoPixel::statLoad(const unsigned long& counter){
+    return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+}
+
+// Pixels can be set from any thread, each owner of a view from its own, so
+// unlike the other counters this one needs a proper atomic add
+void NeoPixel::rangeError(){
+    __atomic_fetch_add(&rangeErrors, 1, __ATOMIC_RELAXED);
+}
 
-    dma_reg[DMA_DEBUG] = 7;
-    usleep(100);
+void NeoPixel::statTime(unsigned long *hist, unsigned long& maxUS, unsigned long& lastUS,
+                        unsigned long& sumUS, const struct timespec& since){
+    struct timespec now;
+    unsigned long us;
+    unsigned int b;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    us = (now.tv_sec - since.tv_sec) * 1000000L + (now.tv_nsec - since.tv_nsec) / 1000;
+    b = us ? 32 - __builtin_clz((uint32_t)std::min(us, 0xffffffffUL)) : 0;
+    statAdd(hist[std::min(b, (unsigned int)STATS_BUCKETS - 1)]);
+    if(us > maxUS) {
+        __atomic_store_n(&maxUS, us, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&lastUS, us, __ATOMIC_RELAXED);
+    statAdd(sumUS, us);
+}
+
+void NeoPixel::recordFrame(){
+    if(!recorder->addFrame(LEDBuffer.data(), millis() - recordStart)) {
+        // Out of space or the like; the frames so far are still playable
+        stopRecording();
+    }
 }
 
-void NeoPixel::startTransfer(){
-    dma_reg[DMA_CONBLK_AD] = mem_virt_to_phys(ctl->cb);
-    dma_reg[DMA_CS] = DMA_CS_CONFIGWORD | (1 << DMA_CS_ACTIVE);
-    usleep(100);
+void NeoPixel::statsTick(){
+    unsigned long now;
 
-    SETBIT(pwm_reg[PWM_CTL], PWM_CTL_PWEN1);    
+    if(statsPath.empty()) {
+        return;
+    }
+    now = millis();
+    if(statsWritten == 0 || now - statsWritten >= statsInterval) {
+        writeStats(statsPath.c_str());
+        statsWritten = now;
+    }
 }
 
 Color_t NeoPixel::wheel(uint8_t wheelPos) {
@@ -476,73 +1208,48 @@ Color_t NeoPixel::wheel(uint8_t wheelPos) {
     }
 }
 
-void NeoPixel::colorWipe(Color_t c, uint8_t wait) {
-    uint16_t i;
-    for(i=0; i<numPixels(); i++) {
-        setPixelColor(i, c);
-        show();
-        usleep(wait * 1000);
-    }
+// The effects are frame generators from ws2812-rpi-effects.h, run here on the
+// whole strip one frame per wait milliseconds from the frame scheduler. They
+// take the same time whatever the strip length; frames that can't be sent in
+// time are skipped rather than slowing the effect down.
+float NeoPixel::effectFPS(uint8_t wait) {
+    return wait ? 1000.0 / wait : 0;
 }
 
-void NeoPixel::rainbow(uint8_t wait) {
-    uint16_t i, j;
+void NeoPixel::runEffect(Effect& effect, uint8_t wait) {
+    NeoPixelSegment all(this, 0, numLEDs);
+    unsigned int step = wait ? wait : 1;
+    unsigned long f;
 
-    for(j=0; j<256; j++) {
-        for(i=0; i<numPixels(); i++) {
-            setPixelColor(i, wheel((i+j) & 255));
-        }
+    scheduler.start(effectFPS(wait));
+    for(f=0; effect.render(f * step, all); f=scheduler.next()) {
         show();
-        usleep(wait * 1000);
     }
 }
 
-void NeoPixel::rainbowCycle(uint8_t wait) {
-    uint16_t i, j;
+void NeoPixel::colorWipe(Color_t c, uint8_t wait) {
+    ColorWipeEffect effect(c, wait, numPixels());
+    runEffect(effect, wait);
+}
 
-    for(j=0; j<256*5; j++) {
-        for(i=0; i<numPixels(); i++) {
-            setPixelColor(i, wheel(((i * 256 / numPixels()) + j) & 255));
-        }
-        show();
-        usleep(wait * 1000);
-    }
+void NeoPixel::rainbow(uint8_t wait) {
+    RainbowEffect effect(wait);
+    runEffect(effect, wait);
 }
 
-void NeoPixel::theaterChase(Color_t c, uint8_t wait) {
-    unsigned int j, q, i;
-    for (j=0; j<15; j++) {
-        for (q=0; q < 3; q++) {
-            for (i=0; i < numPixels(); i=i+3) {
-                setPixelColor(i+q, c);
-            }
-            show();
-     
-            usleep(wait * 1000);
+void NeoPixel::rainbowCycle(uint8_t wait) {
+    RainbowEffect effect(wait, 5, true);
+    runEffect(effect, wait);
+}
 
-            for (i=0; i < numPixels(); i=i+3) {
-                setPixelColor(i+q, 0, 0, 0);
-            }
-        }
-    }
+void NeoPixel::theaterChase(Color_t c, uint8_t wait) {
+    TheaterChaseEffect effect(c, wait, 15);
+    runEffect(effect, wait);
 }
 
 void NeoPixel::theaterChaseRainbow(uint8_t wait) {
-    int j, q, i;
-    for (j=0; j < 256; j+=4) {
-        for (q=0; q < 3; q++) {
-            for (i=0; i < numPixels(); i=i+3) {
-                setPixelColor(i+q, wheel((i+j) % 255));
-            }
-            show();
-
-            usleep(wait * 1000);
-       
-            for (i=0; i < numPixels(); i=i+3) {
-                setPixelColor(i+q, 0, 0, 0);
-            }
-        }
-    }
+    TheaterChaseEffect effect(Color_t(), wait, 64, true);
+    runEffect(effect, wait);
 }
 
 long NeoPixel::map(long x, long in_min, long in_max, long out_min, long out_max){
@@ -578,14 +1285,16 @@ void NeoPixel::gradient(std::vector<Color_t>& scheme, int repeat, int speedMS){
     for(int i=0; i<numLEDs; ++i){
         Color_t currentColor=gradientColor(scheme, range, gradRange, i+offset);
         if(speedMS>0){
-            setPixelColor(
+            setPixelUnchecked(
                 i,
-                map(time%speedMS, 0, speedMS, oldColor.r, currentColor.r),
-                map(time%speedMS, 0, speedMS, oldColor.g, currentColor.g),
-                map(time%speedMS, 0, speedMS, oldColor.b, currentColor.b)
+                RGB2Color(
+                    map(time%speedMS, 0, speedMS, oldColor.r, currentColor.r),
+                    map(time%speedMS, 0, speedMS, oldColor.g, currentColor.g),
+                    map(time%speedMS, 0, speedMS, oldColor.b, currentColor.b)
+                )
             );
         } else {
-            setPixelColor(i, currentColor.r, currentColor.g, currentColor.b);
+            setPixelUnchecked(i, currentColor);
         }
         oldColor=currentColor;
     }
@@ -600,32 +1309,52 @@ void NeoPixel::bars(std::vector<Color_t>& scheme, int width, int speedMS){
 
     for(int i=0; i<numLEDs; ++i){
         int colorIndex=((i+offset)%(scheme.size()*width))/width;
-        setPixelColor(i, scheme[colorIndex].r, scheme[colorIndex].g, scheme[colorIndex].b);
+        setPixelUnchecked(i, scheme[colorIndex]);
     }
     show();
 }
 
+SoftDMA* NeoPixel::getSoftDMA(){ return transport ? transport->getSoftDMA() : 0; }
+
+FrameScheduler& NeoPixel::getScheduler(){ return scheduler; }
+
+const char* NeoPixel::getTransportName(){ return transport ? transport->name() : "none"; }
+
+bool NeoPixel::reattached(){ return transport && transport->reattached(); }
+
 void NeoPixel::effectsDemo() {
     int i, j, ptr;
     float k;
 
     // Default effects from the Arduino lib
-    colorWipe(Color(255, 0, 0), 50); // Red
-    colorWipe(Color(0, 255, 0), 50); // Green
-    colorWipe(Color(0, 0, 255), 50); // Blue
-    theaterChase(Color(127, 127, 127), 50); // White
-    theaterChase(Color(127,   0,   0), 50); // Red
-    theaterChase(Color(  0,   0, 127), 50); // Blue
-    rainbow(5);
-    rainbowCycle(5);
-    theaterChaseRainbow(50);
+    ColorWipeEffect redWipe(Color(255, 0, 0), 50, numLEDs);
+    ColorWipeEffect greenWipe(Color(0, 255, 0), 50, numLEDs);
+    ColorWipeEffect blueWipe(Color(0, 0, 255), 50, numLEDs);
+    TheaterChaseEffect whiteChase(Color(127, 127, 127), 50, 15);
+    TheaterChaseEffect redChase(Color(127,   0,   0), 50, 15);
+    TheaterChaseEffect blueChase(Color(  0,   0, 127), 50, 15);
+    RainbowEffect rainbowEffect(5);
+    RainbowEffect rainbowCycleEffect(5, 5, true);
+    TheaterChaseEffect rainbowChase(Color_t(), 50, 64, true);
+    EffectSequence arduino;
+
+    arduino.add(&redWipe);
+    arduino.add(&greenWipe);
+    arduino.add(&blueWipe);
+    arduino.add(&whiteChase);
+    arduino.add(&redChase);
+    arduino.add(&blueChase);
+    arduino.add(&rainbowEffect);
+    arduino.add(&rainbowCycleEffect);
+    arduino.add(&rainbowChase);
+    runEffect(arduino, 5);
 
     // Watermelon fade :)
     for(k=0; k<0.5; k+=.01) {
         ptr=0;
         setBrightness(k);
         for(i=0; i<numLEDs; i++) {
-            setPixelColor(i, i*5, 64, i*2);
+            setPixelUnchecked(i, RGB2Color(i*5, 64, i*2));
         }
         show();
     }
@@ -633,7 +1362,7 @@ void NeoPixel::effectsDemo() {
         ptr=0;
         setBrightness(k);
         for(i=0; i<numLEDs; i++) {
-            setPixelColor(i, i*5, 64, i*2);
+            setPixelUnchecked(i, RGB2Color(i*5, 64, i*2));
         }
         show();
     }
@@ -664,13 +1393,14 @@ void NeoPixel::effectsDemo() {
         }
         for(k=0; k<1; k+=.01) {
             for(i=0; i<numLEDs; i++) {
-                setPixelColor(
+                setPixelUnchecked(
                     i,
-                    (red * k) + (lastRed * (1-k)),
-                    i * (255 / numLEDs), //(green * k) + (lastGreen * (1-k)),
-                    (blue * k) + (lastBlue * (1-k))
-                    );
-                curPixel = getPixelColor(i);
+                    RGB2Color(
+                        (red * k) + (lastRed * (1-k)),
+                        i * (255 / numLEDs), //(green * k) + (lastGreen * (1-k)),
+                        (blue * k) + (lastBlue * (1-k))
+                    ));
+                curPixel = getPixelUnchecked(i);
             }
             show();
         }
@@ -679,3 +1409,90 @@ void NeoPixel::effectsDemo() {
         lastBlue = blue;
     }
 }
+
+// NeoPixelSegment
+
+NeoPixelSegment::NeoPixelSegment(NeoPixel *strip, unsigned int offset, unsigned int length)
+    : strip(strip), offset(offset), length(length)
+{
+}
+
+unsigned char NeoPixelSegment::setPixelColor(unsigned int n, unsigned char r, unsigned char g, unsigned char b){
+    return setPixelColor(n, Color_t(r, g, b));
+}
+
+unsigned char NeoPixelSegment::setPixelColor(unsigned int n, Color_t c){
+    if(n >= length) {
+        strip->rangeError();
+        return false;
+    }
+    strip->setPixelUnchecked(offset + n, c);
+    return true;
+}
+
+Color_t NeoPixelSegment::getPixelColor(unsigned int n){
+    if(n >= length) {
+        strip->rangeError();
+        return Color_t(0, 0, 0);
+    }
+    return strip->getPixelUnchecked(offset + n);
+}
+
+unsigned char NeoPixelSegment::setPixels(unsigned int first, const Color_t *colors, unsigned int count){
+    if(first > length || count > length - first) {
+        strip->rangeError();
+        return false;
+    }
+    return strip->setPixels(offset + first, colors, count);
+}
+
+unsigned char NeoPixelSegment::fill(unsigned int first, unsigned int count, Color_t c){
+    if(first > length || count > length - first) {
+        strip->rangeError();
+        return false;
+    }
+    return strip->fill(offset + first, count, c);
+}
+
+unsigned char NeoPixelSegment::setPixelWhite(unsigned int n, unsigned char w){
+    if(n >= length) {
+        strip->rangeError();
+        return false;
+    }
+    return strip->setPixelWhite(offset + n, w);
+}
+
+unsigned int NeoPixelSegment::numPixels(){ return length; }
+
+void NeoPixelSegment::clear(){ fill(0, length, Color_t(0, 0, 0)); }
+
+void NeoPixelSegment::show(){ strip->show(); }
+
+NeoPixel *NeoPixelSegment::getStrip(){ return strip; }
+
+NeoPixelView::NeoPixelView(NeoPixel *strip, unsigned int offset, unsigned int length)
+    : NeoPixelSegment(strip, offset, length), ready(false)
+{
+}
+
+bool NeoPixelView::commit(){
+    bool sent;
+
+    pthread_mutex_lock(&strip->viewLock);
+    if(!ready) {
+        ready = true;
+        strip->viewsReady++;
+    }
+    sent = strip->flushViews();
+    pthread_mutex_unlock(&strip->viewLock);
+    return sent;
+}
+
+bool NeoPixelView::committed(){
+    bool r;
+
+    pthread_mutex_lock(&strip->viewLock);
+    r = ready;
+    pthread_mutex_unlock(&strip->viewLock);
+    return r;
+}
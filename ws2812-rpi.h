@@ -40,19 +40,137 @@
 #include <string.h>
 #include <errno.h>
 #include <math.h>
+#include <pthread.h>
 #include <time.h>
 #include <signal.h>
+#include <sys/timerfd.h>
 
 #include <vector>
+#include <string>
+#include <algorithm>
 #include "ws2812-rpi-defines.h"
+#include "ws2812-rpi-encoder.h"
+#include "ws2812-rpi-softdma.h"
+#include "ws2812-rpi-transport.h"
+#include "ws2812-rpi-scheduler.h"
+#include "ws2812-rpi-recording.h"
+#include "ws2812-rpi-workers.h"
+
+class NeoPixel;
+class Effect;
+
+// Counters since the strip was created, from NeoPixel::getStats()
+struct NeoPixelStats {
+    // Frames put on the wire, show() calls with nothing changed (never
+    // sent), and queued submit() frames replaced before they went out
+    unsigned long framesShown;
+    unsigned long framesSkipped;
+    unsigned long framesReplaced;
+
+    // Transfers still running after their frame time plus the latch, i.e.
+    // the DMA stalled and the wire had gaps in it
+    unsigned long underruns;
+    // Peripheral FIFO and bus errors, and DMA controller errors
+    unsigned long fifoErrors;
+    unsigned long dmaErrors;
+    unsigned long rangeErrors;
+
+    // Time spent encoding each changed frame into the idle DMA buffer, and
+    // time show() waited for the previous frame to latch, in microseconds
+    // (see STATS_BUCKETS), with the total of each
+    unsigned long encodeHist[STATS_BUCKETS];
+    unsigned long encodeMaxUS;
+    unsigned long encodeLastUS;
+    unsigned long encodeSumUS;
+    unsigned long waitHist[STATS_BUCKETS];
+    unsigned long waitMaxUS;
+    unsigned long waitLastUS;
+    unsigned long waitSumUS;
+};
+
+// A run of pixels in a NeoPixel's LED buffer, addressed from zero. It doesn't
+// own anything, so it mustn't outlive the strip it came from.
+class NeoPixelSegment {
+public:
+    NeoPixelSegment(NeoPixel *strip, unsigned int offset, unsigned int length);
+
+    unsigned char setPixelColor(unsigned int n, unsigned char r, unsigned char g, unsigned char b);
+    unsigned char setPixelColor(unsigned int n, Color_t c);
+    Color_t getPixelColor(unsigned int n);
+    unsigned char setPixels(unsigned int first, const Color_t *colors, unsigned int count);
+    unsigned char fill(unsigned int first, unsigned int count, Color_t c);
+    unsigned char setPixelWhite(unsigned int n, unsigned char w);
+    // No bounds check, n must be below numPixels()
+    inline void setPixelUnchecked(unsigned int n, Color_t c);
+    inline Color_t getPixelUnchecked(unsigned int n);
+    unsigned int numPixels();
+    void clear();
+    // Shows the whole strip, the segment's channel can't go out on its own
+    void show();
+    // The strip the segment is part of
+    NeoPixel *getStrip();
+
+protected:
+    NeoPixel *strip;
+    unsigned int offset;
+    unsigned int length;
+};
+
+// A segment for one of several owners sharing a strip, each writing its own
+// part of the frame. Instead of a show() apiece, each owner calls commit()
+// when its part is ready; the commit that completes the set puts the whole
+// frame out in one transfer. Created and owned by the strip.
+//
+// Each owner may run on its own thread: setting pixels, commit() and
+// releasing a view are safe alongside the other owners. Everything else on
+// the strip, handleCompletion() included, stays with one thread.
+class NeoPixelView : public NeoPixelSegment {
+public:
+    // True if this completed the frame, which was then submitted: sent
+    // straight away, or queued behind the frame on the wire as by submit()
+    bool commit();
+    // Committed since the last frame went out
+    bool committed();
+
+private:
+    friend class NeoPixel;
+    NeoPixelView(NeoPixel *strip, unsigned int offset, unsigned int length);
+
+    bool ready;
+};
 
 class NeoPixel {
 public:
-    NeoPixel(unsigned int n);
+    // Output is PWM on GPIO18 unless NEOPIXEL_PCM, NEOPIXEL_SPI or
+    // NEOPIXEL_LOOPBACK picks another transport.
+    // With NEOPIXEL_DUAL_CHANNEL, n is the length of each of two strips: one
+    // on GPIO18 (PWM channel 1) and one on GPIO19 (channel 2), sent in one
+    // DMA transfer. Pixels 0 to n-1 are the first strip, n to 2n-1 the second.
+    // The pixel format is GRB unless NEOPIXEL_RGB, NEOPIXEL_GRBW or
+    // NEOPIXEL_RGBW says otherwise; see also NeoPixelStrip.
+    NeoPixel(unsigned int n, unsigned int flags=0);
     ~NeoPixel();
 
     void begin();
     void show();
+    // show() in two halves, for callers that must keep other threads off the
+    // pixels while they are read but not while the wire is waited for.
+    // encodeFrame() brings the idle buffer up to date and returns false if
+    // nothing changed; sendFrame() then waits for the frame on the wire to
+    // latch and starts this one.
+    bool encodeFrame();
+    void sendFrame();
+
+    // Non-blocking show() for event loops. submit() puts the frame on the
+    // wire straight away if it is free and returns true; otherwise the frame
+    // is queued (replacing any frame already queued) and false is returned.
+    // The completion descriptor becomes readable when the frame on the wire
+    // has latched; call handleCompletion() then, which starts any queued
+    // frame and returns false if the wake up was early.
+    bool submit();
+    int getCompletionFD();
+    bool handleCompletion();
+    bool busy();
 
     unsigned long millis(void){
         struct timespec ts;
@@ -62,17 +180,105 @@ public:
 
     unsigned char setPixelColor(unsigned int n, unsigned char r, unsigned char g, unsigned char b);
     unsigned char setPixelColor(unsigned int n, Color_t c);
+    // Brightness, gamma and white balance are applied as the frame is
+    // encoded, through a table rebuilt only when one of them changes. The
+    // LED buffer is never touched, so getPixelColor() returns what was set.
     bool setBrightness(float b);
+    bool setGamma(float g);
+    void setWhiteBalance(unsigned char r, unsigned char g, unsigned char b);
 
     //Color_t* getPixels();
     std::vector<Color_t> getPixels();
+    // Bulk operations on the pixels from first to first + count - 1. Only
+    // the pixels that actually change are marked for re-encoding.
+    unsigned char setPixels(unsigned int first, const Color_t *colors, unsigned int count);
+    unsigned char fill(unsigned int first, unsigned int count, Color_t c);
+    // Moves count pixels from src to dest; the two runs may overlap
+    unsigned char copyWithin(unsigned int dest, unsigned int src, unsigned int count);
+
+    // For callers that have already checked n is below numPixels(), such as
+    // effects looping over a strip or segment: no bounds check, no call
+    inline void setPixelUnchecked(unsigned int n, Color_t c){
+        if(LEDBuffer[n] != c) {
+            LEDBuffer[n] = c;
+            markDirty(n);
+        }
+    }
+    inline Color_t getPixelUnchecked(unsigned int n){ return LEDBuffer[n]; }
+
+    // The white channel of four channel (NEOPIXEL_GRBW or _RGBW) strips,
+    // kept apart from the Color_t buffer; on other strips every pixel is out
+    // of range. Brightness and gamma apply to it, white balance doesn't.
+    unsigned char setPixelWhite(unsigned int n, unsigned char w);
+    unsigned char getPixelWhite(unsigned int n);
+    // Colour bytes each pixel sends: 3, or 4 with white
+    unsigned int getColorChannels();
+
+    // Out of range pixel calls do nothing and return false (or black). They
+    // are counted here rather than printed, so a bad loop can't flood stdout.
+    unsigned long getRangeErrors();
+    // Frame, error and timing counters. Keeping them costs a couple of clock
+    // reads per frame; reading them is safe from any thread, though the
+    // fields are read one by one rather than as a single snapshot.
+    NeoPixelStats getStats();
+    // Writes the counters to path in the Prometheus text format, through a
+    // temporary file so readers never see half of it
+    bool writeStats(const char *path);
+    // Has show() and submit() write the counters to path at most once every
+    // intervalMS milliseconds. An empty path stops it.
+    void setStatsFile(const char *path, unsigned int intervalMS=1000);
+
+    // Records every changed frame show() or submit() sends, with its time,
+    // to path until stopRecording(). See AnimationPlayer for playing it back.
+    bool startRecording(const char *path, unsigned int keyInterval=RECORDING_KEY_INTERVAL);
+    bool stopRecording();
+    // Direct access to the LED buffer, numPixels() long, for callers that
+    // fill it themselves. Changes made through it are picked up by show()
+    // until the matching releasePixelData().
+    Color_t* getPixelData();
+    void releasePixelData();
     float getBrightness();
+    float getGamma();
+    Color_t getWhiteBalance();
     Color_t getPixelColor(unsigned int n);
 
     unsigned int numPixels();
 
     void clear();
 
+    // Pixels re-encoded by the last show(); 0 if nothing had changed and the
+    // frame wasn't sent at all
+    float getEncodedPercent();
+
+    // Spreads encoding over threads threads, counting the one calling show(),
+    // for strips of thousands of LEDs on multi-core boards. The workers are
+    // started here and sleep between frames. Each takes whole dirty groups,
+    // so they write disjoint words and the frame is the same as encoded on
+    // one thread. 1, the default, encodes on the calling thread; 0 picks one
+    // thread per core. Returns false if the threads couldn't be started.
+    bool setEncodeThreads(unsigned int threads);
+    unsigned int getEncodeThreads();
+
+    // A single channel strip encodes straight into the idle DMA buffer, so
+    // each frame's words are written once. Turned off, or with two channels
+    // whose words have to be interleaved, frames are encoded into a copy of
+    // the waveform first and the changed words copied over from there; the
+    // wire sees the same either way. Returns true if encoding straight in.
+    bool setDirectEncode(bool direct);
+
+    // Each PWM channel's strip as its own logical strip
+    unsigned int getNumChannels();
+    NeoPixelSegment channel(unsigned int c);
+
+    // Views over pixels offset to offset + length - 1, for owners that share
+    // the strip; see NeoPixelView. They may overlap. The strip deletes them
+    // in releaseView() or its destructor. Returns 0 if out of range.
+    NeoPixelView* createView(unsigned int offset, unsigned int length);
+    void releaseView(NeoPixelView *view);
+    unsigned int numViews();
+
+    // Blocking effects, run on the whole strip until they finish. See
+    // EffectEngine for running them without blocking.
     static Color_t wheel(uint8_t wheelPos);
     void colorWipe(Color_t c, uint8_t wait);
     void rainbow(uint8_t wait);
@@ -87,42 +293,170 @@ public:
 
     void effectsDemo();
 
+    // Paces the effects above; its statistics cover the last one run
+    FrameScheduler& getScheduler();
+
+    // Only set when constructed with NEOPIXEL_SOFT_DMA (NEOPIXEL_LOOPBACK)
+    SoftDMA* getSoftDMA();
+    // "pwm", "pcm", "spi" or "loopback"
+    const char* getTransportName();
+    // True if constructed with NEOPIXEL_REATTACH and the output was found
+    // already set up by an earlier process, so it was taken over as it was
+    bool reattached();
+
 private:
+    // Segments count their own range errors against the strip
+    friend class NeoPixelSegment;
+    friend class NeoPixelView;
+
     static void printBinary(unsigned int i, unsigned int bits);
     static unsigned int reverseWord(unsigned int word);
 
     void terminate(int dummy);
-    void fatal(char *fmt, ...);
+    void fatal(const char *fmt, ...);
 
     unsigned int mem_virt_to_phys(void *virt);
-    unsigned int mem_phys_to_virt(uint32_t phys);
-    void* map_peripheral(uint32_t base, uint32_t len);
+    uint8_t* mem_phys_to_virt(uint32_t phys);
 
     void clearPWMBuffer();
     void clearLEDBuffer();
 
+    static float effectFPS(uint8_t wait);
+    void runEffect(Effect& effect, uint8_t wait);
+
     static Color_t RGB2Color(unsigned char r, unsigned char g, unsigned char b);
     static Color_t Color(unsigned char r, unsigned char g, unsigned char b);
 
-    void setPWMBit(unsigned int bitPos, unsigned char bit);
-    unsigned char getPWMBit(unsigned int bitPos);
-
+    void allocDMAMemory();
+    void buildChain(unsigned int buffer);
     void initHardware();
-    void startTransfer();
+    bool prepareFrame();
+    void findMappedChanges();
+    void markDirty(unsigned int pixel);
+    bool inRange(unsigned int first, unsigned int count);
+    void markAllDirty();
+    static bool nextGroup(const std::vector<uint32_t>& map, unsigned int g,
+                          unsigned int& first, unsigned int& last);
+    void startTransfer(unsigned int buffer);
+    bool transferActive();
+    bool transferFinished();
+    void waitTransfer();
+    void armCompletion();
+
+    static void statAdd(unsigned long& counter, unsigned long n=1);
+    static unsigned long statLoad(const unsigned long& counter);
+    void rangeError();
+    static void statTime(unsigned long *hist, unsigned long& maxUS, unsigned long& lastUS,
+                         unsigned long& sumUS, const struct timespec& since);
+    void statsTick();
+    void recordFrame();
+    bool flushViews();
+    void markStale();
+    unsigned int encodeGroups(const std::vector<uint32_t>& map, unsigned int *words);
+    static void encodeTask(void *strip, unsigned int job);
 
     unsigned int numLEDs;
+    unsigned int flags;
     std::vector<Color_t> LEDBuffer;
     float brightness;
-    unsigned int PWMWaveform[NUM_DATA_WORDS];
+    float gamma;
+    Color_t whiteBalance;
+    SymbolLUT lut;
+    WS2812Encoder::EncodeFunc encodeFn;
+    unsigned int colorChannels;
+    // PWM words in a dirty group, DIRTY_GROUP_WORDS or more with white
+    unsigned int groupWords;
+    // Empty unless the format has a white channel
+    std::vector<uint8_t> whiteBuffer;
+    unsigned int numChannels;
+    unsigned int channelLEDs;
+    unsigned int channelGroups;
+    unsigned int channelWords;
+    unsigned int frameWords;
+    // Each channel's words back to back, channelWords apiece. Empty while
+    // encoding straight into the DMA buffers.
+    std::vector<unsigned int> PWMWaveform;
+
+    // Groups of pixels changed since the last frame, and per DMA buffer the
+    // groups where it is behind the pixels (or behind PWMWaveform, when that
+    // is in use)
+    // Owners of views set dirty bits from their own threads, so dirtyMap and
+    // dirtyGroups only change through atomics; markStale() takes the bits
+    // for a frame into frameDirty
+    std::vector<uint32_t> dirtyMap;
+    std::vector<uint32_t> frameDirty;
+    std::vector<uint32_t> staleMap[NUM_BUFFERS];
+    unsigned int dirtyGroups;
+    unsigned int encodedPixels;
+
+    // LEDs start to end of a channel, the dirty runs of this frame cut into
+    // pieces for the workers
+    struct EncodeJob {
+        unsigned int channel;
+        unsigned int start;
+        unsigned int end;
+    };
+    std::vector<EncodeJob> encodeJobs;
+    WorkerPool *encodePool;
+    // Where the jobs write: PWMWaveform, or the idle DMA buffer
+    unsigned int *encodeWords;
+    bool directEncode;
+    unsigned long rangeErrors;
+
+    // Written only by the thread driving the strip; see statAdd()
+    NeoPixelStats stats;
+    bool overran;
+    std::string statsPath;
+    unsigned int statsInterval;
+    unsigned long statsWritten;
+
+    AnimationRecorder *recorder;
+    unsigned long recordStart;
+
+    // Views sharing the strip, and how many have committed this frame.
+    // viewLock covers both, and the frame a commit sends.
+    std::vector<NeoPixelView*> views;
+    unsigned int viewsReady;
+    pthread_mutex_t viewLock;
+
+    // While getPixelData() is in use, the pixels as of the last frame
+    unsigned int pixelDataRefs;
+    bool pixelDataMapped;
+    std::vector<Color_t> shownPixels;
 
-    static struct control_data_s *ctl;
     page_map_t *page_map;
-    static uint8_t *virtbase;
+    uint8_t *virtbase;
+    unsigned int numPages;
+    std::vector<std::pair<uint32_t, unsigned int> > physIndex;
+    dma_cb_t *cbs[NUM_BUFFERS];
+    uint32_t *sample[NUM_BUFFERS];
+
+    unsigned int backBuffer;
+    bool transferPending;
+    bool framePending;
+    struct timespec transferEnd;
+    int completionFD;
+    WS2812Transport *transport;
+    FrameScheduler scheduler;
+    bool swapBytes;
+};
 
-    static volatile unsigned int *pwm_reg;
-    static volatile unsigned int *clk_reg;
-    static volatile unsigned int *dma_reg;
-    static volatile unsigned int *gpio_reg;
+// A strip with its pixel format in its type, e.g. NeoPixelStrip<FormatGRBW>
+// for an SK6812 RGBW strip. Format::flag replaces any format in flags.
+template<class Format>
+class NeoPixelStrip : public NeoPixel {
+public:
+    NeoPixelStrip(unsigned int n, unsigned int flags=0)
+        : NeoPixel(n, (flags & ~NEOPIXEL_FORMAT_MASK) | Format::flag)
+    {}
 };
 
+void NeoPixelSegment::setPixelUnchecked(unsigned int n, Color_t c){
+    strip->setPixelUnchecked(offset + n, c);
+}
+
+Color_t NeoPixelSegment::getPixelUnchecked(unsigned int n){
+    return strip->getPixelUnchecked(offset + n);
+}
+
 #endif